@@ -0,0 +1,73 @@
+#version 330 core
+
+// The procedural corrosion, linked into the gear programs next to pattern.frag and depth.frag.
+// A fragment shader with a discard in it loses early depth testing on most GPUs, so the program
+// that shades after the depth prepass links corrosiondepth.frag instead.
+
+// the same block as pattern.vert:
+layout(std140) uniform MaterialBlock
+{
+	vec4	uColor;				// object color
+	float	uKa, uKd, uKs;		// coefficients of each type of lighting -- make sum to 1.0
+	float	uShininess;			// specular exponent
+	vec4	uCorrosionSeed;		// xyz: offset into the noise, so every gear and seed looks different
+	float	uCorrosionScale;	// noise cells per unit of length
+	float	uCorrosionDensity;	// noise level below which the metal is eaten away, 0. is clean, 1. is gone
+	float	uToothAngle;		// angle between instanced teeth
+	bool	isCorroded;			// if the gear is corroded, only ever set for the second wheel
+};
+
+// integer hash of a lattice point, the same mixer the C++ side uses:
+uint
+Hash( ivec3 c )
+{
+	uvec3 p = uvec3( c );
+	uint h = ( p.x * 0x8da6b343u ) ^ ( p.y * 0xd8163841u ) ^ ( p.z * 0xcb1ab31fu );
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	h *= 0x846ca68bu;
+	h ^= h >> 16;
+	return h;
+}
+
+float
+Lattice( ivec3 c )
+{
+	return float( Hash( c ) & 0xffffu ) / 65535.;
+}
+
+// 3D value noise: random values on the integer lattice, smoothly interpolated
+float
+ValueNoise( vec3 p )
+{
+	vec3 i = floor( p );
+	vec3 f = p - i;
+	vec3 u = f * f * ( 3. - 2. * f );
+	ivec3 c = ivec3( i );
+
+	float x00 = mix( Lattice( c ),                  Lattice( c + ivec3(1,0,0) ), u.x );
+	float x10 = mix( Lattice( c + ivec3(0,1,0) ),   Lattice( c + ivec3(1,1,0) ), u.x );
+	float x01 = mix( Lattice( c + ivec3(0,0,1) ),   Lattice( c + ivec3(1,0,1) ), u.x );
+	float x11 = mix( Lattice( c + ivec3(0,1,1) ),   Lattice( c + ivec3(1,1,1) ), u.x );
+	return mix( mix( x00, x10, u.y ), mix( x01, x11, u.y ), u.z );
+}
+
+// three octaves, so the pits have ragged edges:
+float
+CorrosionNoise( vec3 p )
+{
+	float n = 0.5714 * ValueNoise( p );
+	n += 0.2857 * ValueNoise( 2.03 * p );
+	n += 0.1429 * ValueNoise( 4.01 * p );
+	return n;
+}
+
+// throw away the fragments where the metal is eaten away:
+void
+Corrode( vec3 mc )
+{
+	if (isCorroded) {
+		if( CorrosionNoise( uCorrosionScale * mc + uCorrosionSeed.xyz ) < uCorrosionDensity ) discard;
+	}
+}
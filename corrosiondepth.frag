@@ -0,0 +1,9 @@
+#version 330 core
+
+// Corrode( ) for the program that shades after the depth prepass: depth.frag already cut the holes
+// into the depth buffer and the depth test keeps only what is left, so nothing is discarded here
+// and the GPU can test the depth before running pattern.frag.
+void
+Corrode( vec3 mc )
+{
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+// The depth prepass of the corroded gears: no color, only the depth of the metal that is left.
+in vec3		vMC;			// model coordinates
+
+// in corrosion.frag:
+void	Corrode( vec3 mc );
+
+void
+main( )
+{
+	Corrode( vMC );
+}
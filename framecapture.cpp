@@ -0,0 +1,251 @@
+#include "framecapture.h"
+#include "imagefile.h"
+
+#include <string.h>
+
+FrameCapture::FrameCapture()
+{
+	for (int i = 0; i < CAPTURE_RING_SIZE; i++) {
+		Ring[i].Pbo = 0;
+		Ring[i].Size = 0;
+		Ring[i].Fence = 0;
+		Ring[i].Width = Ring[i].Height = 0;
+		Ring[i].Number = 0;
+	}
+	NextSlot = 0;
+	Format = IMAGE_PNG;
+	NextNumber = 0;
+	Capturing = false;
+	Writing = 0;
+	NumWritten = NumFailed = NumWaits = 0;
+	Quit = false;
+}
+
+FrameCapture::~FrameCapture()
+{
+	if (Capturing) {
+		Stop();
+	}
+	for (size_t i = 0; i < FreeFrames.size(); i++) {
+		delete FreeFrames[i];
+	}
+}
+
+// starts the readback of the w x h pixels at x, y of the current read buffer
+// and hands the frame of CAPTURE_RING_SIZE - 1 captures ago to the writers:
+void
+FrameCapture::Capture(int x, int y, int w, int h)
+{
+	if (!Capturing) {
+		return;
+	}
+
+	// only after a Stop( ) in between could this slot still be busy:
+	Slot& slot = Ring[NextSlot];
+	if (slot.Fence != 0) {
+		Collect(slot);
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.Pbo);
+	GLsizei size = 4 * w * h;
+	if (size != slot.Size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		slot.Size = size;
+	}
+	// RGBA rows are whole words, the same as the framebuffer, so the driver has nothing to repack:
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.Width = w;
+	slot.Height = h;
+	slot.Number = NextNumber++;
+
+	NextSlot = (NextSlot + 1) % CAPTURE_RING_SIZE;
+	if (Ring[NextSlot].Fence != 0) {
+		Collect(Ring[NextSlot]);
+	}
+}
+
+// maps the slot's buffer, copies the pixels into a frame and queues it for the writers:
+void
+FrameCapture::Collect(Slot& slot)
+{
+	// the fence is normally signalled already, the flush only matters for the last frames from Stop( ):
+	glClientWaitSync(slot.Fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+	glDeleteSync(slot.Fence);
+	slot.Fence = 0;
+
+	Frame* frame;
+	{
+		std::unique_lock<std::mutex> lock(Mutex);
+		if (Queue.size() >= CAPTURE_MAX_QUEUED) {
+			NumWaits++;
+			Done.wait(lock, [this] { return Queue.size() < CAPTURE_MAX_QUEUED; });
+		}
+		if (FreeFrames.empty()) {
+			frame = new Frame;
+		}
+		else {
+			frame = FreeFrames.back();
+			FreeFrames.pop_back();
+		}
+	}
+
+	frame->Width = slot.Width;
+	frame->Height = slot.Height;
+	frame->Number = slot.Number;
+	frame->Pixels.resize(slot.Size);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.Pbo);
+	void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.Size, GL_MAP_READ_BIT);
+	if (pixels != NULL) {
+		memcpy(&frame->Pixels[0], pixels, slot.Size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	else {
+		memset(&frame->Pixels[0], 0, slot.Size);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		Queue.push_back(frame);
+	}
+	WakeUp.notify_one();
+}
+
+bool
+FrameCapture::IsCapturing() const
+{
+	return Capturing;
+}
+
+void
+FrameCapture::PrintStats(FILE* fp)
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	fprintf(fp, "Capture: %d frames written", NumWritten);
+	if (NumFailed > 0) {
+		fprintf(fp, ", %d could not be written", NumFailed);
+	}
+	if (!Queue.empty() || Writing > 0) {
+		fprintf(fp, ", %d on the way", (int)Queue.size() + Writing);
+	}
+	fprintf(fp, ", the writers held up the frames %d times\n", NumWaits);
+}
+
+// files are named prefix00000.png, prefix00001.png, ... and the numbers go on after a Stop( ) and Start( ).
+// numWriters <= 0 means half the hardware threads, the gear meshes and the driver want the rest:
+void
+FrameCapture::Start(const char* prefix, int format, int numWriters)
+{
+	if (Capturing) {
+		return;
+	}
+	if (numWriters <= 0) {
+		numWriters = (int)std::thread::hardware_concurrency() / 2;
+	}
+	if (numWriters <= 0) {
+		numWriters = 1;
+	}
+
+	Prefix = prefix;
+	Format = format;
+	for (int i = 0; i < CAPTURE_RING_SIZE; i++) {
+		glGenBuffers(1, &Ring[i].Pbo);
+		Ring[i].Size = 0;
+		Ring[i].Fence = 0;
+	}
+	NextSlot = 0;
+	NumWritten = NumFailed = NumWaits = 0;
+	Quit = false;
+	for (int i = 0; i < numWriters; i++) {
+		Writers.push_back(std::thread(&FrameCapture::WriterLoop, this));
+	}
+	Capturing = true;
+}
+
+// collects the frames still in the ring, oldest first, and waits until the writers are done with all of them:
+void
+FrameCapture::Stop()
+{
+	if (!Capturing) {
+		return;
+	}
+	for (int i = 0; i < CAPTURE_RING_SIZE; i++) {
+		Slot& slot = Ring[(NextSlot + i) % CAPTURE_RING_SIZE];
+		if (slot.Fence != 0) {
+			Collect(slot);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		Quit = true;
+	}
+	WakeUp.notify_all();
+	for (size_t i = 0; i < Writers.size(); i++) {
+		Writers[i].join();
+	}
+	Writers.clear();
+
+	for (int i = 0; i < CAPTURE_RING_SIZE; i++) {
+		glDeleteBuffers(1, &Ring[i].Pbo);
+		Ring[i].Pbo = 0;
+		Ring[i].Size = 0;
+	}
+	Capturing = false;
+}
+
+// the writers only quit once the queue is empty, so Stop( ) loses no frames:
+void
+FrameCapture::WriterLoop()
+{
+	std::vector<unsigned char> rgb;
+	char file[1024];
+	for (;;) {
+		Frame* frame;
+		{
+			std::unique_lock<std::mutex> lock(Mutex);
+			WakeUp.wait(lock, [this] { return Quit || !Queue.empty(); });
+			if (Queue.empty()) {
+				return;
+			}
+			frame = Queue.front();
+			Queue.pop_front();
+			Writing++;
+		}
+		Done.notify_all();
+
+		// RGBA from the bottom up to RGB from the top down:
+		int width = frame->Width;
+		int height = frame->Height;
+		rgb.resize((size_t)3 * width * height);
+		for (int row = 0; row < height; row++) {
+			const unsigned char* src = &frame->Pixels[(size_t)4 * width * (height - 1 - row)];
+			unsigned char* dst = &rgb[(size_t)3 * width * row];
+			for (int x = 0; x < width; x++) {
+				dst[3 * x + 0] = src[4 * x + 0];
+				dst[3 * x + 1] = src[4 * x + 1];
+				dst[3 * x + 2] = src[4 * x + 2];
+			}
+		}
+
+		snprintf(file, sizeof(file), "%s%05d.%s", Prefix.c_str(), frame->Number, Format == IMAGE_PNG ? "png" : "ppm");
+		bool written = WriteImage(file, width, height, &rgb[0], Format);
+		if (!written) {
+			fprintf(stderr, "Cannot write '%s'\n", file);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			Writing--;
+			if (written)
+				NumWritten++;
+			else
+				NumFailed++;
+			FreeFrames.push_back(frame);
+		}
+	}
+}
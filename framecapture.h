@@ -0,0 +1,82 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+// Records the frames as an image sequence without stalling the render loop.
+// Capture( ) only starts an asynchronous glReadPixels( ) into the next pixel buffer object of a ring;
+// the frame read CAPTURE_RING_SIZE - 1 frames earlier is finished by then, so mapping it does not
+// wait for the GPU. Its pixels are copied out and handed to writer threads, which flip, compress
+// and write them with imagefile.h while the next frames are drawn.
+
+#include <stdio.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+#include "glew.h"
+#include <GL/gl.h>
+
+#define CAPTURE_RING_SIZE		3
+#define CAPTURE_MAX_QUEUED		16		// frames waiting for a writer before Capture( ) waits too
+
+class FrameCapture
+{
+  private:
+	// a frame on its way to a file:
+	struct Frame
+	{
+		std::vector<unsigned char>	Pixels;		// RGBA, bottom-up like glReadPixels( )
+		int		Width, Height;
+		int		Number;
+	};
+
+	// a pixel buffer object of the ring and the readback in it:
+	struct Slot
+	{
+		GLuint	Pbo;
+		GLsizei	Size;			// bytes allocated
+		GLsync	Fence;			// signalled when the readback is done, 0 when the slot is free
+		int		Width, Height;
+		int		Number;
+	};
+
+	Slot				Ring[CAPTURE_RING_SIZE];
+	int					NextSlot;
+	std::string			Prefix;
+	int					Format;			// IMAGE_PPM or IMAGE_PNG
+	int					NextNumber;
+	bool				Capturing;
+
+	std::vector<std::thread>	Writers;
+	std::mutex					Mutex;
+	std::condition_variable		WakeUp;			// signals the writers that a frame is queued or they should quit
+	std::condition_variable		Done;			// signals Capture( ) and Stop( ) that a writer took or wrote a frame
+	std::deque<Frame*>			Queue;
+	std::vector<Frame*>			FreeFrames;		// written frames, kept so their pixel memory is reused
+	int							Writing;		// frames the writers are busy with
+	int							NumWritten;
+	int							NumFailed;
+	int							NumWaits;		// times Capture( ) had to wait for the writers
+	bool						Quit;
+
+	void	Collect(Slot&);
+	void	WriterLoop();
+
+  public:
+		FrameCapture();
+		~FrameCapture();
+
+	void	Capture(int, int, int, int);
+	bool	IsCapturing() const;
+	void	PrintStats(FILE*);
+	void	Start(const char*, int, int = 0);
+	void	Stop();
+};
+
+#endif		// #ifndef FRAMECAPTURE_H
@@ -0,0 +1,133 @@
+#include "framepacer.h"
+
+// targetFps <= 0. means no limit, for vsync or benchmarking:
+FramePacer::FramePacer(float targetFps)
+{
+	Start = std::chrono::steady_clock::now();
+	NextFrame = 0.;
+	FrameStart = 0.;
+	LastFrameStart = -1.;
+	Animating = true;
+	Visible = true;
+	RedrawRequested = true;
+	NumSamples = 0;
+	NextSample = 0;
+	SetTargetFps(targetFps);
+}
+
+// moves the deadline on by one interval -- or starts over from now when the frame came more than an
+// interval late, so the frames after a stall or a pause do not rush to catch up:
+void
+FramePacer::BeginFrame()
+{
+	double now = GetSeconds();
+	if (now >= NextFrame + Interval) {
+		NextFrame = now + Interval;
+	}
+	else {
+		NextFrame = (now > NextFrame ? now : NextFrame) + Interval;
+	}
+
+	// the time between two frames only says something about the pacing while it animates:
+	LastFrameStart = (Animating && Visible && FrameStart > 0.) ? FrameStart : -1.;
+	FrameStart = now;
+	RedrawRequested = false;
+}
+
+void
+FramePacer::EndFrame()
+{
+	if (LastFrameStart < 0.) {
+		return;
+	}
+	FrameMs[NextSample] = (float)(1000. * (FrameStart - LastFrameStart));
+	WorkMs[NextSample] = (float)(1000. * (GetSeconds() - FrameStart));
+	NextSample = (NextSample + 1) % NUM_FRAME_SAMPLES;
+	if (NumSamples < NUM_FRAME_SAMPLES) {
+		NumSamples++;
+	}
+}
+
+double
+FramePacer::GetSeconds() const
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+}
+
+double
+FramePacer::GetSecondsToNextFrame() const
+{
+	double wait = NextFrame - GetSeconds();
+	return wait > 0. ? wait : 0.;
+}
+
+FrameStats
+FramePacer::GetStats() const
+{
+	FrameStats stats = { NumSamples, 0.f, 0.f, 0.f, 0.f, 0.f };
+	if (NumSamples == 0) {
+		return stats;
+	}
+
+	stats.MinMs = stats.MaxMs = FrameMs[0];
+	for (int i = 0; i < NumSamples; i++) {
+		stats.AverageMs += FrameMs[i];
+		stats.AverageWorkMs += WorkMs[i];
+		if (FrameMs[i] < stats.MinMs) {
+			stats.MinMs = FrameMs[i];
+		}
+		if (FrameMs[i] > stats.MaxMs) {
+			stats.MaxMs = FrameMs[i];
+		}
+	}
+	stats.AverageMs /= NumSamples;
+	stats.AverageWorkMs /= NumSamples;
+	if (stats.AverageMs > 0.f) {
+		stats.Fps = 1000.f / stats.AverageMs;
+	}
+	return stats;
+}
+
+float
+FramePacer::GetTargetFps() const
+{
+	return Interval > 0. ? (float)(1. / Interval) : 0.f;
+}
+
+bool
+FramePacer::IsAnimating() const
+{
+	return Animating;
+}
+
+// an input or a state change wants one more frame, even when nothing animates:
+void
+FramePacer::RequestRedraw()
+{
+	RedrawRequested = true;
+}
+
+void
+FramePacer::SetAnimating(bool animating)
+{
+	Animating = animating;
+}
+
+void
+FramePacer::SetTargetFps(float targetFps)
+{
+	Interval = targetFps > 0.f ? 1. / targetFps : 0.;
+}
+
+// a hidden or minimized window draws nothing until it shows again:
+void
+FramePacer::SetVisible(bool visible)
+{
+	Visible = visible;
+}
+
+bool
+FramePacer::WantsFrame() const
+{
+	return Visible && (Animating || RedrawRequested);
+}
@@ -0,0 +1,59 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+// Decides when the next frame is due, so the main loop can sleep in between instead of spinning.
+// A frame is wanted while something animates in a visible window, or once after an input or a
+// state change asked for one. Frames come at a target rate on absolute deadlines, so a late wake up
+// does not slow the average rate down; a target of 0 leaves the pacing to vsync.
+// It does not know about glut: the caller asks how long to wait and arms its own timer.
+
+#include <chrono>
+
+#define NUM_FRAME_SAMPLES	120
+
+// the timing of the last NUM_FRAME_SAMPLES frames:
+struct FrameStats
+{
+	int		NumFrames;
+	float	AverageMs;			// from the start of one frame to the start of the next
+	float	MinMs;
+	float	MaxMs;
+	float	AverageWorkMs;		// from the start to the end of a frame
+	float	Fps;
+};
+
+class FramePacer
+{
+  private:
+	std::chrono::steady_clock::time_point	Start;
+	double	Interval;			// seconds between frames, 0. means no limit
+	double	NextFrame;			// deadline of the next frame, in seconds since Start
+	double	FrameStart;			// start of the current frame
+	double	LastFrameStart;		// start of the frame before, < 0. when it does not count for the statistics
+	bool	Animating;
+	bool	Visible;
+	bool	RedrawRequested;
+
+	float	FrameMs[NUM_FRAME_SAMPLES];
+	float	WorkMs[NUM_FRAME_SAMPLES];
+	int		NumSamples;
+	int		NextSample;
+
+  public:
+		FramePacer(float = 60.f);
+
+	void		BeginFrame();
+	void		EndFrame();
+	double		GetSeconds() const;
+	double		GetSecondsToNextFrame() const;
+	FrameStats	GetStats() const;
+	float		GetTargetFps() const;
+	bool		IsAnimating() const;
+	void		RequestRedraw();
+	void		SetAnimating(bool);
+	void		SetTargetFps(float);
+	void		SetVisible(bool);
+	bool		WantsFrame() const;
+};
+
+#endif		// #ifndef FRAMEPACER_H
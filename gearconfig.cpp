@@ -0,0 +1,388 @@
+#include "gearconfig.h"
+#include "gearmesh.h"
+
+#include <ctype.h>
+#include <string.h>
+
+// the names of PlanetaryMembers in the config file:
+static const char* PlanetaryMemberNames[] = { "sun", "ring", "carrier" };
+
+// FNV-1a over the fields, one at a time so padding never gets in:
+static unsigned int
+HashBytes(unsigned int h, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		h ^= bytes[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+unsigned int
+GearParams::Hash() const
+{
+	unsigned int h = 2166136261u;
+	h = HashBytes(h, &NumTeeth, sizeof(NumTeeth));
+	h = HashBytes(h, &Radius, sizeof(Radius));
+	h = HashBytes(h, &TeethHeight, sizeof(TeethHeight));
+	h = HashBytes(h, &Thickness, sizeof(Thickness));
+	h = HashBytes(h, &Arms, sizeof(Arms));
+	h = HashBytes(h, &Internal, sizeof(Internal));
+	h = HashBytes(h, &ProfileOffset, sizeof(ProfileOffset));
+	h = HashBytes(h, &ToothShare, sizeof(ToothShare));
+	return h;
+}
+
+// Seen from the carrier, a planet meshes with the sun and the ring at once only every 2 pi / (SunTeeth + RingTeeth),
+// so planet k goes to the one of those directions nearest to k / NumPlanets of a turn:
+// when NumPlanets divides SunTeeth + RingTeeth they are evenly spaced.
+double
+PlanetarySet::GetPlanetDirection(int planet) const
+{
+	int steps = SunTeeth + GetRingTeeth();
+	return 2. * M_PI * floor((double)planet * steps / NumPlanets + 0.5) / steps;
+}
+
+int
+PlanetarySet::GetRingTeeth() const
+{
+	return SunTeeth + 2 * PlanetTeeth;
+}
+
+// the sun and the planets of a planetary set share their arms, the ring and the carrier have none:
+// false when the gear cannot change
+bool
+GearTrainConfig::ChangeArms(int gear, int delta)
+{
+	if (gear < 2) {
+		Arms[gear] += delta;
+		return true;
+	}
+	LinkedGear& link = MoreGears[gear - 2];
+	if (link.Set < 0) {
+		link.Arms += delta;
+		return true;
+	}
+	if (link.Link != GEAR_SUN && link.Link != GEAR_PLANET) {
+		return false;
+	}
+	Planetaries[link.Set].Arms += delta;
+	return true;
+}
+
+// the ring of a planetary set gets its teeth from the sun and the planets, the carrier has none:
+// false when the gear cannot change
+bool
+GearTrainConfig::ChangeTeeth(int gear, int delta)
+{
+	if (gear < 2) {
+		NumTeeth[gear] += delta;
+		return true;
+	}
+	LinkedGear& link = MoreGears[gear - 2];
+	if (link.Set < 0) {
+		link.NumTeeth += delta;
+		return true;
+	}
+	if (link.Link == GEAR_SUN)
+		Planetaries[link.Set].SunTeeth += delta;
+	else if (link.Link == GEAR_PLANET)
+		Planetaries[link.Set].PlanetTeeth += delta;
+	else
+		return false;
+	return true;
+}
+
+// gear 2 sits on the other side of the contact, one teeth height further out:
+float
+GearTrainConfig::GetCenterDistance() const
+{
+	return Radius1 + TeethHeight + GetGear(1).Radius;
+}
+
+GearParams
+GearTrainConfig::GetGear(int gear) const
+{
+	LinkedGear link = GetLink(gear);
+	GearParams params;
+	params.NumTeeth = link.NumTeeth;
+	params.Radius = Radius1 * link.NumTeeth / NumTeeth[0];
+	params.TeethHeight = TeethHeight;
+	params.Thickness = Thickness;
+	params.Arms = link.Arms;
+
+	// the base circle of a ring is the sun's + the planet's diameter, and its teeth reach in to the roots of the planets,
+	// one teeth height above it: the sun's radius + teeth height + the planet's diameter
+	params.Internal = link.Link == GEAR_RING;
+	params.ProfileOffset = params.Internal ? TeethHeight : 0.f;
+	params.ToothShare = (float)GetStandardShare(params.NumTeeth, params.Radius, params.TeethHeight, params.ProfileOffset);
+	return params;
+}
+
+// gears 1 and 2 as links too: gear 2 meshes with gear 1 straight along +x,
+// and the members of a planetary set take their teeth, arms, parent and offset from the set
+LinkedGear
+GearTrainConfig::GetLink(int gear) const
+{
+	if (gear >= 2) {
+		LinkedGear link = MoreGears[gear - 2];
+		if (link.Set >= 0) {
+			const PlanetarySet& set = Planetaries[link.Set];
+			link.Parent = set.Parent;
+			link.Placement = set.Offset;
+			link.NumTeeth = link.Link == GEAR_SUN ? set.SunTeeth : link.Link == GEAR_PLANET ? set.PlanetTeeth :
+				link.Link == GEAR_RING ? set.GetRingTeeth() : 0;
+			link.Arms = (link.Link == GEAR_SUN || link.Link == GEAR_PLANET) ? set.Arms : 0;
+		}
+		return link;
+	}
+	LinkedGear link;
+	link.Link = gear == 0 ? GEAR_DRIVER : GEAR_MESH;
+	link.Parent = gear == 0 ? -1 : 0;
+	link.NumTeeth = NumTeeth[gear];
+	link.Arms = Arms[gear];
+	link.Placement = 0.f;
+	link.Set = -1;
+	return link;
+}
+
+int
+GearTrainConfig::GetNumGears() const
+{
+	return 2 + (int)MoreGears.size();
+}
+
+// the same checks GearMeshBuilder does, before anything is built:
+bool
+GearTrainConfig::IsValid() const
+{
+	if (Radius1 <= 0. || TeethHeight <= 0. || Thickness <= 0. || Backlash < 0.) {
+		return false;
+	}
+	for (int gear = 0; gear < GetNumGears(); gear++) {
+		LinkedGear link = GetLink(gear);
+		if (link.Link == GEAR_CARRIER) {
+			continue;
+		}
+		if (link.NumTeeth < 3 || (link.Arms < 1 && link.Link != GEAR_RING)) {
+			return false;
+		}
+		if (gear >= 2) {
+			if (link.Parent < 0 || link.Parent >= gear) {
+				return false;
+			}
+			// a gear meshes with the outer teeth of a gear on a fixed axis, and nothing rides on a planet:
+			int parent = GetLink(link.Parent).Link;
+			if (parent == GEAR_PLANET || (link.Link == GEAR_MESH && parent != GEAR_DRIVER && parent != GEAR_MESH && parent != GEAR_SHAFT)) {
+				return false;
+			}
+		}
+		GearParams params = GetGear(gear);
+		if (MakeGearAngles(params.NumTeeth, params.Radius, params.TeethHeight, params.ToothShare, params.ProfileOffset).ThetaBig < 0.) {
+			return false;
+		}
+	}
+
+	// neighbouring planets must not touch, tip to tip:
+	for (size_t i = 0; i < Planetaries.size(); i++) {
+		const PlanetarySet& set = Planetaries[i];
+		if (set.Input == set.Fixed || set.NumPlanets < 1) {
+			return false;
+		}
+		GearParams sun = GetGear(set.FirstGear);
+		GearParams planet = GetGear(set.FirstGear + 3);
+		double orbit = sun.Radius + TeethHeight + planet.Radius;
+		for (int k = 0; k < set.NumPlanets && set.NumPlanets > 1; k++) {
+			double next = k + 1 < set.NumPlanets ? set.GetPlanetDirection(k + 1) : 2. * M_PI;
+			double between = next - set.GetPlanetDirection(k);
+			if (2. * orbit * sin(between / 2.) <= 2. * (planet.Radius + TeethHeight)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// reads "key = value" lines, '#' starts a comment:
+// the file has the whole train, the gears linked by an earlier file are gone
+bool
+GearTrainConfig::Load(const char* fileName)
+{
+	FILE* fp = fopen(fileName, "r");
+	if (fp == NULL) {
+		return false;
+	}
+	MoreGears.clear();
+	Planetaries.clear();
+
+	bool ok = true;
+	char line[256];
+	for (int lineNumber = 1; fgets(line, sizeof(line), fp) != NULL; lineNumber++) {
+		char* comment = strchr(line, '#');
+		if (comment != NULL) {
+			*comment = '\0';
+		}
+		char* p = line;
+		while (isspace((unsigned char)*p)) {
+			p++;
+		}
+		if (*p == '\0') {
+			continue;
+		}
+		if (!Set(p)) {
+			fprintf(stderr, "%s:%d: cannot use '%s'\n", fileName, lineNumber, p);
+			ok = false;
+		}
+	}
+	fclose(fp);
+	return ok;
+}
+
+void
+GearTrainConfig::Print(FILE* fp) const
+{
+	fprintf(fp, "teeth1 = %d\n", NumTeeth[0]);
+	fprintf(fp, "teeth2 = %d\n", NumTeeth[1]);
+	fprintf(fp, "arms1 = %d\n", Arms[0]);
+	fprintf(fp, "arms2 = %d\n", Arms[1]);
+	fprintf(fp, "radius1 = %g\n", Radius1);
+	fprintf(fp, "teeth_height = %g\n", TeethHeight);
+	fprintf(fp, "thickness = %g\n", Thickness);
+	fprintf(fp, "backlash = %g\n", Backlash);
+	for (size_t i = 0; i < MoreGears.size(); i++) {
+		const LinkedGear& link = MoreGears[i];
+		if (link.Set >= 0) {
+			// one line for all members of a planetary set, at its sun:
+			if (link.Link == GEAR_SUN) {
+				const PlanetarySet& set = Planetaries[link.Set];
+				fprintf(fp, "planetary = %d %s %s %d %d %d %d %g\n", set.Parent + 1, PlanetaryMemberNames[set.Input],
+					PlanetaryMemberNames[set.Fixed], set.SunTeeth, set.PlanetTeeth, set.NumPlanets, set.Arms, set.Offset);
+			}
+			continue;
+		}
+		fprintf(fp, "gear = %s %d %d %d %g\n", link.Link == GEAR_SHAFT ? "shaft" : "mesh",
+			link.Parent + 1, link.NumTeeth, link.Arms, link.Placement);
+	}
+}
+
+bool
+GearTrainConfig::Save(const char* fileName) const
+{
+	FILE* fp = fopen(fileName, "w");
+	if (fp == NULL) {
+		return false;
+	}
+	fprintf(fp, "# Gear transmission parameters, gear 2 keeps the module of gear 1\n");
+	Print(fp);
+	fclose(fp);
+	return true;
+}
+
+// one "key = value" (or "key=value") assignment:
+bool
+GearTrainConfig::Set(const char* assignment)
+{
+	char key[64];
+	const char* equals = strchr(assignment, '=');
+	if (equals == NULL || equals - assignment >= (int)sizeof(key)) {
+		return false;
+	}
+
+	int length = (int)(equals - assignment);
+	while (length > 0 && isspace((unsigned char)assignment[length - 1])) {
+		length--;
+	}
+	memcpy(key, assignment, length);
+	key[length] = '\0';
+	return Set(key, equals + 1);
+}
+
+// "gear" adds a gear to the train, "planetary" a planetary set, the other keys take a number:
+bool
+GearTrainConfig::Set(const char* key, const char* value)
+{
+	if (strcmp(key, "gear") == 0) {
+		char link[16];
+		LinkedGear gear;
+		char rest;
+		if (sscanf(value, " %15s %d %d %d %f %c", link, &gear.Parent, &gear.NumTeeth, &gear.Arms, &gear.Placement, &rest) != 5) {
+			return false;
+		}
+		if (strcmp(link, "mesh") == 0)
+			gear.Link = GEAR_MESH;
+		else if (strcmp(link, "shaft") == 0)
+			gear.Link = GEAR_SHAFT;
+		else
+			return false;
+		gear.Parent--;		// the file counts the gears from 1, like the keys
+		gear.Set = -1;
+		MoreGears.push_back(gear);
+		return true;
+	}
+
+	// the set takes the next gear numbers: the sun, the ring, the carrier, then the planets
+	if (strcmp(key, "planetary") == 0) {
+		char input[16], fixed[16];
+		PlanetarySet set;
+		char rest;
+		if (sscanf(value, " %d %15s %15s %d %d %d %d %f %c", &set.Parent, input, fixed, &set.SunTeeth, &set.PlanetTeeth,
+			&set.NumPlanets, &set.Arms, &set.Offset, &rest) != 8 || set.NumPlanets < 1) {
+			return false;
+		}
+		set.Input = set.Fixed = -1;
+		for (int m = PLANETARY_SUN; m <= PLANETARY_CARRIER; m++) {
+			if (strcmp(input, PlanetaryMemberNames[m]) == 0)
+				set.Input = m;
+			if (strcmp(fixed, PlanetaryMemberNames[m]) == 0)
+				set.Fixed = m;
+		}
+		if (set.Input < 0 || set.Fixed < 0) {
+			return false;
+		}
+		set.Parent--;
+		set.FirstGear = GetNumGears();
+
+		const int memberLinks[3] = { GEAR_SUN, GEAR_RING, GEAR_CARRIER };
+		for (int i = 0; i < 3 + set.NumPlanets; i++) {
+			LinkedGear member;
+			member.Link = i < 3 ? memberLinks[i] : GEAR_PLANET;
+			member.Parent = set.Parent;
+			member.NumTeeth = member.Arms = 0;
+			member.Placement = 0.f;
+			member.Set = (int)Planetaries.size();
+			MoreGears.push_back(member);
+		}
+		Planetaries.push_back(set);
+		return true;
+	}
+
+	char* end;
+	double number = strtod(value, &end);
+	while (isspace((unsigned char)*end)) {
+		end++;
+	}
+	if (end == value || *end != '\0') {
+		return false;
+	}
+
+	if (strcmp(key, "teeth1") == 0)
+		NumTeeth[0] = (int)number;
+	else if (strcmp(key, "teeth2") == 0)
+		NumTeeth[1] = (int)number;
+	else if (strcmp(key, "arms1") == 0)
+		Arms[0] = (int)number;
+	else if (strcmp(key, "arms2") == 0)
+		Arms[1] = (int)number;
+	else if (strcmp(key, "radius1") == 0)
+		Radius1 = (float)number;
+	else if (strcmp(key, "teeth_height") == 0)
+		TeethHeight = (float)number;
+	else if (strcmp(key, "thickness") == 0)
+		Thickness = (float)number;
+	else if (strcmp(key, "backlash") == 0)
+		Backlash = (float)number;
+	else
+		return false;
+	return true;
+}
@@ -0,0 +1,109 @@
+#ifndef GEARCONFIG_H
+#define GEARCONFIG_H
+
+// Runtime parameters of the transmission.
+// They come from the compiled-in defaults, a config file of "key = value" lines and
+// "--set key=value" on the command line, and can be changed while the program runs.
+// Each gear gets a hash of everything its mesh depends on, so only gears whose hash changed
+// have to be generated again.
+// Gears 1 and 2 are the original transmission, "gear = ..." lines hang any number of further gears on them,
+// and "planetary = ..." lines whole planetary sets.
+
+#include <stdio.h>
+#include <vector>
+
+// everything the mesh of one gear depends on:
+struct GearParams
+{
+	int		NumTeeth;
+	float	Radius;
+	float	TeethHeight;
+	float	Thickness;
+	int		Arms;
+	bool	Internal;		// an internal ring gear, Radius is its base circle like everyone's
+	float	ProfileOffset;	// a ring's teeth start this far above its base circle, GearTrain fits it to the planets
+	float	ToothShare;		// the standard one of GetStandardShare( ), GearTrain fits a meshing gear to its parent
+
+	unsigned int	Hash() const;
+};
+
+// how a gear of a train is held:
+enum GearLinks
+{
+	GEAR_DRIVER,		// turned by the motor, gear 1
+	GEAR_MESH,			// meshes with its parent gear, on a shaft of its own
+	GEAR_SHAFT,			// on the shaft of its parent gear and turning with it, a compound gear
+	GEAR_SUN,			// the members of a planetary set, one after the other in this order
+	GEAR_RING,			// the internal gear around the planets
+	GEAR_CARRIER,		// the arm the planets turn on, with no teeth of its own and not drawn
+	GEAR_PLANET
+};
+
+// the members of a planetary set that can be driven or held:
+enum PlanetaryMembers
+{
+	PLANETARY_SUN,
+	PLANETARY_RING,
+	PLANETARY_CARRIER
+};
+
+// "planetary = PARENT INPUT FIXED SUN_TEETH PLANET_TEETH PLANETS ARMS OFFSET", INPUT and FIXED being
+// sun, ring or carrier: the sun, the ring and the carrier share one axis, the input member sits on the shaft
+// of gear PARENT, OFFSET along it, and turns with it, the fixed member stands still and the third one follows.
+// The ring has SUN_TEETH + 2 PLANET_TEETH teeth, so the planets fit between it and the sun.
+// The planets are spaced as evenly as the teeth allow.
+struct PlanetarySet
+{
+	int		Parent;			// index of an earlier gear, 0 is gear 1
+	int		Input;			// PLANETARY_SUN, PLANETARY_RING or PLANETARY_CARRIER
+	int		Fixed;
+	int		SunTeeth;
+	int		PlanetTeeth;
+	int		NumPlanets;
+	int		Arms;			// of the sun and the planets
+	float	Offset;			// along the parent's shaft
+	int		FirstGear;		// index of the sun, the ring, the carrier and the planets come after it
+
+	double	GetPlanetDirection(int) const;
+	int		GetRingTeeth() const;
+};
+
+// a gear after the first two, "gear = mesh|shaft PARENT TEETH ARMS PLACEMENT", or a member of a planetary set:
+struct LinkedGear
+{
+	int		Link;			// GEAR_MESH or GEAR_SHAFT, or GEAR_SUN ... GEAR_PLANET
+	int		Parent;			// index of an earlier gear, 0 is gear 1
+	int		NumTeeth;
+	int		Arms;
+	float	Placement;		// GEAR_MESH: direction from the parent's center in degrees, GEAR_SHAFT: offset along the shaft
+	int		Set;			// index into Planetaries of a planetary member, -1 for the others
+};
+
+// the two meshing gears -- gear 2 keeps the module of gear 1, so its radius follows from the teeth --
+// and the gears linked to them, which keep it too:
+struct GearTrainConfig
+{
+	int		NumTeeth[2];
+	int		Arms[2];
+	float	Radius1;
+	float	TeethHeight;
+	float	Thickness;
+	float	Backlash;		// of every meshing pair, along the line of action
+	std::vector<LinkedGear>	MoreGears;		// gears 3, 4, ...
+	std::vector<PlanetarySet>	Planetaries;	// the sets whose members are in MoreGears
+
+	bool		ChangeArms(int, int);
+	bool		ChangeTeeth(int, int);
+	float		GetCenterDistance() const;
+	GearParams	GetGear(int) const;
+	LinkedGear	GetLink(int) const;
+	int			GetNumGears() const;
+	bool		IsValid() const;
+	bool		Load(const char*);
+	void		Print(FILE*) const;
+	bool		Save(const char*) const;
+	bool		Set(const char*);
+	bool		Set(const char*, const char*);
+};
+
+#endif		// #ifndef GEARCONFIG_H
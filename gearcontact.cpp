@@ -0,0 +1,289 @@
+#include "gearcontact.h"
+#include "gearmesh.h"
+
+#include <chrono>
+
+// floor( ) that compiles to a conversion and a compare, so the loops around it stay vectorized:
+static inline float
+FloorOf(float v)
+{
+	float f = (float)(int)v;
+	return f > v ? f - 1.f : f;
+}
+
+GearContacts::GearContacts()
+{
+	Speed = 0.;
+	TotalContacts = 0;
+	MaxSlidingSpeed = 0.f;
+}
+
+// one pair, frame being the ratio of the carrier the pair is seen from, 0 for gears on fixed axes:
+void
+GearContacts::AddPair(const GearTrain& train, int driver, int driven, double frame)
+{
+	const GearParams& p1 = train.GetParams(driver);
+	const GearParams& p2 = train.GetParams(driven);
+	double w1 = train.GetRatio(driver) - frame;
+	double thickness = GetBaseThickness(p1.NumTeeth, p1.Radius, p1.TeethHeight, p1.ToothShare, p1.ProfileOffset);
+	bool internal = p1.Internal || p2.Internal;
+
+	// the profiles cross the line between R t0 and R t1 from their base circles, the driven one's on the far side
+	// of T2 for a ring and a planet:
+	double driverStart = p1.Radius * InvoluteParameter(p1.Radius, p1.Radius + p1.ProfileOffset);
+	double driverReach = p1.Radius * InvoluteParameter(p1.Radius, p1.Radius + p1.ProfileOffset + p1.TeethHeight);
+	double drivenStart = p2.Radius * InvoluteParameter(p2.Radius, p2.Radius + p2.ProfileOffset);
+	double drivenReach = p2.Radius * InvoluteParameter(p2.Radius, p2.Radius + p2.ProfileOffset + p2.TeethHeight);
+
+	// A ring's flanks are those of its spaces, and the driving one, in front of its tooth, crosses the line the other way:
+	// from T1 its involute goes back against the turn, and the contacts come in towards T1.
+	// So a ring that drives is on the other side of its line, as if it turned the other way.
+	double side = (w1 < 0. ? -1. : 1.) * (p1.Internal ? -1. : 1.);
+
+	Drivers.push_back(driver);
+	Drivens.push_back(driven);
+	BaseRadii.push_back(p1.Radius);
+	RadiusSums.push_back(internal ? fabsf(p1.Radius - p2.Radius) : p1.Radius + p2.Radius);
+	Facings.push_back(p2.Internal ? -1.f : 1.f);
+	DriverStarts.push_back((float)driverStart);
+	DriverReaches.push_back((float)driverReach);
+	DrivenNears.push_back((float)(internal ? drivenStart : -drivenReach));
+	DrivenFars.push_back((float)(internal ? drivenReach : -drivenStart));
+	BasePitches.push_back(2.f * (float)M_PI * p1.Radius / p1.NumTeeth);
+	FlankAngles.push_back((float)(M_PI / p1.NumTeeth + side * thickness / 2.));
+	Sides.push_back((float)side);
+	DriverRates.push_back((float)w1);
+	DrivenRates.push_back((float)(train.GetRatio(driven) - frame));
+}
+
+// The meshing pairs of the train: every meshing gear with its parent, and every planet with the sun or the ring
+// that drives it and with the other one, which it drives.
+// On a side the teeth only touch when the backlash is taken up, and GearTrain turns every driven gear back
+// against the way it goes, so its driving flanks do.
+void
+GearContacts::Build(const GearTrain& train)
+{
+	Drivers.clear();
+	Drivens.clear();
+	BaseRadii.clear();
+	RadiusSums.clear();
+	Facings.clear();
+	DriverStarts.clear();
+	DriverReaches.clear();
+	DrivenNears.clear();
+	DrivenFars.clear();
+	BasePitches.clear();
+	FlankAngles.clear();
+	Sides.clear();
+	DriverRates.clear();
+	DrivenRates.clear();
+
+	int sun = -1;
+	for (int gear = 0; gear < train.GetNumGears(); gear++) {
+		const LinkedGear& link = train.GetLink(gear);
+		if (link.Link == GEAR_SUN) {
+			sun = gear;
+		}
+		if (link.Link == GEAR_MESH) {
+			AddPair(train, link.Parent, gear, 0.);
+		}
+		else if (link.Link == GEAR_PLANET) {
+			// the planets follow the carrier of their set, two after the sun, the ring is the one after the sun:
+			double frame = train.GetRatio(sun + 2);
+			int driver = train.GetDriver(gear);
+			AddPair(train, driver, gear, frame);
+			AddPair(train, gear, driver == sun ? sun + 1 : sun, frame);
+		}
+	}
+
+	int numPairs = (int)Drivers.size();
+	CenterX.resize(numPairs);
+	CenterY.resize(numPairs);
+	CenterZ.resize(numPairs);
+	DirectionX.resize(numPairs);
+	DirectionY.resize(numPairs);
+	Distances.resize(numPairs);
+	Phases.resize(numPairs);
+	Lengths.assign(numPairs, 0.f);
+	ActionStarts.assign(numPairs, 0.f);
+	ActionEnds.assign(numPairs, 0.f);
+	FirstContacts.assign(numPairs, 0.f);
+	NumContacts.assign(numPairs, 0);
+	Starts.resize(numPairs);
+	Ways.resize(numPairs);
+	Points.clear();
+	Lines.clear();
+	TotalContacts = 0;
+	MaxSlidingSpeed = 0.f;
+}
+
+const std::vector<Vec3>&
+GearContacts::GetLines() const
+{
+	return Lines;
+}
+
+float
+GearContacts::GetMaxSlidingSpeed() const
+{
+	return MaxSlidingSpeed;
+}
+
+int
+GearContacts::GetNumContacts(int pair) const
+{
+	return NumContacts[pair];
+}
+
+int
+GearContacts::GetNumPairs() const
+{
+	return (int)Drivers.size();
+}
+
+const std::vector<Vec3>&
+GearContacts::GetPoints() const
+{
+	return Points;
+}
+
+// units per second, contact 0 being the one nearest T1:
+float
+GearContacts::GetSlidingSpeed(int pair, int contact) const
+{
+	float s = FirstContacts[pair] + contact * BasePitches[pair];
+	return (float)Speed * ((DriverRates[pair] - DrivenRates[pair]) * s + DrivenRates[pair] * Lengths[pair]);
+}
+
+int
+GearContacts::GetTotalContacts() const
+{
+	return TotalContacts;
+}
+
+// finds the contacts for the angles and centers of the train's last Update( ),
+// speed being how fast gear 1 turns, in radians per second:
+void
+GearContacts::Update(const GearTrain& train, double speed)
+{
+	Speed = speed;
+	int numPairs = (int)Drivers.size();
+
+	// the gathers and the two angles that need the math library: where the pair faces, and its pressure angle
+	for (int i = 0; i < numPairs; i++) {
+		const Vec3& c1 = train.GetCenter(Drivers[i]);
+		const Vec3& c2 = train.GetCenter(Drivens[i]);
+		float dx = c2.x - c1.x;
+		float dy = c2.y - c1.y;
+		float distance = sqrtf(dx * dx + dy * dy);
+		CenterX[i] = c1.x;
+		CenterY[i] = c1.y;
+		CenterZ[i] = c1.z;
+		DirectionX[i] = dx / distance;
+		DirectionY[i] = dy / distance;
+		Distances[i] = distance;
+		float alpha = acosf(RadiusSums[i] / distance);
+		Phases[i] = train.GetAngle(Drivers[i]) + FlankAngles[i] - atan2f(Facings[i] * dy, Facings[i] * dx) + Sides[i] * alpha;
+	}
+
+	// the line of action, and the first driving flank on it at or after where the teeth come in:
+	for (int i = 0; i < numPairs; i++) {
+		float cosAlpha = RadiusSums[i] / Distances[i];
+		float sinAlpha = sqrtf(1.f - cosAlpha * cosAlpha);
+		float length = Facings[i] * Distances[i] * sinAlpha;
+		float start = length + DrivenNears[i];
+		start = start > DriverStarts[i] ? start : DriverStarts[i];
+		float end = length + DrivenFars[i];
+		end = end < DriverReaches[i] ? end : DriverReaches[i];
+		float pitch = BasePitches[i];
+		float s = Sides[i] * BaseRadii[i] * Phases[i];
+		float first = s - pitch * FloorOf((s - start) / pitch);
+		float count = FloorOf((end - first) / pitch) + 1.f;
+		count = count < 0.f ? 0.f : count;
+		count = count > GEAR_CONTACT_MAX ? (float)GEAR_CONTACT_MAX : count;
+		Lengths[i] = length;
+		ActionStarts[i] = start;
+		ActionEnds[i] = end;
+		FirstContacts[i] = first;
+		NumContacts[i] = (int)count;
+
+		// T1 is the direction to the driven gear, or away from a driven ring, turned back by the pressure angle,
+		// and the line goes on square to it:
+		float rx = Facings[i] * (DirectionX[i] * cosAlpha + Sides[i] * DirectionY[i] * sinAlpha);
+		float ry = Facings[i] * (DirectionY[i] * cosAlpha - Sides[i] * DirectionX[i] * sinAlpha);
+		Starts[i] = Vec3(CenterX[i] + BaseRadii[i] * rx, CenterY[i] + BaseRadii[i] * ry, CenterZ[i]);
+		Ways[i] = Vec3(-Sides[i] * ry, Sides[i] * rx, 0.f);
+	}
+
+	Points.clear();
+	Lines.resize(2 * numPairs);
+	TotalContacts = 0;
+	MaxSlidingSpeed = 0.f;
+	for (int i = 0; i < numPairs; i++) {
+		Lines[2 * i] = Starts[i] + Ways[i] * ActionStarts[i];
+		Lines[2 * i + 1] = Starts[i] + Ways[i] * ActionEnds[i];
+		for (int k = 0; k < NumContacts[i]; k++) {
+			Points.push_back(Starts[i] + Ways[i] * (FirstContacts[i] + k * BasePitches[i]));
+			float sliding = fabsf(GetSlidingSpeed(i, k));
+			if (sliding > MaxSlidingSpeed) {
+				MaxSlidingSpeed = sliding;
+			}
+		}
+		TotalContacts += NumContacts[i];
+	}
+}
+
+
+// The contacts of a long train without a window: a chain of meshing gears and a few planetary sets,
+// turned through a couple of thousand frames.
+void
+BenchmarkGearContacts()
+{
+	const int CHAIN = 400;
+	const int PLANETARIES = 8;
+	const int FRAMES = 2000;
+
+	GearTrainConfig config = {};
+	config.Set("teeth1 = 23");
+	config.Set("teeth2 = 47");
+	config.Set("arms1 = 3");
+	config.Set("arms2 = 5");
+	config.Set("radius1 = 10");
+	config.Set("teeth_height = 2");
+	config.Set("thickness = 2");
+	char line[128];
+	for (int gear = 3; gear <= CHAIN; gear++) {
+		snprintf(line, sizeof(line), "gear = mesh %d %d 3 %d", gear - 1, gear % 2 == 0 ? 17 : 29, (gear * 37) % 360);
+		config.Set(line);
+	}
+	for (int set = 0; set < PLANETARIES; set++) {
+		snprintf(line, sizeof(line), "planetary = %d sun ring 20 10 6 3 %d", 1 + set, 3 * (set + 1));
+		config.Set(line);
+	}
+
+	GearTrain train;
+	GearContacts contacts;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	train.Build(config, Vec3(0.f, 0.f, 0.f));
+	contacts.Build(train);
+	std::chrono::duration<double, std::milli> buildMs = std::chrono::steady_clock::now() - start;
+
+	double trainMs = 0., contactMs = 0.;
+	long long totalContacts = 0;
+	for (int frame = 0; frame < FRAMES; frame++) {
+		double angle = 0.01 * frame;
+		start = std::chrono::steady_clock::now();
+		train.Update(angle);
+		std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+		contacts.Update(train, 1.);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		trainMs += std::chrono::duration<double, std::milli>(middle - start).count();
+		contactMs += std::chrono::duration<double, std::milli>(end - middle).count();
+		totalContacts += contacts.GetTotalContacts();
+	}
+
+	fprintf(stderr, "%d gears, %d meshing pairs, built in %.3f ms\n", train.GetNumGears(), contacts.GetNumPairs(), buildMs.count());
+	fprintf(stderr, "per frame: train %.4f ms, contacts %.4f ms (%.1f ns per pair), %.2f teeth touching per pair\n",
+		trainMs / FRAMES, contactMs / FRAMES, 1.e6 * contactMs / FRAMES / contacts.GetNumPairs(),
+		(double)totalContacts / FRAMES / contacts.GetNumPairs());
+}
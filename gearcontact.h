@@ -0,0 +1,88 @@
+#ifndef GEARCONTACT_H
+#define GEARCONTACT_H
+
+// Where the teeth of the meshing pairs of a GearTrain touch, frame by frame.
+// Two involute gears touch on their line of action, the line tangent to both base circles, which runs from T1
+// on the driver's base circle to T2 on the driven gear's and is L = C sin(alpha) long, cos(alpha) = (R1 + R2) / C.
+// The involute that starts on the base circle at angle b crosses it R1 (b - tau) from T1, tau being the angle
+// of T1, so the driving flanks cross it one base pitch 2 pi R1 / N1 apart, and those between the two tip
+// circles touch. A ring and a planet touch on the line tangent to both base circles on the same side,
+// cos(alpha) = (Rr - Rp) / C, beyond the planet's T: T2 is L behind T1 when the planet drives, and the teeth
+// touch where both profiles cross the line, the ring's from above its base circle.
+// Seen from the carrier the planets are gears on fixed axes, and the sliding speed there,
+// the difference of the two surface speeds across the line, is
+//	(w1 - w2) s + w2 D
+// at s from T1, T2 being D from T1 along the line: zero at the pitch point, and fastest where the teeth
+// come in and out.
+// Build( ) collects the pairs once per train: every meshing gear with its parent, and every planet with its sun and its ring.
+// Update( ) works through structure of arrays in loops without branches, which the compiler can vectorize,
+// and leaves the contact points and the lines of action in flat arrays the renderer streams as they are.
+
+#include <stdio.h>
+#include <vector>
+
+#include "geartrain.h"
+
+// teeth of one pair that can touch at once, a contact ratio over 4 is not a gear worth drawing:
+#define GEAR_CONTACT_MAX	4
+
+class GearContacts
+{
+  private:
+	// the pairs, from Build( ):
+	std::vector<int>	Drivers;
+	std::vector<int>	Drivens;
+	std::vector<float>	BaseRadii;		// of the driver
+	std::vector<float>	RadiusSums;		// C cos(alpha): R1 + R2, Rr - Rp for a ring and a planet
+	std::vector<float>	Facings;		// -1 when a planet drives its ring: T1 is on its side, away from the ring's center
+	std::vector<float>	DriverStarts;	// from T1 to where the driver's profile starts along the line, R1 t0
+	std::vector<float>	DriverReaches;	// from T1 to the driver's tip circle along the line, R1 t1
+	std::vector<float>	DrivenNears;	// where the driven gear's profile crosses the line, from T2
+	std::vector<float>	DrivenFars;
+	std::vector<float>	BasePitches;
+	std::vector<float>	FlankAngles;	// where a driving flank starts on the base circle, from the driver's angle
+	std::vector<float>	Sides;			// 1 when the driver turns counterclockwise seen from the carrier, -1 if not, the other way for a ring
+	std::vector<float>	DriverRates;	// w1 and w2 seen from the carrier, per radian of gear 1
+	std::vector<float>	DrivenRates;
+
+	// from Update( ), per pair:
+	std::vector<float>	CenterX;		// of the driver
+	std::vector<float>	CenterY;
+	std::vector<float>	CenterZ;
+	std::vector<float>	DirectionX;		// unit vector to the driven gear
+	std::vector<float>	DirectionY;
+	std::vector<float>	Distances;
+	std::vector<float>	Phases;			// driver angle + flank angle - angle of the direction
+	std::vector<float>	Lengths;		// from T1 to T2 along the line, D, negative when a planet drives its ring
+	std::vector<float>	ActionStarts;	// where the teeth touch, from T1
+	std::vector<float>	ActionEnds;
+	std::vector<float>	FirstContacts;
+	std::vector<int>	NumContacts;
+	std::vector<Vec3>	Starts;			// T1
+	std::vector<Vec3>	Ways;			// unit vector along the line, from T1 to where the teeth touch
+
+	double				Speed;			// radians per second of gear 1
+	std::vector<Vec3>	Points;			// the contact points of all pairs, one after the other
+	std::vector<Vec3>	Lines;			// two ends per pair, where its teeth touch
+	int					TotalContacts;
+	float				MaxSlidingSpeed;
+
+	void				AddPair(const GearTrain&, int, int, double);
+
+  public:
+		GearContacts();
+
+	void			Build(const GearTrain&);
+	const std::vector<Vec3>&	GetLines() const;
+	float			GetMaxSlidingSpeed() const;
+	int				GetNumContacts(int) const;
+	int				GetNumPairs() const;
+	const std::vector<Vec3>&	GetPoints() const;
+	float			GetSlidingSpeed(int, int) const;
+	int				GetTotalContacts() const;
+	void			Update(const GearTrain&, double);
+};
+
+void	BenchmarkGearContacts();
+
+#endif		// #ifndef GEARCONTACT_H
@@ -0,0 +1,923 @@
+#include "gearmesh.h"
+
+#include <chrono>
+
+void
+GearMesh::Clear()
+{
+	Vertices.clear();
+	Indices.clear();
+}
+
+int
+GearMesh::NumVertices() const
+{
+	return (int)Vertices.size();
+}
+
+int
+GearMesh::NumIndices() const
+{
+	return (int)Indices.size();
+}
+
+// counts the non-degenerate triangles of all strips:
+int
+GearMesh::NumTriangles() const
+{
+	int count = 0;
+	int inStrip = 0;
+	for (size_t i = 0; i < Indices.size(); i++) {
+		if (Indices[i] == GEAR_MESH_RESTART) {
+			inStrip = 0;
+			continue;
+		}
+		inStrip++;
+		if (inStrip >= 3) {
+			unsigned int a = Indices[i - 2], b = Indices[i - 1], c = Indices[i];
+			if (a != b && b != c && a != c) {
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
+void
+GearMesh::PrintStats(const char* name) const
+{
+	fprintf(stderr, "%s mesh: %d vertices, %d triangles, %d indices, %.1f KB\n",
+		name, NumVertices(), NumTriangles(), NumIndices(), SizeInBytes() / 1024.);
+}
+
+size_t
+GearMesh::SizeInBytes() const
+{
+	return Vertices.size() * sizeof(point) + Indices.size() * sizeof(unsigned int);
+}
+
+
+GearMeshBuilder::GearMeshBuilder(int gNumTeeth, float gRadius, float gTeethHeight, float gThickness, int gArms, int gPolygons)
+{
+	Init(gNumTeeth, gRadius, gTeethHeight, gThickness, gArms,
+		MakeGearAngles(gNumTeeth, gRadius, gTeethHeight, GetStandardShare(gNumTeeth, gRadius, gTeethHeight)));
+	Tess = MakeUniformTessellation(gPolygons);
+}
+
+// everything but the tessellation, which each constructor sets its own way:
+void
+GearMeshBuilder::Init(int gNumTeeth, float gRadius, float gTeethHeight, float gThickness, int gArms, const GearAngles& angles)
+{
+	NumTeeth = gNumTeeth;
+	Radius = gRadius;
+	TeethHeight = gTeethHeight;
+	Thickness = gThickness;
+	Arms = gArms;
+	Internal = false;
+	ProfileOffset = 0.f;
+	Tess = MakeUniformTessellation(1);
+	FixedProfiles = false;
+	SetOutput(NULL, NULL, 0);
+	LoadIdentity();
+
+	InvoluteStart = angles.InvoluteStart;
+	InvoluteAlpha = angles.InvoluteAlpha;
+	ContactAlpha = angles.ContactAlpha;
+	ThetaBig = angles.ThetaBig;
+	ThetaSmall = angles.ThetaSmall;
+}
+
+float
+GearMeshBuilder::GetContactAlpha() const
+{
+	return ContactAlpha;
+}
+
+int
+GearMeshBuilder::GetNumTeeth() const
+{
+	return NumTeeth;
+}
+
+float
+GearMeshBuilder::GetThetaBig() const
+{
+	return ThetaBig;
+}
+
+float
+GearMeshBuilder::GetThetaSmall() const
+{
+	return ThetaSmall;
+}
+
+GearTessellation
+GearMeshBuilder::GetTessellation() const
+{
+	return Tess;
+}
+
+// angle between two neighbouring teeth:
+float
+GearMeshBuilder::GetToothAngle() const
+{
+	return 2 * M_PI / NumTeeth;
+}
+
+bool
+GearMeshBuilder::IsInternal() const
+{
+	return Internal;
+}
+
+// the involutes of two neighbouring teeth must not overlap:
+bool
+GearMeshBuilder::IsValid() const
+{
+	return 2 * ContactAlpha <= 2 * M_PI / NumTeeth;
+}
+
+
+// GEAR_POLYGONS style: the same number of segments everywhere, whole degree hob steps
+GearTessellation
+MakeUniformTessellation(int polygons)
+{
+	GearTessellation t;
+	t.Involute = t.Tip = t.Root = t.Arm = t.Depth = t.Rim = polygons;
+	t.Hob = HOB_STEPS;
+	return t;
+}
+
+// Tessellation for a maximum chord error, in the units of the gear.
+// The profiles of a tooth take MakeProfileSegments( ), the compile time profiles of a GearGeometry<> were made with it too.
+// The arcs of a ring's teeth are ProfileOffset further out, which only makes its involute a little finer than it needs.
+GearTessellation
+GearMeshBuilder::MakeTessellation(float maxError) const
+{
+	GearTessellation t;
+	GearProfileSegments segments = MakeProfileSegments(Radius + ProfileOffset, TeethHeight, InvoluteAlpha, ContactAlpha,
+		ThetaBig, ThetaSmall, maxError);
+	t.Involute = segments.Involute;
+	t.Tip = segments.Tip;
+	t.Root = segments.Root;
+	t.Hob = ArcSegments(0.2 * Radius, 2 * M_PI, maxError);
+	if (t.Hob > HOB_STEPS) {
+		t.Hob = HOB_STEPS;
+	}
+
+	// the arm ends follow the hob and the inner radius of the rim
+	int armHob = ArcSegments(0.2 * Radius, 2 * asin(0.05 / 0.2), maxError);
+	int armRim = ArcSegments(0.8 * Radius, 2 * asin(0.05 / 0.8), maxError);
+	t.Arm = armHob > armRim ? armHob : armRim;
+
+	// straight edges get about the length of the involute segments at the tip
+	float edge = Radius * InvoluteAlpha * InvoluteAlpha / t.Involute;
+	t.Depth = ClampSegments(Thickness / edge);
+	t.Rim = ClampSegments(0.2 * Radius / edge);
+	return t;
+}
+
+// An internal ring gear has the same profile, with the metal on the other side of it:
+// its teeth are the spaces between the teeth of an external gear. Radius stays its base circle, the teeth
+// point in from Radius + profileOffset + TeethHeight to Radius + profileOffset, and the rim goes out from there
+// (see FitRingMesh( )). The profile normals point the other way, so the fixed profiles of a GearGeometry<> do not fit.
+// The tooth share stays as it was.
+void
+GearMeshBuilder::SetInternal(bool internal, float profileOffset)
+{
+	if (internal) {
+		FixedLods.clear();
+		FixedProfiles = false;
+	}
+	Internal = internal;
+	ProfileOffset = internal ? profileOffset : 0.f;
+	GearAngles angles = MakeGearAngles(NumTeeth, Radius, TeethHeight, ThetaBig / (ThetaBig + ThetaSmall), ProfileOffset);
+	InvoluteStart = angles.InvoluteStart;
+	InvoluteAlpha = angles.InvoluteAlpha;
+	ContactAlpha = angles.ContactAlpha;
+	ThetaBig = angles.ThetaBig;
+	ThetaSmall = angles.ThetaSmall;
+}
+
+// a tessellation from MakeTessellation( ) picks the compile time profiles of its LOD, if there are any:
+void
+GearMeshBuilder::SetTessellation(const GearTessellation& t)
+{
+	FixedProfiles = false;
+	for (size_t lod = 0; lod < FixedLods.size() && !FixedProfiles; lod++) {
+		const GearFixedProfiles& fixed = FixedLods[lod];
+		if (fixed.Segments.Involute == t.Involute && fixed.Segments.Tip == t.Tip && fixed.Segments.Root == t.Root) {
+			ContactPoints.assign(fixed.Contact, fixed.Contact + t.Involute + 1);
+			SmallCirclePoints.assign(fixed.SmallCircle, fixed.SmallCircle + t.Root + 1);
+			BigCirclePoints.assign(fixed.BigCircle, fixed.BigCircle + t.Tip + 1);
+			FixedProfiles = true;
+		}
+	}
+	Tess = t;
+}
+
+// a tooth share from GetStandardShare( ) or FitGearMesh( ), the constructor takes the standard one:
+void
+GearMeshBuilder::SetToothShare(float toothShare)
+{
+	GearAngles angles = MakeGearAngles(NumTeeth, Radius, TeethHeight, toothShare, ProfileOffset);
+	if ((float)angles.ThetaBig != ThetaBig) {
+		FixedLods.clear();
+		FixedProfiles = false;
+	}
+	ThetaBig = angles.ThetaBig;
+	ThetaSmall = angles.ThetaSmall;
+}
+
+
+// the transform functions mirror glLoadIdentity( ) / glRotatef( ), so the geometry below
+// can be written exactly as it was written against the OpenGL matrix stack:
+void
+GearMeshBuilder::LoadIdentity()
+{
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) {
+			Transform[i][j] = (i == j) ? 1.f : 0.f;
+		}
+	}
+}
+
+// same as glRotatef(180., 1., 0., 0.):
+void
+GearMeshBuilder::RotateX180()
+{
+	for (int i = 0; i < 3; i++) {
+		Transform[i][1] = -Transform[i][1];
+		Transform[i][2] = -Transform[i][2];
+	}
+}
+
+// same as glRotatef(angle * 180 / M_PI, 0., 0., 1.):
+void
+GearMeshBuilder::RotateZ(float angle)
+{
+	float c = cos(angle);
+	float s = sin(angle);
+	for (int i = 0; i < 3; i++) {
+		float m0 = Transform[i][0];
+		float m1 = Transform[i][1];
+		Transform[i][0] = m0 * c + m1 * s;
+		Transform[i][1] = -m0 * s + m1 * c;
+	}
+}
+
+// every glBegin(GL_QUAD_STRIP) becomes a triangle strip -- the vertex order is the same:
+// every strip starts with a restart, so each feature has the same index count wherever it lands
+// in the index buffer (a leading restart draws nothing)
+void
+GearMeshBuilder::BeginStrip()
+{
+	AddIndex(GEAR_MESH_RESTART);
+}
+
+void
+GearMeshBuilder::AddIndex(unsigned int index)
+{
+	if (IndexOut != NULL) {
+		IndexOut[NumIndicesOut] = index;
+	}
+	NumIndicesOut++;
+}
+
+// index the next AddVertex( ) will return:
+unsigned int
+GearMeshBuilder::NextVertex() const
+{
+	return BaseVertex + NumVerticesOut;
+}
+
+// transforms and stores a vertex without referencing it, returns its index:
+unsigned int
+GearMeshBuilder::AddVertex(const point& p)
+{
+	point q;
+	q.x = Transform[0][0] * p.x + Transform[0][1] * p.y + Transform[0][2] * p.z;
+	q.y = Transform[1][0] * p.x + Transform[1][1] * p.y + Transform[1][2] * p.z;
+	q.z = Transform[2][0] * p.x + Transform[2][1] * p.y + Transform[2][2] * p.z;
+	q.nx = Transform[0][0] * p.nx + Transform[0][1] * p.ny + Transform[0][2] * p.nz;
+	q.ny = Transform[1][0] * p.nx + Transform[1][1] * p.ny + Transform[1][2] * p.nz;
+	q.nz = Transform[2][0] * p.nx + Transform[2][1] * p.ny + Transform[2][2] * p.nz;
+
+	if (VertexOut != NULL) {
+		VertexOut[NumVerticesOut] = q;
+	}
+	return BaseVertex + NumVerticesOut++;
+}
+
+void
+GearMeshBuilder::EmitPoint(const point& p)
+{
+	AddIndex(AddVertex(p));
+}
+
+// connects a (rows x columns) block of vertices, stored row by row from index first,
+// with one triangle strip between every pair of neighbouring rows:
+void
+GearMeshBuilder::AddGridStrips(unsigned int first, int rows, int columns)
+{
+	for (int i = 1; i < rows; i++) {
+		BeginStrip();
+		for (int j = 0; j < columns; j++) {
+			AddIndex(first + i * columns + j);
+			AddIndex(first + (i - 1) * columns + j);
+		}
+	}
+}
+
+// sweeps a profile of (segments + 1) points along z by dz, as a (profile x thickness) grid of shared vertices
+void
+GearMeshBuilder::BuildSurfaceGrid(point* profile, int segments, float dz)
+{
+	unsigned int first = NextVertex();
+	for (int i = 0; i <= segments; i++) {
+		for (int j = 0; j <= Tess.Depth; j++) {
+			point p = profile[i];
+			p.z += j * dz / Tess.Depth;
+			AddVertex(p);
+		}
+	}
+	AddGridStrips(first, segments + 1, Tess.Depth + 1);
+}
+
+
+// the involute and the tip and root arcs of a single tooth, shared by all teeth:
+void
+GearMeshBuilder::MakeProfiles()
+{
+	if (FixedProfiles) {
+		return;
+	}
+
+	int n = GEAR_MAX_SEGMENTS + 1;
+	std::vector<float> x(n), y(n), nx(n), ny(n);
+	point p0 = { 0., 0., 0., 0., 0., 0. };
+	float side = Internal ? -1.f : 1.f;		// the normals point out of the metal
+
+	ContactPoints.assign(Tess.Involute + 1, p0);
+	SmallCirclePoints.assign(Tess.Root + 1, p0);
+	BigCirclePoints.assign(Tess.Tip + 1, p0);
+
+	// a ring's profile starts above the base circle, turned back so it starts at angle 0 like the others
+	float c = cosf(-InvoluteAngle(InvoluteStart));
+	float s = sinf(-InvoluteAngle(InvoluteStart));
+	SampleInvolute(Radius, InvoluteStart, (InvoluteAlpha - InvoluteStart) / Tess.Involute, Tess.Involute + 1, &x[0], &y[0], &nx[0], &ny[0]);
+	for (int i = 0; i <= Tess.Involute; i++) {
+		ContactPoints[i].x = c * x[i] - s * y[i];
+		ContactPoints[i].y = s * x[i] + c * y[i];
+		ContactPoints[i].nx = side * (c * nx[i] - s * ny[i]);
+		ContactPoints[i].ny = side * (s * nx[i] + c * ny[i]);
+	}
+
+	SampleArc(Radius + ProfileOffset, -ThetaSmall / 2, ThetaSmall / Tess.Root, side, Tess.Root + 1, &x[0], &y[0], &nx[0], &ny[0]);
+	for (int i = 0; i <= Tess.Root; i++) {
+		SmallCirclePoints[i].x = x[i];
+		SmallCirclePoints[i].y = y[i];
+		SmallCirclePoints[i].nx = nx[i];
+		SmallCirclePoints[i].ny = ny[i];
+	}
+
+	SampleArc(Radius + ProfileOffset + TeethHeight, ThetaSmall / 2 + ContactAlpha, ThetaBig / Tess.Tip, side, Tess.Tip + 1, &x[0], &y[0], &nx[0], &ny[0]);
+	for (int i = 0; i <= Tess.Tip; i++) {
+		BigCirclePoints[i].x = x[i];
+		BigCirclePoints[i].y = y[i];
+		BigCirclePoints[i].nx = nx[i];
+		BigCirclePoints[i].ny = ny[i];
+	}
+}
+
+// points the builder at a slice of the output buffers, NULL buffers only count:
+void
+GearMeshBuilder::SetOutput(point* vertices, unsigned int* indices, unsigned int baseVertex)
+{
+	VertexOut = vertices;
+	IndexOut = indices;
+	BaseVertex = baseVertex;
+	NumVerticesOut = 0;
+	NumIndicesOut = 0;
+}
+
+// builds one independent feature into the current output:
+void
+GearMeshBuilder::BuildFeature(int feature, int k)
+{
+	switch (feature) {
+	case TOOTH:
+		BuildTooth(k * 2 * M_PI / NumTeeth);
+		break;
+	case HOB_STEP:
+		BuildHobStep(k);
+		break;
+	case ARM:
+		BuildArm(k);
+		break;
+	}
+}
+
+// Builds numTeeth tooth sectors, optionally followed by the hub, into one mesh.
+// Every tooth, hob step and arm is independent and all features of one kind have the same size.
+// So one instance of each kind is built in counting mode to size the output buffers.
+// After that every feature writes straight into its own slice, in parallel when a pool is given.
+bool
+GearMeshBuilder::BuildFeatures(GearMesh& mesh, int numTeeth, bool hub, WorkerPool* pool)
+{
+	if (!IsValid()) {
+		fprintf(stderr, "Incorrect Gear Parameters!\n");
+		return false;
+	}
+	if (numTeeth > 0) {
+		MakeProfiles();
+	}
+
+	int featureCounts[NUM_FEATURES] = { numTeeth, hub ? Tess.Hob : 0, hub ? Arms : 0 };
+	int featureVertices[NUM_FEATURES];
+	int featureIndices[NUM_FEATURES];
+	int firstTask[NUM_FEATURES + 1];
+	unsigned int firstVertex[NUM_FEATURES + 1];
+	size_t firstIndex[NUM_FEATURES + 1];
+
+	firstTask[0] = 0;
+	firstVertex[0] = 0;
+	firstIndex[0] = 0;
+	for (int f = 0; f < NUM_FEATURES; f++) {
+		featureVertices[f] = featureIndices[f] = 0;
+		if (featureCounts[f] > 0) {
+			SetOutput(NULL, NULL, 0);
+			BuildFeature(f, 0);
+			featureVertices[f] = NumVerticesOut;
+			featureIndices[f] = NumIndicesOut;
+		}
+		firstTask[f + 1] = firstTask[f] + featureCounts[f];
+		firstVertex[f + 1] = firstVertex[f] + featureCounts[f] * featureVertices[f];
+		firstIndex[f + 1] = firstIndex[f] + (size_t)featureCounts[f] * featureIndices[f];
+	}
+
+	mesh.Vertices.resize(firstVertex[NUM_FEATURES]);
+	mesh.Indices.resize(firstIndex[NUM_FEATURES]);
+	if (mesh.Indices.empty()) {
+		return true;
+	}
+
+	auto task = [&](int t) {
+		int f = 0;
+		while (t >= firstTask[f + 1]) {
+			f++;
+		}
+		int k = t - firstTask[f];
+
+		GearMeshBuilder worker = *this;
+		unsigned int v = firstVertex[f] + k * featureVertices[f];
+		size_t i = firstIndex[f] + (size_t)k * featureIndices[f];
+		worker.SetOutput(&mesh.Vertices[v], &mesh.Indices[i], v);
+		worker.BuildFeature(f, k);
+	};
+
+	if (pool != NULL) {
+		pool->Run(firstTask[NUM_FEATURES], task);
+	}
+	else {
+		for (int t = 0; t < firstTask[NUM_FEATURES]; t++) {
+			task(t);
+		}
+	}
+
+	SetOutput(NULL, NULL, 0);
+	return true;
+}
+
+// the complete gear: every tooth, the hob and the arms -- a ring gear has no hob and no arms
+bool
+GearMeshBuilder::Build(GearMesh& mesh, WorkerPool* pool)
+{
+	return BuildFeatures(mesh, NumTeeth, !Internal, pool);
+}
+
+// a single tooth sector at angle 0 -- rotating it by k * 2 * M_PI / NumTeeth gives tooth k
+bool
+GearMeshBuilder::BuildToothSector(GearMesh& mesh, WorkerPool* pool)
+{
+	return BuildFeatures(mesh, 1, false, pool);
+}
+
+// everything that is not repeated per tooth: the hob and the arms
+bool
+GearMeshBuilder::BuildHub(GearMesh& mesh, WorkerPool* pool)
+{
+	return BuildFeatures(mesh, 0, !Internal, pool);
+}
+
+
+// one tooth sector: both contact surfaces, tip and root, side faces, rim segment and inner radius
+void
+GearMeshBuilder::BuildTooth(float phi)
+{
+	point p0;
+
+	// one row of arc samples at a time
+	int n = GEAR_MAX_SEGMENTS + 1;
+	std::vector<float> x(n), y(n), nx(n), ny(n);
+
+	// Contact Surface left
+	LoadIdentity();
+	RotateZ(phi);
+	RotateZ(ThetaSmall / 2);
+	BuildSurfaceGrid(&ContactPoints[0], Tess.Involute, -Thickness);
+
+	// Contact Surface right
+	LoadIdentity();
+	RotateZ(phi);
+	RotateX180();
+	RotateZ(ThetaSmall / 2);
+	BuildSurfaceGrid(&ContactPoints[0], Tess.Involute, Thickness);
+
+	// Outer and Inner tooth radiuses
+	LoadIdentity();
+	RotateZ(phi);
+	BuildSurfaceGrid(&SmallCirclePoints[0], Tess.Root, -Thickness);
+	BuildSurfaceGrid(&BigCirclePoints[0], Tess.Tip, -Thickness);
+
+	// everything below is rotated half a root width, like the left contact surface
+	LoadIdentity();
+	RotateZ(phi);
+	RotateZ(ThetaSmall / 2);
+	if (Internal) {
+		BuildRingRim();
+		return;
+	}
+
+	// Filling Teeth Surfaces: rows follow the involute, columns go across the tooth
+	for (float zNorm = 1.; zNorm >= -1.; zNorm -= 2.) {
+		unsigned int first = NextVertex();
+		for (int i = 0; i <= Tess.Involute; i++) {	// contactPoints loop
+			float tempR = sqrt(ContactPoints[i].x * ContactPoints[i].x + ContactPoints[i].y * ContactPoints[i].y);
+			float phi0R = atan(ContactPoints[i].y / ContactPoints[i].x);
+			float phi1R = 2 * ContactAlpha + ThetaBig - phi0R;
+			SampleArc(tempR, phi0R, (phi1R - phi0R) / Tess.Tip, 1., Tess.Tip + 1, &x[0], &y[0], NULL, NULL);
+
+			for (int j = 0; j <= Tess.Tip; j++) {
+				p0.x = x[j];
+				p0.y = y[j];
+				p0.z = (zNorm == 1.) ? 0. : -Thickness;
+				p0.nx = 0.;
+				p0.ny = 0.;
+				p0.nz = zNorm;
+				AddVertex(p0);
+			}
+		}
+		AddGridStrips(first, Tess.Involute + 1, Tess.Tip + 1);
+	}
+
+	// Drawing rim: rows go inwards from the root radius, columns go around the axis
+	for (float zNorm = 1.; zNorm >= -1.; zNorm -= 2.) {
+		for (int part = 0; part < 2; part++) {
+			float phi0R = (part == 0) ? 0. : -ThetaSmall;
+			float phi1R = (part == 0) ? 2 * ContactAlpha + ThetaBig : 0.;
+			int columns = (part == 0) ? Tess.Tip : Tess.Root;
+
+			// every row is the same unit arc, scaled
+			SampleArc(1., phi0R, (phi1R - phi0R) / columns, 1., columns + 1, &x[0], &y[0], NULL, NULL);
+
+			unsigned int first = NextVertex();
+			for (int i = 0; i <= Tess.Rim; i++) {
+				float tempR = Radius - i * 0.2 / Tess.Rim * Radius;
+
+				for (int j = 0; j <= columns; j++) {
+					p0.x = tempR * x[j];
+					p0.y = tempR * y[j];
+					p0.z = (zNorm == 1.) ? 0. : -Thickness;
+					p0.nx = 0.;
+					p0.ny = 0.;
+					p0.nz = zNorm;
+					AddVertex(p0);
+				}
+			}
+			AddGridStrips(first, Tess.Rim + 1, columns + 1);
+		}
+	}
+
+	// Filling inner radius, 1st and 2nd part: rows go around the axis, columns go down the thickness
+	float tempR = 0.8 * Radius;
+	for (int part = 0; part < 2; part++) {
+		float phi0R = (part == 0) ? 0. : -ThetaSmall;
+		float phi1R = (part == 0) ? 2 * ContactAlpha + ThetaBig : 0.;
+		int rows = (part == 0) ? Tess.Tip : Tess.Root;
+
+		SampleArc(tempR, phi0R, (phi1R - phi0R) / rows, -1., rows + 1, &x[0], &y[0], &nx[0], &ny[0]);
+
+		unsigned int first = NextVertex();
+		for (int i = 0; i <= rows; i++) {
+			for (int j = 0; j <= Tess.Depth; j++) {
+				p0.x = x[i];
+				p0.y = y[i];
+				p0.z = -j * Thickness / Tess.Depth;
+				p0.nx = nx[i];
+				p0.ny = ny[i];
+				p0.nz = 0.;
+				AddVertex(p0);
+			}
+		}
+		AddGridStrips(first, rows + 1, Tess.Depth + 1);
+	}
+}
+
+// The faces and the outer radius of one tooth sector of a ring gear, in the frame of the left contact surface.
+// The ring's tooth fills the root arc of the profile, between the right involute of this sector and
+// the left one of the next, and the rim goes around everything from the tip radius out.
+void
+GearMeshBuilder::BuildRingRim()
+{
+	point p0;
+	int n = GEAR_MAX_SEGMENTS + 1;
+	std::vector<float> x(n), y(n), nx(n), ny(n);
+	float innerR = Radius + ProfileOffset + TeethHeight;
+	float outerR = innerR + GEAR_RING_RIM * Radius;
+
+	// Filling Teeth Surfaces: rows follow the involute, columns go across the root arc to the next tooth
+	for (float zNorm = 1.; zNorm >= -1.; zNorm -= 2.) {
+		unsigned int first = NextVertex();
+		for (int i = 0; i <= Tess.Involute; i++) {
+			float tempR = sqrt(ContactPoints[i].x * ContactPoints[i].x + ContactPoints[i].y * ContactPoints[i].y);
+			float phi0R = atan(ContactPoints[i].y / ContactPoints[i].x);
+			float phi1R = 2 * ContactAlpha + ThetaBig - phi0R;
+			SampleArc(tempR, phi1R, (GetToothAngle() + phi0R - phi1R) / Tess.Root, 1., Tess.Root + 1, &x[0], &y[0], NULL, NULL);
+
+			for (int j = 0; j <= Tess.Root; j++) {
+				p0.x = x[j];
+				p0.y = y[j];
+				p0.z = (zNorm == 1.) ? 0. : -Thickness;
+				p0.nx = 0.;
+				p0.ny = 0.;
+				p0.nz = zNorm;
+				AddVertex(p0);
+			}
+		}
+		AddGridStrips(first, Tess.Involute + 1, Tess.Root + 1);
+	}
+
+	// Drawing rim: rows go outwards from the tip radius, columns go around the axis
+	for (float zNorm = 1.; zNorm >= -1.; zNorm -= 2.) {
+		for (int part = 0; part < 2; part++) {
+			float phi0R = (part == 0) ? 0. : -ThetaSmall;
+			float phi1R = (part == 0) ? 2 * ContactAlpha + ThetaBig : 0.;
+			int columns = (part == 0) ? Tess.Tip : Tess.Root;
+
+			SampleArc(1., phi0R, (phi1R - phi0R) / columns, 1., columns + 1, &x[0], &y[0], NULL, NULL);
+
+			unsigned int first = NextVertex();
+			for (int i = 0; i <= Tess.Rim; i++) {
+				float tempR = innerR + i * GEAR_RING_RIM / Tess.Rim * Radius;
+
+				for (int j = 0; j <= columns; j++) {
+					p0.x = tempR * x[j];
+					p0.y = tempR * y[j];
+					p0.z = (zNorm == 1.) ? 0. : -Thickness;
+					p0.nx = 0.;
+					p0.ny = 0.;
+					p0.nz = zNorm;
+					AddVertex(p0);
+				}
+			}
+			AddGridStrips(first, Tess.Rim + 1, columns + 1);
+		}
+	}
+
+	// Filling outer radius: rows go around the axis, columns go down the thickness
+	for (int part = 0; part < 2; part++) {
+		float phi0R = (part == 0) ? 0. : -ThetaSmall;
+		float phi1R = (part == 0) ? 2 * ContactAlpha + ThetaBig : 0.;
+		int rows = (part == 0) ? Tess.Tip : Tess.Root;
+
+		SampleArc(outerR, phi0R, (phi1R - phi0R) / rows, 1., rows + 1, &x[0], &y[0], &nx[0], &ny[0]);
+
+		unsigned int first = NextVertex();
+		for (int i = 0; i <= rows; i++) {
+			for (int j = 0; j <= Tess.Depth; j++) {
+				p0.x = x[i];
+				p0.y = y[i];
+				p0.z = -j * Thickness / Tess.Depth;
+				p0.nx = nx[i];
+				p0.ny = ny[i];
+				p0.nz = 0.;
+				AddVertex(p0);
+			}
+		}
+		AddGridStrips(first, rows + 1, Tess.Depth + 1);
+	}
+}
+
+
+// one step of the hob: outer and inner cylinders plus the top and bottom rings
+void
+GearMeshBuilder::BuildHobStep(int step)
+{
+	point p0, p1;
+
+	// both edges of the step on the unit circle, each sampled by itself,
+	// so the next step gets exactly the same vertices on the edge they share
+	float c[2], s[2];
+	SampleArc(1., step * 2. * M_PI / Tess.Hob, 0., 1., 1, &c[0], &s[0], NULL, NULL);
+	SampleArc(1., (step + 1) * 2. * M_PI / Tess.Hob, 0., 1., 1, &c[1], &s[1], NULL, NULL);
+
+	LoadIdentity();
+
+	// outer and inner circle
+	for (int inner = 0; inner < 2; inner++) {
+		float r = inner ? 0.1 : 0.2;
+		float n = inner ? -1. : 1.;
+
+		p0.x = Radius * r * c[0];
+		p0.y = Radius * r * s[0];
+		p0.z = 0.;
+		p0.nx = n * c[0];
+		p0.ny = n * s[0];
+		p0.nz = 0.;
+
+		p1.x = Radius * r * c[1];
+		p1.y = Radius * r * s[1];
+		p1.z = 0.;
+		p1.nx = n * c[1];
+		p1.ny = n * s[1];
+		p1.nz = 0.;
+
+		BeginStrip();
+		EmitPoint(p0);
+		EmitPoint(p1);
+		for (int j = 1; j <= Tess.Depth; j++) {
+			p0.z -= Thickness / Tess.Depth;
+			p1.z -= Thickness / Tess.Depth;
+			EmitPoint(p0);
+			EmitPoint(p1);
+		}
+	}
+
+	// filling top and bottom surface
+	for (float zNorm = 1.; zNorm >= -1.; zNorm -= 2.) {
+		BeginStrip();
+		for (int j = 0; j <= Tess.Rim; j++) {
+			p0.x = Radius * (0.2 - 0.1 * j / Tess.Rim) * c[0];
+			p0.y = Radius * (0.2 - 0.1 * j / Tess.Rim) * s[0];
+			p0.z = (zNorm == 1.) ? 0. : -Thickness;
+			p0.nx = 0.;
+			p0.ny = 0.;
+			p0.nz = zNorm;
+
+			p1.x = Radius * (0.2 - 0.1 * j / Tess.Rim) * c[1];
+			p1.y = Radius * (0.2 - 0.1 * j / Tess.Rim) * s[1];
+			p1.z = (zNorm == 1.) ? 0. : -Thickness;
+			p1.nx = 0.;
+			p1.ny = 0.;
+			p1.nz = zNorm;
+
+			EmitPoint(p0);
+			EmitPoint(p1);
+		}
+	}
+}
+
+
+// one arm connecting the hob to the rim
+void
+GearMeshBuilder::BuildArm(int k)
+{
+	point p0, p1;
+
+	float phi0p0 = asin(0.05 / 0.2);
+	float phi1p0 = -phi0p0;
+	float phi0p1 = asin(0.05 / 0.8);
+	float phi1p1 = -phi0p1;
+
+	// the arm's ends on the hob and on the rim, from one side to the other:
+	int n = Tess.Arm + 1;
+	std::vector<float> xHob(n), yHob(n), xRim(n), yRim(n);
+	SampleArc(0.2 * Radius, phi1p0, (phi0p0 - phi1p0) / Tess.Arm, 1., n, &xHob[0], &yHob[0], NULL, NULL);
+	SampleArc(0.8 * Radius, phi1p1, (phi0p1 - phi1p1) / Tess.Arm, 1., n, &xRim[0], &yRim[0], NULL, NULL);
+
+	LoadIdentity();
+	RotateZ(k * 2 * M_PI / Arms);
+
+	for (int i = 1; i <= Tess.Arm; i++) {
+		float xp0 = xHob[i];
+		float yp0 = yHob[i];
+		float xp0prev = xHob[i - 1];
+		float yp0prev = yHob[i - 1];
+		float xp1 = xRim[i];
+		float xp1prev = xRim[i - 1];
+
+		// Drawing top and bot surface
+		for (float zNorm = 1.; zNorm >= -1.; zNorm -= 2.) {
+			p0.x = xp0prev;
+			p0.y = yp0prev;
+			p0.z = (zNorm == 1.) ? 0. : -Thickness;
+			p0.nx = 0.;
+			p0.ny = 0.;
+			p0.nz = zNorm;
+
+			p1.x = xp0;
+			p1.y = yp0;
+			p1.z = (zNorm == 1.) ? 0. : -Thickness;
+			p1.nx = 0.;
+			p1.ny = 0.;
+			p1.nz = zNorm;
+
+			BeginStrip();
+			EmitPoint(p0);
+			EmitPoint(p1);
+			for (int j = 1; j <= Tess.Rim; j++) {
+				p0.x += (xp1prev - xp0prev) / Tess.Rim;
+				p1.x += (xp1 - xp0) / Tess.Rim;
+				EmitPoint(p0);
+				EmitPoint(p1);
+			}
+		}
+	}
+
+	// the side walls meet the top and bottom surfaces at the last samples of the ends:
+	float xp0 = xHob[Tess.Arm];
+	float yp0 = yHob[Tess.Arm];
+	float xp1 = xRim[Tess.Arm];
+	for (int i = 1; i <= Tess.Depth; i++) {
+		// Drawing the two side walls
+		for (float yNorm = 1.; yNorm >= -1.; yNorm -= 2.) {
+			p0.x = xp0;
+			p0.y = yNorm * yp0;
+			p0.z = -(i - 1) * Thickness / Tess.Depth;
+			p0.nx = 0.;
+			p0.ny = yNorm;
+			p0.nz = 0.;
+
+			p1.x = xp0;
+			p1.y = yNorm * yp0;
+			p1.z = -i * Thickness / Tess.Depth;
+			p1.nx = 0.;
+			p1.ny = yNorm;
+			p1.nz = 0.;
+
+			BeginStrip();
+			EmitPoint(p0);
+			EmitPoint(p1);
+			for (int j = 1; j <= Tess.Rim; j++) {
+				p0.x += (xp1 - xp0) / Tess.Rim;
+				p1.x += (xp1 - xp0) / Tess.Rim;
+				EmitPoint(p0);
+				EmitPoint(p1);
+			}
+		}
+	}
+}
+
+
+// Scaling benchmark of the mesh generation over 1 .. maxThreads threads.
+// Runs without a window, reports the best of a few builds for every thread count.
+void
+BenchmarkGearMeshBuilder(int maxThreads)
+{
+	if (maxThreads <= 0) {
+		maxThreads = (int)std::thread::hardware_concurrency();
+	}
+	if (maxThreads <= 0) {
+		maxThreads = 1;
+	}
+
+	struct BenchCase
+	{
+		const char *	name;
+		int				teeth;
+		int				polygons;
+	};
+	BenchCase cases[] =
+	{
+		{ "47 teeth,   20 polygons", 47, 20 },
+		{ "47 teeth,   80 polygons", 47, 80 },
+		{ "1000 teeth, 20 polygons", 1000, 20 },
+	};
+	const int REPEATS = 3;
+
+	for (size_t c = 0; c < sizeof(cases) / sizeof(BenchCase); c++) {
+		// keep the module of the default transmission, so the radius grows with the teeth
+		GearMeshBuilder builder(cases[c].teeth, 10. * cases[c].teeth / 23, 2., 2., 5, cases[c].polygons);
+		GearMesh mesh;
+		double serialMs = 0.;
+
+		fprintf(stderr, "%s:\n", cases[c].name);
+		for (int threads = 1; threads <= maxThreads; threads++) {
+			WorkerPool pool(threads);
+			double bestMs = 1.e30;
+			for (int r = 0; r < REPEATS; r++) {
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				builder.Build(mesh, &pool);
+				std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+				if (elapsed.count() < bestMs) {
+					bestMs = elapsed.count();
+				}
+			}
+			if (threads == 1) {
+				serialMs = bestMs;
+			}
+			fprintf(stderr, "  %2d threads: %9.2f ms  (x%.2f)  %d vertices\n", threads, bestMs, serialMs / bestMs, mesh.NumVertices());
+		}
+	}
+}
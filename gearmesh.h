@@ -0,0 +1,593 @@
+#ifndef GEARMESH_H
+#define GEARMESH_H
+
+// Headless gear mesh generation.
+// Nothing in here touches OpenGL, so gear meshes can be generated, cached, measured and tested without a window.
+// The renderer only has to upload the resulting buffers.
+
+#ifndef _USE_MATH_DEFINES
+#define _USE_MATH_DEFINES
+#endif
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "gearsimd.h"
+#include "workerpool.h"
+
+#define GEAR_GLOBAL_TOLERANCE	0.0000001
+
+// the thinnest tooth tip, as a part of the space the involutes of a tooth leave (see GetStandardShare):
+#define GEAR_MIN_TIP_SHARE	0.1
+
+// the hob is built in one degree steps, at most:
+#define HOB_STEPS	360
+
+// upper limit for the segments of any one curve or edge:
+#define GEAR_MAX_SEGMENTS	256
+
+// the rim of an internal ring gear, outside its tooth roots, as a part of its radius:
+#define GEAR_RING_RIM	0.1
+
+// one vertex of the gear mesh, interleaved so it can be uploaded as is:
+// (corrosion is procedural in pattern.frag, so there are no texture coords)
+struct point
+{
+	float x, y, z;		// coordinates
+	float nx, ny, nz;	// surface normal
+};
+
+// index value that separates triangle strips in the index buffer (glPrimitiveRestartIndex):
+const unsigned int GEAR_MESH_RESTART = 0xffffffff;
+
+// an indexed gear mesh in plain memory:
+// the indices form triangle strips separated by GEAR_MESH_RESTART
+struct GearMesh
+{
+	std::vector<point>			Vertices;
+	std::vector<unsigned int>	Indices;
+
+	void	Clear();
+	int		NumVertices() const;
+	int		NumIndices() const;
+	int		NumTriangles() const;
+	void	PrintStats(const char*) const;
+	size_t	SizeInBytes() const;
+};
+
+// How finely each part of a gear is divided, in segments.
+// Curves get enough segments to stay within a chord error, straight edges are exact with one
+// segment and get about as many as keep the triangles near square.
+struct GearTessellation
+{
+	int		Involute;	// along each contact surface
+	int		Tip;		// across the tooth: tip arc, face fill, rim and inner radius below the tooth
+	int		Root;		// between two teeth: root arc, rim and inner radius below it
+	int		Hob;		// around the hob, HOB_STEPS at most
+	int		Arm;		// across an arm
+	int		Depth;		// along the thickness
+	int		Rim;		// radially across the rim and the hob faces, and along the arms
+};
+
+GearTessellation	MakeUniformTessellation(int);
+
+// Compile time math for the gear geometry below.
+// Plain series, evaluated in double until the terms stop changing the result.
+// They also run at run time, but the profile kernels in gearsimd.h are much faster there.
+constexpr double
+ConstSqrt(double x)
+{
+	if (x <= 0.) {
+		return 0.;
+	}
+	double r = x > 1. ? x : 1.;
+	for (int i = 0; i < 100; i++) {
+		double next = 0.5 * (r + x / r);
+		if (next >= r) {
+			break;
+		}
+		r = next;
+	}
+	return r;
+}
+
+constexpr double
+ConstSin(double x)
+{
+	double turns = x / (2. * M_PI);
+	x -= 2. * M_PI * (double)(long long)(turns + (turns < 0. ? -0.5 : 0.5));	// now in [-pi, pi]
+	double term = x;
+	double sum = x;
+	for (int n = 1; n < 40 && sum + term != sum; n++) {
+		term *= -x * x / ((2 * n) * (2 * n + 1));
+		sum += term;
+	}
+	return sum;
+}
+
+constexpr double
+ConstCos(double x)
+{
+	return ConstSin(x + M_PI / 2);
+}
+
+constexpr double
+ConstAtan(double x)
+{
+	if (x < 0.) {
+		return -ConstAtan(-x);
+	}
+	if (x > 1.) {
+		return M_PI / 2 - ConstAtan(1. / x);
+	}
+	// two half angle steps bring x below tan(pi / 16), where the series converges quickly
+	x = x / (1. + ConstSqrt(1. + x * x));
+	x = x / (1. + ConstSqrt(1. + x * x));
+	double term = x;
+	double sum = x;
+	for (int n = 1; n < 60 && sum + term / (2 * n + 1) != sum; n++) {
+		term *= -x * x;
+		sum += term / (2 * n + 1);
+	}
+	return 4. * sum;
+}
+
+constexpr double
+ConstAcos(double x)
+{
+	if (x >= 1.) {
+		return 0.;
+	}
+	if (x <= -1.) {
+		return M_PI;
+	}
+	return 2. * ConstAtan(ConstSqrt((1. - x) / (1. + x)));
+}
+
+// the angles of one tooth, from the closed form of the involute:
+// the involute of the base circle R reaches radius R * sqrt(1 + t^2) at parameter t,
+// so it ends on the outer radius Ra at t = sqrt((Ra / R)^2 - 1), at the polar angle t - atan(t).
+// The teeth of a ring start an offset above its base circle, there the profile starts at a parameter above 0.
+struct GearAngles
+{
+	double	InvoluteStart;		// involute parameter where the profile starts, 0 on the base circle
+	double	InvoluteAlpha;		// involute parameter where the involute reaches the outer radius
+	double	ContactAlpha;		// angular size of the profile's involute around the gear axis
+	double	ThetaBig;			// angular width of the tooth tip
+	double	ThetaSmall;			// angular width of the tooth root
+};
+
+// polar angle of the involute at parameter t, the involute function inv(t):
+constexpr double
+InvoluteAngle(double t)
+{
+	return t - ConstAtan(t);
+}
+
+// parameter where the involute of the base circle radius reaches radius r:
+constexpr double
+InvoluteParameter(double radius, double r)
+{
+	double ratio = r / radius;
+	return ConstSqrt(ratio * ratio - 1.);
+}
+
+// Parameter where the involute reaches the polar angle, by Newton's method on inv(t) - angle.
+// inv'(t) = t^2 / (1 + t^2), and inv is convex for t > 0: started above the root, every step stays above it,
+// so the iterations go down to it without overshooting. inv(t) > t - pi / 2 gives such a start.
+constexpr double
+SolveInvolute(double angle)
+{
+	if (angle <= 0.) {
+		return 0.;
+	}
+	double t = angle + M_PI / 2;
+	for (int i = 0; i < 100; i++) {
+		double step = (InvoluteAngle(t) - angle) * (1. + t * t) / (t * t);
+		t -= step;
+		if (step < GEAR_GLOBAL_TOLERANCE * t) {
+			break;
+		}
+	}
+	return t;
+}
+
+// toothShare is the part of the space between the two involutes of a tooth that goes to its tip,
+// the rest goes to the root between two teeth; the teeth go from offset to offset + teethHeight above the radius:
+constexpr GearAngles
+MakeGearAngles(int numTeeth, double radius, double teethHeight, double toothShare, double offset = 0.)
+{
+	double involuteStart = InvoluteParameter(radius, radius + offset);
+	double involuteAlpha = InvoluteParameter(radius, radius + offset + teethHeight);
+	double contactAlpha = InvoluteAngle(involuteAlpha) - InvoluteAngle(involuteStart);
+	double rest = 2. * M_PI / numTeeth - 2. * contactAlpha;
+	GearAngles angles = { involuteStart, involuteAlpha, contactAlpha, rest * toothShare, rest * (1. - toothShare) };
+	return angles;
+}
+
+// Tooth thickness and center distance of a meshing pair.
+// A tooth is measured by its angle on the base circle, psi = 2 inv(InvoluteAlpha) + ThetaBig, and on the radius
+// R sqrt(1 + t^2) it is psi - 2 inv(t) thick. Two gears with the base radii R1 and R2 at the center distance C
+// touch along the line tangent to both base circles, which crosses the line of centers where the involutes
+// have the parameter tw = sqrt((C / (R1 + R2))^2 - 1). There the teeth of one fill the gaps of the other,
+// short of the backlash along that line, when
+//	R1 psi1 + R2 psi2 = 2 pi m + 2 (R1 + R2) inv(tw) - backlash,
+// m being the base radius per tooth, the same for both.
+// The "teeth" of an internal ring are its spaces, and a planet of base radius Rp meshes with the ring Rr
+// on the line tangent to both base circles on the same side, tw = sqrt((C / (Rr - Rp))^2 - 1). The space
+// holds the planet's tooth and the backlash when
+//	Rr psi_r - Rp psi_p = 2 (Rr - Rp) inv(tw) + backlash.
+
+// angle of a tooth on its base circle:
+constexpr double
+GetBaseThickness(int numTeeth, double radius, double teethHeight, double toothShare, double offset = 0.)
+{
+	GearAngles angles = MakeGearAngles(numTeeth, radius, teethHeight, toothShare, offset);
+	return 2. * InvoluteAngle(angles.InvoluteAlpha) + angles.ThetaBig;
+}
+
+// the tooth share of a tooth baseThickness wide on its base circle, not clamped:
+constexpr double
+GetToothShare(int numTeeth, double radius, double teethHeight, double baseThickness, double offset = 0.)
+{
+	GearAngles angles = MakeGearAngles(numTeeth, radius, teethHeight, 0., offset);
+	if (angles.ThetaSmall <= 0.) {
+		return GEAR_MIN_TIP_SHARE;
+	}
+	return (baseThickness - 2. * InvoluteAngle(angles.InvoluteAlpha)) / angles.ThetaSmall;
+}
+
+// The tooth share of a gear by itself: the teeth are as thick as the gaps halfway up, where two such gears
+// roll on each other, so it meshes with a copy of itself without backlash.
+// Small gears with high teeth would come to a point below their tips, they keep GEAR_MIN_TIP_SHARE.
+constexpr double
+GetStandardShare(int numTeeth, double radius, double teethHeight, double offset = 0.)
+{
+	double thickness = M_PI / numTeeth + 2. * InvoluteAngle(InvoluteParameter(radius, radius + offset + teethHeight / 2.));
+	double share = GetToothShare(numTeeth, radius, teethHeight, thickness, offset);
+	return share < GEAR_MIN_TIP_SHARE ? GEAR_MIN_TIP_SHARE : share > 1. ? 1. : share;
+}
+
+// a driven gear fitted to its driver:
+struct GearMeshFit
+{
+	double	ToothShare;			// of the driven gear
+	double	CenterDistance;
+	double	Backlash;			// along the line of action, as the pair ends up
+};
+
+// The driven gear gets the tooth share that leaves the requested backlash at the usual center distance,
+// where its tips reach the driver's roots and the other way round.
+// A tooth thinner than GEAR_MIN_TIP_SHARE allows keeps that share and the gears move apart instead,
+// until the line of action is tilted enough for the teeth: the equation above solved for inv(tw),
+// then SolveInvolute( ) for tw. A tooth that would have to fill its own roots gets share 1 at the usual distance,
+// and more backlash than requested.
+constexpr GearMeshFit
+FitGearMesh(int driverTeeth, double driverRadius, double driverShare, int numTeeth, double radius, double teethHeight, double backlash)
+{
+	double module = driverRadius / driverTeeth;
+	double sum = driverRadius + radius;
+	double driver = driverRadius * GetBaseThickness(driverTeeth, driverRadius, teethHeight, driverShare);
+	GearMeshFit fit = { 0., sum + teethHeight, backlash };
+	double total = 2. * M_PI * module + 2. * sum * InvoluteAngle(InvoluteParameter(sum, fit.CenterDistance)) - backlash;
+	double share = GetToothShare(numTeeth, radius, teethHeight, (total - driver) / radius);
+	if (share > 1.) {
+		fit.ToothShare = 1.;
+		fit.Backlash += total - driver - radius * GetBaseThickness(numTeeth, radius, teethHeight, 1.);
+	}
+	else if (share < GEAR_MIN_TIP_SHARE) {
+		fit.ToothShare = GEAR_MIN_TIP_SHARE;
+		double thickness = radius * GetBaseThickness(numTeeth, radius, teethHeight, GEAR_MIN_TIP_SHARE);
+		double tw = SolveInvolute((driver + thickness - 2. * M_PI * module + backlash) / (2. * sum));
+		fit.CenterDistance = sum * ConstSqrt(1. + tw * tw);
+	}
+	else {
+		fit.ToothShare = share;
+	}
+	return fit;
+}
+
+// the ring of a planetary set fitted to its planets:
+struct GearRingFit
+{
+	double	ToothShare;			// of the ring's spaces, its teeth get the rest
+	double	ProfileOffset;		// from its base circle out to its teeth
+	double	Backlash;			// along the line of action, as the pair ends up
+};
+
+// The planets go around at centerDistance, and the ring's teeth reach in to their roots: they start at
+// C + Rp, above the base circle Rr by the offset, and end where the planets' tips reach. The spaces get the share
+// that leaves the backlash by the internal equation above. The ring's teeth are the rest of the space, so
+// 1 - GEAR_MIN_TIP_SHARE leaves them their thinnest tip; a ring that cannot get the backlash
+// between that and spaces with no root arc keeps the nearest share, and the backlash as it ends up.
+constexpr GearRingFit
+FitRingMesh(int planetTeeth, double planetRadius, double planetShare, int numTeeth, double radius, double teethHeight,
+	double centerDistance, double backlash)
+{
+	double difference = radius - planetRadius;
+	double planet = planetRadius * GetBaseThickness(planetTeeth, planetRadius, teethHeight, planetShare);
+	double total = planet + 2. * difference * InvoluteAngle(InvoluteParameter(difference, centerDistance));
+	GearRingFit fit = { 0., centerDistance + planetRadius - radius, backlash };
+	double share = GetToothShare(numTeeth, radius, teethHeight, (total + backlash) / radius, fit.ProfileOffset);
+	fit.ToothShare = share < 0. ? 0. : share > 1. - GEAR_MIN_TIP_SHARE ? 1. - GEAR_MIN_TIP_SHARE : share;
+	if (fit.ToothShare != share) {
+		fit.Backlash = radius * GetBaseThickness(numTeeth, radius, teethHeight, fit.ToothShare, fit.ProfileOffset) - total;
+	}
+	return fit;
+}
+
+// Segments of the curves of a tooth for a maximum chord error, shared by GearMeshBuilder::MakeTessellation( )
+// and the compile time profiles below, so both come to the same counts for the same gear.
+// The arguments are floats, as the builder keeps them.
+constexpr int
+ClampSegments(double segments)
+{
+	if (segments < 1.) {
+		return 1;
+	}
+	if (segments > GEAR_MAX_SEGMENTS) {
+		return GEAR_MAX_SEGMENTS;
+	}
+	int whole = (int)segments;
+	return whole < segments ? whole + 1 : whole;
+}
+
+// segments of an arc of radius r over angle, so no chord is further than maxError from the arc:
+constexpr int
+ArcSegments(float r, float angle, float maxError)
+{
+	if (maxError >= r) {
+		return 1;
+	}
+	return ClampSegments(angle / (2. * ConstAcos(1. - maxError / r)));
+}
+
+// the involute, tip and root segments of one tooth:
+struct GearProfileSegments
+{
+	int		Involute;
+	int		Tip;
+	int		Root;
+};
+
+// The involute has the radius of curvature Radius * t, largest at the tip, so a step dt
+// of the involute parameter deviates by about Radius * InvoluteAlpha * dt^2 / 8 from the curve.
+// The tip segments also span the face fill and the rim below the tooth, which is wider.
+constexpr GearProfileSegments
+MakeProfileSegments(float radius, float teethHeight, float involuteAlpha, float contactAlpha, float thetaBig, float thetaSmall, float maxError)
+{
+	float dt = ConstSqrt(8. * maxError / (radius * involuteAlpha));
+	int tip = ArcSegments(radius + teethHeight, thetaBig, maxError);
+	int below = ArcSegments(radius, 2 * contactAlpha + thetaBig, maxError);
+	GearProfileSegments segments = { ClampSegments(involuteAlpha / dt), tip > below ? tip : below,
+		ArcSegments(radius, thetaSmall, maxError) };
+	return segments;
+}
+
+// the involute and the tip and root arcs of one tooth at one level of detail,
+// MaxSegments + 1 points at most, Segments tells how many are used:
+template <int MaxSegments>
+struct GearProfileTables
+{
+	GearProfileSegments	Segments;
+	point	Contact[MaxSegments + 1];
+	point	SmallCircle[MaxSegments + 1];
+	point	BigCircle[MaxSegments + 1];
+};
+
+template <int MaxSegments>
+constexpr GearProfileTables<MaxSegments>
+MakeGearProfileTables(double radius, double teethHeight, const GearAngles& angles, const GearProfileSegments& segments)
+{
+	GearProfileTables<MaxSegments> tables = {};
+	tables.Segments = segments;
+	for (int i = 0; i <= segments.Involute; i++) {
+		double c = i * angles.InvoluteAlpha / segments.Involute;
+		double sinC = ConstSin(c);
+		double cosC = ConstCos(c);
+		tables.Contact[i].x = (float)(radius * (cosC + c * sinC));
+		tables.Contact[i].y = (float)(radius * (sinC - c * cosC));
+		tables.Contact[i].nx = (float)sinC;
+		tables.Contact[i].ny = (float)-cosC;
+	}
+	for (int i = 0; i <= segments.Root; i++) {
+		double cSmall = -angles.ThetaSmall / 2 + i * angles.ThetaSmall / segments.Root;
+		tables.SmallCircle[i].x = (float)(radius * ConstCos(cSmall));
+		tables.SmallCircle[i].y = (float)(radius * ConstSin(cSmall));
+		tables.SmallCircle[i].nx = (float)ConstCos(cSmall);
+		tables.SmallCircle[i].ny = (float)ConstSin(cSmall);
+	}
+	for (int i = 0; i <= segments.Tip; i++) {
+		double cBig = angles.ThetaSmall / 2 + angles.ContactAlpha + i * angles.ThetaBig / segments.Tip;
+		tables.BigCircle[i].x = (float)((radius + teethHeight) * ConstCos(cBig));
+		tables.BigCircle[i].y = (float)((radius + teethHeight) * ConstSin(cBig));
+		tables.BigCircle[i].nx = (float)ConstCos(cBig);
+		tables.BigCircle[i].ny = (float)ConstSin(cBig);
+	}
+	return tables;
+}
+
+// the profiles of every level of detail, the finest first:
+template <int MaxSegments, int NumLods>
+struct GearLodTables
+{
+	GearProfileTables<MaxSegments>	Lods[NumLods];
+};
+
+template <int MaxSegments, int NumLods>
+constexpr GearLodTables<MaxSegments, NumLods>
+MakeGearLodTables(double radius, double teethHeight, const GearAngles& angles, float maxError, float errorStep)
+{
+	GearLodTables<MaxSegments, NumLods> tables = {};
+	for (int lod = 0; lod < NumLods; lod++) {
+		GearProfileSegments segments = MakeProfileSegments((float)radius, (float)teethHeight, (float)angles.InvoluteAlpha,
+			(float)angles.ContactAlpha, (float)angles.ThetaBig, (float)angles.ThetaSmall, maxError);
+		tables.Lods[lod] = MakeGearProfileTables<MaxSegments>(radius, teethHeight, angles, segments);
+		maxError *= errorStep;
+	}
+	return tables;
+}
+
+// A gear whose parameters are all known at compile time.
+// Dims supplies the sizes shared by the gears of one transmission, as static constexpr doubles:
+//	RadiusPerTooth	(the radius grows with the teeth, keeping the module)
+//	TeethHeight
+// and Lods the levels of detail the gear is drawn in:
+//	Count
+//	MaxError		chord error of LOD 0, a float like the one the renderer passes to MakeTessellation( )
+//	ErrorStep		factor from one LOD to the next
+// Angles and the profile tables of every LOD are computed by the compiler, impossible gears do not compile.
+// A gear with DriverTeeth > 0 is fitted to the driver with that many teeth and the standard share,
+// without backlash, any other gear has the standard share.
+// Gears read at run time use the GearMeshBuilder constructor that takes the parameters instead.
+template <int Teeth, class Dims, class Lods, int DriverTeeth = 0>
+struct GearGeometry
+{
+	static_assert(Teeth >= 3, "A gear needs at least 3 teeth");
+	static_assert(Dims::RadiusPerTooth > 0. && Dims::TeethHeight > 0., "Gear radius and teeth height must be positive");
+	static_assert(Lods::Count >= 1 && Lods::MaxError > 0.f, "A gear needs at least 1 level of detail");
+
+	static constexpr int		NumTeeth = Teeth;
+	static constexpr int		NumLods = Lods::Count;
+	static constexpr float		MaxError = Lods::MaxError;
+	static constexpr double		Radius = Dims::RadiusPerTooth * Teeth;
+	static constexpr double		TeethHeight = Dims::TeethHeight;
+	static constexpr double		ToothShare = DriverTeeth > 0 ?
+		FitGearMesh(DriverTeeth, Dims::RadiusPerTooth * DriverTeeth, GetStandardShare(DriverTeeth, Dims::RadiusPerTooth * DriverTeeth, TeethHeight),
+			Teeth, Radius, TeethHeight, 0.).ToothShare :
+		GetStandardShare(Teeth, Radius, TeethHeight);
+	static constexpr GearAngles	Angles = MakeGearAngles(Teeth, Radius, TeethHeight, ToothShare);
+
+	static_assert(Angles.ThetaBig >= 0., "Incorrect Gear Parameters! The teeth are too high for their number: the involutes of one tooth overlap");
+
+	// LOD 0 has the most segments, the tables are as large as it needs:
+	static constexpr GearProfileSegments	Finest = MakeProfileSegments((float)Radius, (float)TeethHeight, (float)Angles.InvoluteAlpha,
+		(float)Angles.ContactAlpha, (float)Angles.ThetaBig, (float)Angles.ThetaSmall, Lods::MaxError);
+	static constexpr int		MaxSegments = Finest.Involute > Finest.Tip ? (Finest.Involute > Finest.Root ? Finest.Involute : Finest.Root) :
+		(Finest.Tip > Finest.Root ? Finest.Tip : Finest.Root);
+	static constexpr GearLodTables<MaxSegments, Lods::Count>	Profiles =
+		MakeGearLodTables<MaxSegments, Lods::Count>(Radius, TeethHeight, Angles, Lods::MaxError, Lods::ErrorStep);
+};
+
+template <int Teeth, class Dims, class Lods, int DriverTeeth>
+constexpr double GearGeometry<Teeth, Dims, Lods, DriverTeeth>::ToothShare;
+
+template <int Teeth, class Dims, class Lods, int DriverTeeth>
+constexpr GearAngles GearGeometry<Teeth, Dims, Lods, DriverTeeth>::Angles;
+
+template <int Teeth, class Dims, class Lods, int DriverTeeth>
+constexpr GearProfileSegments GearGeometry<Teeth, Dims, Lods, DriverTeeth>::Finest;
+
+template <int Teeth, class Dims, class Lods, int DriverTeeth>
+constexpr GearLodTables<GearGeometry<Teeth, Dims, Lods, DriverTeeth>::MaxSegments, Lods::Count> GearGeometry<Teeth, Dims, Lods, DriverTeeth>::Profiles;
+
+// the profiles of one LOD of a GearGeometry<>, without its template arguments:
+struct GearFixedProfiles
+{
+	GearProfileSegments	Segments;
+	const point *		Contact;
+	const point *		SmallCircle;
+	const point *		BigCircle;
+};
+
+
+class GearMeshBuilder
+{
+  private:
+	// the independent pieces of a gear, all pieces of one kind have the same vertex and index count:
+	enum Features
+	{
+		TOOTH,
+		HOB_STEP,
+		ARM,
+		NUM_FEATURES
+	};
+
+	int		NumTeeth;
+	float	Radius;
+	float	TeethHeight;
+	float	Thickness;
+	int		Arms;
+	bool	Internal;			// a ring gear: the profile bounds the teeth from the outside, there is no hub
+	float	ProfileOffset;		// the teeth start this far above the base circle Radius, 0 but for a ring
+
+	GearTessellation	Tess;
+
+	float	InvoluteStart;		// involute parameter where the profile starts
+	float	InvoluteAlpha;		// involute parameter where the involute reaches the outer radius
+	float	ContactAlpha;		// angular size of the profile's involute around the gear axis
+	float	ThetaBig;			// angular width of the tooth tip
+	float	ThetaSmall;			// angular width of the tooth root
+
+	std::vector<point>	ContactPoints;		// involute of the left contact surface
+	std::vector<point>	SmallCirclePoints;	// tooth root arc
+	std::vector<point>	BigCirclePoints;	// tooth tip arc
+	std::vector<GearFixedProfiles>	FixedLods;	// the compile time profiles of a GearGeometry<>, one per LOD
+	bool				FixedProfiles;		// the profiles are one of FixedLods, MakeProfiles leaves them alone
+
+	point *			VertexOut;		// slice of the output this builder writes to, NULL when only counting
+	unsigned int *	IndexOut;
+	unsigned int	BaseVertex;		// index of VertexOut[0] in the whole mesh
+	int				NumVerticesOut;
+	int				NumIndicesOut;
+	float			Transform[3][3];	// current rotation, applied to every emitted point
+
+	void			AddGridStrips(unsigned int, int, int);
+	void			AddIndex(unsigned int);
+	unsigned int	AddVertex(const point&);
+	void			BeginStrip();
+	void			EmitPoint(const point&);
+	void			LoadIdentity();
+	unsigned int	NextVertex() const;
+	void			RotateX180();
+	void			RotateZ(float);
+	void			SetOutput(point*, unsigned int*, unsigned int);
+
+	void			BuildArm(int);
+	void			BuildFeature(int, int);
+	bool			BuildFeatures(GearMesh&, int, bool, WorkerPool*);
+	void			BuildHobStep(int);
+	void			BuildRingRim();
+	void			BuildSurfaceGrid(point*, int, float);
+	void			BuildTooth(float);
+	void			Init(int, float, float, float, int, const GearAngles&);
+	void			MakeProfiles();
+
+  public:
+		GearMeshBuilder(int, float, float, float, int, int);
+
+		// a gear from a GearGeometry<>, using its compile time angles and, at its LODs, its profiles:
+		template <class Geometry>
+		GearMeshBuilder(const Geometry&, float gThickness, int gArms)
+		{
+			Init(Geometry::NumTeeth, (float)Geometry::Radius, (float)Geometry::TeethHeight, gThickness, gArms, Geometry::Angles);
+			for (int lod = 0; lod < Geometry::NumLods; lod++) {
+				const GearProfileTables<Geometry::MaxSegments>& tables = Geometry::Profiles.Lods[lod];
+				GearFixedProfiles fixed = { tables.Segments, tables.Contact, tables.SmallCircle, tables.BigCircle };
+				FixedLods.push_back(fixed);
+			}
+			SetTessellation(MakeTessellation(Geometry::MaxError));
+		}
+
+	bool	Build(GearMesh&, WorkerPool* = NULL);
+	bool	BuildHub(GearMesh&, WorkerPool* = NULL);
+	bool	BuildToothSector(GearMesh&, WorkerPool* = NULL);
+	float	GetContactAlpha() const;
+	int		GetNumTeeth() const;
+	float	GetThetaBig() const;
+	float	GetThetaSmall() const;
+	GearTessellation	GetTessellation() const;
+	float	GetToothAngle() const;
+	bool	IsInternal() const;
+	bool	IsValid() const;
+	GearTessellation	MakeTessellation(float) const;
+	void	SetInternal(bool, float);
+	void	SetTessellation(const GearTessellation&);
+	void	SetToothShare(float);
+};
+
+void	BenchmarkGearMeshBuilder(int);
+
+#endif		// #ifndef GEARMESH_H
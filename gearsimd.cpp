@@ -0,0 +1,453 @@
+#include "gearsimd.h"
+
+#ifndef _USE_MATH_DEFINES
+#define _USE_MATH_DEFINES
+#endif
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define GEARSIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// gcc and clang only emit AVX2/FMA code in functions that ask for it, msvc takes the intrinsics as they are:
+#if defined(GEARSIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define GEARSIMD_TARGET_SSE2	__attribute__((target("sse2")))
+#define GEARSIMD_TARGET_AVX2	__attribute__((target("avx2,fma")))
+#else
+#define GEARSIMD_TARGET_SSE2
+#define GEARSIMD_TARGET_AVX2
+#endif
+
+// Cephes style sincos: reduce by multiples of pi/2 (Cody-Waite, three parts), then
+// a degree 7 sine and a degree 8 cosine polynomial on [-pi/4, pi/4].
+// Accurate to a few float ulps for the |angle| < 8192 we ever need.
+static const float TWO_OVER_PI = 0.636619772367581343f;
+static const float DP1 = 1.5703125f;
+static const float DP2 = 4.837512969970703125e-4f;
+static const float DP3 = 7.54978995489188216e-8f;
+static const float S1 = -1.6666654611e-1f;
+static const float S2 = 8.3321608736e-3f;
+static const float S3 = -1.9515295891e-4f;
+static const float C1 = 4.166664568298827e-2f;
+static const float C2 = -1.388731625493765e-3f;
+static const float C3 = 2.443315711809948e-5f;
+
+static int	SimdPath = -1;		// -1 until the CPU has been checked
+
+
+void
+FastSinCos(float x, float* sinOut, float* cosOut)
+{
+	float fj = floorf(x * TWO_OVER_PI + 0.5f);
+	int j = (int)fj;
+	float r = ((x - fj * DP1) - fj * DP2) - fj * DP3;
+	float z = r * r;
+	float sinp = r + r * z * (S1 + z * (S2 + z * S3));
+	float cosp = 1.f - 0.5f * z + z * z * (C1 + z * (C2 + z * C3));
+
+	float s = (j & 1) ? cosp : sinp;
+	float c = (j & 1) ? sinp : cosp;
+	*sinOut = (j & 2) ? -s : s;
+	*cosOut = ((j + 1) & 2) ? -c : c;
+}
+
+static void
+SampleInvoluteScalar(float r, float t0, float dt, int first, int count, float* x, float* y, float* nx, float* ny)
+{
+	for (int i = first; i < count; i++) {
+		float t = t0 + (float)i * dt;
+		float s, c;
+		FastSinCos(t, &s, &c);
+		if (x != NULL)	x[i] = r * (c + t * s);
+		if (y != NULL)	y[i] = r * (s - t * c);
+		if (nx != NULL)	nx[i] = s;
+		if (ny != NULL)	ny[i] = -c;
+	}
+}
+
+static void
+SampleArcScalar(float r, float a0, float da, float normalSign, int first, int count, float* x, float* y, float* nx, float* ny)
+{
+	for (int i = first; i < count; i++) {
+		float a = a0 + (float)i * da;
+		float s, c;
+		FastSinCos(a, &s, &c);
+		if (x != NULL)	x[i] = r * c;
+		if (y != NULL)	y[i] = r * s;
+		if (nx != NULL)	nx[i] = normalSign * c;
+		if (ny != NULL)	ny[i] = normalSign * s;
+	}
+}
+
+
+#ifdef GEARSIMD_X86
+
+// 4 lanes of the same sincos:
+GEARSIMD_TARGET_SSE2
+static inline void
+SinCos4(__m128 x, __m128* sinOut, __m128* cosOut)
+{
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i two = _mm_set1_epi32(2);
+
+	__m128i j = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(TWO_OVER_PI)));	// round to nearest
+	__m128 fj = _mm_cvtepi32_ps(j);
+	__m128 r = _mm_sub_ps(x, _mm_mul_ps(fj, _mm_set1_ps(DP1)));
+	r = _mm_sub_ps(r, _mm_mul_ps(fj, _mm_set1_ps(DP2)));
+	r = _mm_sub_ps(r, _mm_mul_ps(fj, _mm_set1_ps(DP3)));
+	__m128 z = _mm_mul_ps(r, r);
+
+	__m128 sinp = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(S3)), _mm_set1_ps(S2));
+	sinp = _mm_add_ps(_mm_mul_ps(z, sinp), _mm_set1_ps(S1));
+	sinp = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, z), sinp));
+
+	__m128 cosp = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(C3)), _mm_set1_ps(C2));
+	cosp = _mm_add_ps(_mm_mul_ps(z, cosp), _mm_set1_ps(C1));
+	cosp = _mm_mul_ps(_mm_mul_ps(z, z), cosp);
+	cosp = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.f), _mm_mul_ps(_mm_set1_ps(0.5f), z)), cosp);
+
+	__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, one), one));
+	__m128 s = _mm_or_ps(_mm_and_ps(swap, cosp), _mm_andnot_ps(swap, sinp));
+	__m128 c = _mm_or_ps(_mm_and_ps(swap, sinp), _mm_andnot_ps(swap, cosp));
+	__m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, two), 30));
+	__m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(j, one), two), 30));
+	*sinOut = _mm_xor_ps(s, sinSign);
+	*cosOut = _mm_xor_ps(c, cosSign);
+}
+
+GEARSIMD_TARGET_SSE2
+static void
+SampleInvoluteSSE2(float r, float t0, float dt, int count, float* x, float* y, float* nx, float* ny)
+{
+	const __m128 lanes = _mm_set_ps(3.f, 2.f, 1.f, 0.f);
+	const __m128 vr = _mm_set1_ps(r);
+	const __m128 signBit = _mm_set1_ps(-0.f);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 t = _mm_add_ps(_mm_set1_ps(t0), _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)i), lanes), _mm_set1_ps(dt)));
+		__m128 s, c;
+		SinCos4(t, &s, &c);
+		if (x != NULL)	_mm_storeu_ps(x + i, _mm_mul_ps(vr, _mm_add_ps(c, _mm_mul_ps(t, s))));
+		if (y != NULL)	_mm_storeu_ps(y + i, _mm_mul_ps(vr, _mm_sub_ps(s, _mm_mul_ps(t, c))));
+		if (nx != NULL)	_mm_storeu_ps(nx + i, s);
+		if (ny != NULL)	_mm_storeu_ps(ny + i, _mm_xor_ps(c, signBit));
+	}
+	SampleInvoluteScalar(r, t0, dt, i, count, x, y, nx, ny);
+}
+
+GEARSIMD_TARGET_SSE2
+static void
+SampleArcSSE2(float r, float a0, float da, float normalSign, int count, float* x, float* y, float* nx, float* ny)
+{
+	const __m128 lanes = _mm_set_ps(3.f, 2.f, 1.f, 0.f);
+	const __m128 vr = _mm_set1_ps(r);
+	const __m128 vn = _mm_set1_ps(normalSign);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 a = _mm_add_ps(_mm_set1_ps(a0), _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)i), lanes), _mm_set1_ps(da)));
+		__m128 s, c;
+		SinCos4(a, &s, &c);
+		if (x != NULL)	_mm_storeu_ps(x + i, _mm_mul_ps(vr, c));
+		if (y != NULL)	_mm_storeu_ps(y + i, _mm_mul_ps(vr, s));
+		if (nx != NULL)	_mm_storeu_ps(nx + i, _mm_mul_ps(vn, c));
+		if (ny != NULL)	_mm_storeu_ps(ny + i, _mm_mul_ps(vn, s));
+	}
+	SampleArcScalar(r, a0, da, normalSign, i, count, x, y, nx, ny);
+}
+
+
+// 8 lanes of the same sincos, with fused multiply-adds:
+GEARSIMD_TARGET_AVX2
+static inline void
+SinCos8(__m256 x, __m256* sinOut, __m256* cosOut)
+{
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i two = _mm256_set1_epi32(2);
+
+	__m256i j = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(TWO_OVER_PI)));	// round to nearest
+	__m256 fj = _mm256_cvtepi32_ps(j);
+	__m256 r = _mm256_fnmadd_ps(fj, _mm256_set1_ps(DP1), x);
+	r = _mm256_fnmadd_ps(fj, _mm256_set1_ps(DP2), r);
+	r = _mm256_fnmadd_ps(fj, _mm256_set1_ps(DP3), r);
+	__m256 z = _mm256_mul_ps(r, r);
+
+	__m256 sinp = _mm256_fmadd_ps(z, _mm256_set1_ps(S3), _mm256_set1_ps(S2));
+	sinp = _mm256_fmadd_ps(z, sinp, _mm256_set1_ps(S1));
+	sinp = _mm256_fmadd_ps(_mm256_mul_ps(r, z), sinp, r);
+
+	__m256 cosp = _mm256_fmadd_ps(z, _mm256_set1_ps(C3), _mm256_set1_ps(C2));
+	cosp = _mm256_fmadd_ps(z, cosp, _mm256_set1_ps(C1));
+	cosp = _mm256_fmadd_ps(_mm256_mul_ps(z, z), cosp, _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, _mm256_set1_ps(1.f)));
+
+	__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, one), one));
+	__m256 s = _mm256_blendv_ps(sinp, cosp, swap);
+	__m256 c = _mm256_blendv_ps(cosp, sinp, swap);
+	__m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, two), 30));
+	__m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(j, one), two), 30));
+	*sinOut = _mm256_xor_ps(s, sinSign);
+	*cosOut = _mm256_xor_ps(c, cosSign);
+}
+
+GEARSIMD_TARGET_AVX2
+static void
+SampleInvoluteAVX2(float r, float t0, float dt, int count, float* x, float* y, float* nx, float* ny)
+{
+	const __m256 lanes = _mm256_set_ps(7.f, 6.f, 5.f, 4.f, 3.f, 2.f, 1.f, 0.f);
+	const __m256 vr = _mm256_set1_ps(r);
+	const __m256 signBit = _mm256_set1_ps(-0.f);
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 t = _mm256_add_ps(_mm256_set1_ps(t0), _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps((float)i), lanes), _mm256_set1_ps(dt)));
+		__m256 s, c;
+		SinCos8(t, &s, &c);
+		if (x != NULL)	_mm256_storeu_ps(x + i, _mm256_mul_ps(vr, _mm256_fmadd_ps(t, s, c)));
+		if (y != NULL)	_mm256_storeu_ps(y + i, _mm256_mul_ps(vr, _mm256_fnmadd_ps(t, c, s)));
+		if (nx != NULL)	_mm256_storeu_ps(nx + i, s);
+		if (ny != NULL)	_mm256_storeu_ps(ny + i, _mm256_xor_ps(c, signBit));
+	}
+	SampleInvoluteScalar(r, t0, dt, i, count, x, y, nx, ny);
+}
+
+GEARSIMD_TARGET_AVX2
+static void
+SampleArcAVX2(float r, float a0, float da, float normalSign, int count, float* x, float* y, float* nx, float* ny)
+{
+	const __m256 lanes = _mm256_set_ps(7.f, 6.f, 5.f, 4.f, 3.f, 2.f, 1.f, 0.f);
+	const __m256 vr = _mm256_set1_ps(r);
+	const __m256 vn = _mm256_set1_ps(normalSign);
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 a = _mm256_add_ps(_mm256_set1_ps(a0), _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps((float)i), lanes), _mm256_set1_ps(da)));
+		__m256 s, c;
+		SinCos8(a, &s, &c);
+		if (x != NULL)	_mm256_storeu_ps(x + i, _mm256_mul_ps(vr, c));
+		if (y != NULL)	_mm256_storeu_ps(y + i, _mm256_mul_ps(vr, s));
+		if (nx != NULL)	_mm256_storeu_ps(nx + i, _mm256_mul_ps(vn, c));
+		if (ny != NULL)	_mm256_storeu_ps(ny + i, _mm256_mul_ps(vn, s));
+	}
+	SampleArcScalar(r, a0, da, normalSign, i, count, x, y, nx, ny);
+}
+
+#endif		// #ifdef GEARSIMD_X86
+
+
+bool
+IsGearSimdPathSupported(int path)
+{
+	switch (path) {
+	case SIMD_SCALAR:
+		return true;
+
+#ifdef GEARSIMD_X86
+#ifdef _MSC_VER
+	case SIMD_SSE2:
+	{
+		int info[4];
+		__cpuid(info, 1);
+		return (info[3] & (1 << 26)) != 0;
+	}
+
+	case SIMD_AVX2:
+	{
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+		__cpuid(info, 1);
+		bool fma = (info[2] & (1 << 12)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!fma || !osxsave || !avx || (_xgetbv(0) & 6) != 6)	// the OS must save the ymm registers
+			return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+	}
+#else
+	case SIMD_SSE2:
+		return __builtin_cpu_supports("sse2");
+
+	case SIMD_AVX2:
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+#endif
+
+	default:
+		return false;
+	}
+}
+
+int
+GetGearSimdPath()
+{
+	if (SimdPath < 0) {
+		SimdPath = SIMD_SCALAR;
+		for (int path = NUM_SIMD_PATHS - 1; path > SIMD_SCALAR; path--) {
+			if (IsGearSimdPathSupported(path)) {
+				SimdPath = path;
+				break;
+			}
+		}
+	}
+	return SimdPath;
+}
+
+const char*
+GetGearSimdPathName(int path)
+{
+	switch (path) {
+	case SIMD_SSE2:		return "sse2";
+	case SIMD_AVX2:		return "avx2";
+	default:			return "scalar";
+	}
+}
+
+// forces one path, mainly for comparing them -- unsupported paths are ignored:
+void
+SetGearSimdPath(int path)
+{
+	if (IsGearSimdPathSupported(path)) {
+		SimdPath = path;
+	}
+}
+
+void
+SampleInvolute(float r, float t0, float dt, int count, float* x, float* y, float* nx, float* ny)
+{
+	switch (GetGearSimdPath()) {
+#ifdef GEARSIMD_X86
+	case SIMD_AVX2:
+		SampleInvoluteAVX2(r, t0, dt, count, x, y, nx, ny);
+		break;
+	case SIMD_SSE2:
+		SampleInvoluteSSE2(r, t0, dt, count, x, y, nx, ny);
+		break;
+#endif
+	default:
+		SampleInvoluteScalar(r, t0, dt, 0, count, x, y, nx, ny);
+	}
+}
+
+void
+SampleArc(float r, float a0, float da, float normalSign, int count, float* x, float* y, float* nx, float* ny)
+{
+	switch (GetGearSimdPath()) {
+#ifdef GEARSIMD_X86
+	case SIMD_AVX2:
+		SampleArcAVX2(r, a0, da, normalSign, count, x, y, nx, ny);
+		break;
+	case SIMD_SSE2:
+		SampleArcSSE2(r, a0, da, normalSign, count, x, y, nx, ny);
+		break;
+#endif
+	default:
+		SampleArcScalar(r, a0, da, normalSign, 0, count, x, y, nx, ny);
+	}
+}
+
+
+// Accuracy and throughput of every supported path, against the libm code the builder used before.
+// Accuracy is checked over the angle ranges the gears use (involute parameter up to pi/2, full circles)
+// plus a wide range to exercise the argument reduction.
+void
+BenchmarkGearSimd()
+{
+	const int N = 1 << 16;
+	const int REPEATS = 200;
+	const float TOLERANCE = 2.e-6f;		// relative to the radius, a few float ulps
+
+	std::vector<float> x(N), y(N), nx(N), ny(N);
+	int savedPath = GetGearSimdPath();
+
+	struct AccuracyCase
+	{
+		const char *	name;
+		bool			involute;
+		float			r, a0, a1;
+	};
+	AccuracyCase cases[] =
+	{
+		{ "involute, t in [0, pi/2]", true, 10.f, 0.f, (float)M_PI / 2 },
+		{ "arc, a in [-pi, pi]", false, 22.f, -(float)M_PI, (float)M_PI },
+		{ "arc, a in [-1024, 1024]", false, 1.f, -1024.f, 1024.f },	// exact steps, so only the reduction is tested
+	};
+
+	bool allPassed = true;
+	for (int path = 0; path < NUM_SIMD_PATHS; path++) {
+		if (!IsGearSimdPathSupported(path)) {
+			fprintf(stderr, "%-6s: not supported by this CPU\n", GetGearSimdPathName(path));
+			continue;
+		}
+		SetGearSimdPath(path);
+
+		for (size_t c = 0; c < sizeof(cases) / sizeof(AccuracyCase); c++) {
+			AccuracyCase& ac = cases[c];
+			float d = (ac.a1 - ac.a0) / N;
+			if (ac.involute)
+				SampleInvolute(ac.r, ac.a0, d, N, &x[0], &y[0], &nx[0], &ny[0]);
+			else
+				SampleArc(ac.r, ac.a0, d, 1.f, N, &x[0], &y[0], &nx[0], &ny[0]);
+
+			double maxPos = 0., maxNorm = 0.;
+			for (int i = 0; i < N; i++) {
+				double t = (double)(ac.a0 + (float)i * d);
+				double ex = ac.involute ? ac.r * (cos(t) + t * sin(t)) : ac.r * cos(t);
+				double ey = ac.involute ? ac.r * (sin(t) - t * cos(t)) : ac.r * sin(t);
+				double enx = ac.involute ? sin(t) : cos(t);
+				double eny = ac.involute ? -cos(t) : sin(t);
+				maxPos = fmax(maxPos, fmax(fabs(x[i] - ex), fabs(y[i] - ey)) / ac.r);
+				maxNorm = fmax(maxNorm, fmax(fabs(nx[i] - enx), fabs(ny[i] - eny)));
+			}
+			bool passed = maxPos < TOLERANCE && maxNorm < TOLERANCE;
+			allPassed = allPassed && passed;
+			fprintf(stderr, "%-6s: %-26s max error: position %.2e, normal %.2e  %s\n",
+				GetGearSimdPathName(path), ac.name, maxPos, maxNorm, passed ? "ok" : "FAILED");
+		}
+	}
+
+	// throughput, libm first:
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int r = 0; r < REPEATS; r++) {
+		for (int i = 0; i < N; i++) {
+			float t = (float)i * (1.5f / N);
+			x[i] = 10.f * (cos(t) + t * sin(t));
+			y[i] = 10.f * (sin(t) - t * cos(t));
+			nx[i] = sin(t);
+			ny[i] = -cos(t);
+		}
+	}
+	std::chrono::duration<double> libmSeconds = std::chrono::steady_clock::now() - start;
+	double libmRate = (double)N * REPEATS / libmSeconds.count() / 1.e6;
+	fprintf(stderr, "libm  : involute %8.1f Mpoints/s\n", libmRate);
+
+	for (int path = 0; path < NUM_SIMD_PATHS; path++) {
+		if (!IsGearSimdPathSupported(path))
+			continue;
+		SetGearSimdPath(path);
+
+		start = std::chrono::steady_clock::now();
+		for (int r = 0; r < REPEATS; r++)
+			SampleInvolute(10.f, 0.f, 1.5f / N, N, &x[0], &y[0], &nx[0], &ny[0]);
+		std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+		double rate = (double)N * REPEATS / seconds.count() / 1.e6;
+
+		start = std::chrono::steady_clock::now();
+		for (int r = 0; r < REPEATS; r++)
+			SampleArc(10.f, 0.f, 2.f * (float)M_PI / N, 1.f, N, &x[0], &y[0], &nx[0], &ny[0]);
+		seconds = std::chrono::steady_clock::now() - start;
+		double arcRate = (double)N * REPEATS / seconds.count() / 1.e6;
+
+		fprintf(stderr, "%-6s: involute %8.1f Mpoints/s (x%.1f vs libm), arc %8.1f Mpoints/s\n",
+			GetGearSimdPathName(path), rate, rate / libmRate, arcRate);
+	}
+
+	SetGearSimdPath(savedPath);
+	fprintf(stderr, "Accuracy: %s, using the %s path\n", allPassed ? "all paths ok" : "FAILED", GetGearSimdPathName(savedPath));
+}
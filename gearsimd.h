@@ -0,0 +1,38 @@
+#ifndef GEARSIMD_H
+#define GEARSIMD_H
+
+// Batched sampling of the gear profile curves.
+// Every kernel evaluates a whole array of involute or arc points (position plus unit normal) in one pass.
+// Sine and cosine come from one polynomial sincos, so each angle is reduced once and
+// its sine and cosine share the work.
+//
+// There are AVX2 (8 lanes) and SSE2 (4 lanes) paths and a scalar fallback with the same polynomial.
+// The best path the CPU supports is picked at run time.
+// Results are written as structure of arrays, any of the output pointers may be NULL.
+
+enum GearSimdPaths
+{
+	SIMD_SCALAR,
+	SIMD_SSE2,
+	SIMD_AVX2,
+	NUM_SIMD_PATHS
+};
+
+int			GetGearSimdPath();
+const char*	GetGearSimdPathName(int);
+bool		IsGearSimdPathSupported(int);
+void		SetGearSimdPath(int);
+
+// sine and cosine of one angle with the same polynomial the kernels use:
+void	FastSinCos(float, float*, float*);
+
+// involute of the base circle radius r at the parameters t = t0 + i * dt:
+//	x = r * (cos t + t sin t),  y = r * (sin t - t cos t),  normal = (sin t, -cos t)
+void	SampleInvolute(float r, float t0, float dt, int count, float* x, float* y, float* nx, float* ny);
+
+// arc of radius r at the angles a = a0 + i * da, the normal is (cos a, sin a) times normalSign:
+void	SampleArc(float r, float a0, float da, float normalSign, int count, float* x, float* y, float* nx, float* ny);
+
+void	BenchmarkGearSimd();
+
+#endif		// #ifndef GEARSIMD_H
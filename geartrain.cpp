@@ -0,0 +1,386 @@
+#include "geartrain.h"
+#include "gearmesh.h"
+
+// the phase of a gear taken to the nearest multiple of its tooth pitch, which looks the same:
+static double
+NearestPitch(double phase, int numTeeth)
+{
+	double pitch = 2. * M_PI / numTeeth;
+	return phase - pitch * floor(phase / pitch + 0.5);
+}
+
+// A gear's root arc, a gap, is centered at angle 0 and its teeth repeat every 2 pi / N.
+// Gear i meshes with its parent p at direction b, where it faces the parent with its own angle b + pi.
+// Rolling keeps Np (b - angle_p) + Ni (b + pi - angle_i) the same, and the gears fit when that is
+// pi (mod 2 pi): a gap of one faces a tooth of the other. So
+//	angle_i = -(Np / Ni) angle_p + (Np / Ni) b + b + pi - pi / Ni,
+// taken to the nearest multiple of a tooth pitch, which leaves gear 2 of the original transmission at angle 0.
+// Its teeth are fitted to the parent's by FitGearMesh( ), which also says how far apart they go. Facing a tooth
+// with a gap splits the backlash between both sides of the tooth, so a gear with backlash is turned back
+// by half of it, against the way it turns, and the flanks that drive it touch.
+// Gears that do not mesh with a parent, the driver, gears on a shaft and suns, keep their standard teeth.
+// Gear 1 is placed at driverCenter, and everything else from it.
+void
+GearTrain::Build(const GearTrainConfig& config, const Vec3& driverCenter)
+{
+	int numGears = config.GetNumGears();
+	Params.resize(numGears);
+	Links.resize(numGears);
+	Ratios.resize(numGears);
+	Phases.resize(numGears);
+	Centers.resize(numGears);
+	Angles.assign(numGears, 0.f);
+	Transforms.resize(numGears);
+
+	Orbit fixedAxis = { -1, 0.f, 0. };
+	Orbits.assign(numGears, fixedAxis);
+	Drivers.assign(numGears, -1);
+	Instances.assign(numGears, 1);
+	for (int i = 0; i < numGears; i++) {
+		Params[i] = config.GetGear(i);
+		Links[i] = config.GetLink(i);
+	}
+
+	for (int i = 0; i < numGears; i++) {
+		const LinkedGear& link = Links[i];
+		if (link.Link == GEAR_DRIVER) {
+			Ratios[i] = 1.;
+			Phases[i] = 0.;
+			Centers[i] = driverCenter;
+			continue;
+		}
+
+		// all members of a planetary set at once, from its sun:
+		if (link.Link == GEAR_SUN) {
+			const PlanetarySet& set = config.Planetaries[link.Set];
+			BuildPlanetary(set, config.Backlash);
+			i += 2 + set.NumPlanets;
+			continue;
+		}
+
+		int p = link.Parent;
+		if (link.Link == GEAR_SHAFT) {
+			Ratios[i] = Ratios[p];
+			Phases[i] = Phases[p];
+			Centers[i] = Centers[p] + Vec3(0.f, 0.f, link.Placement);
+			continue;
+		}
+
+		GearMeshFit fit = FitGearMesh(Params[p].NumTeeth, Params[p].Radius, Params[p].ToothShare,
+			Params[i].NumTeeth, Params[i].Radius, Params[i].TeethHeight, config.Backlash);
+		Params[i].ToothShare = (float)fit.ToothShare;
+		Drivers[i] = p;
+
+		double direction = link.Placement * M_PI / 180.;
+		double teeth = (double)Params[p].NumTeeth / Params[i].NumTeeth;
+		Ratios[i] = -teeth * Ratios[p];
+		double phase = -teeth * Phases[p] + teeth * direction + direction + M_PI - M_PI / Params[i].NumTeeth;
+		double lag = fit.Backlash / (2. * Params[i].Radius);
+		Phases[i] = NearestPitch(Ratios[i] < 0. ? phase + lag : phase - lag, Params[i].NumTeeth);
+		float distance = (float)fit.CenterDistance;
+		Centers[i] = Centers[p] + Vec3(distance * (float)cos(direction), distance * (float)sin(direction), 0.f);
+	}
+}
+
+// The Willis equation Ns (sun - carrier) = -Nr (ring - carrier) holds for the speeds, and so for the angles,
+// as Ns sun + Nr ring - (Ns + Nr) carrier = 0: the input member turns with the parent's shaft,
+// the fixed one not at all, and the third one follows.
+// Seen from the carrier the planets are gears on fixed axes, planet k at direction b_k meshes with the sun
+// as in Build( ). The ring's teeth are centered at angle 0, it fits planet k when
+// Nr (b_k - ring) = Np (b_k - planet) (mod 2 pi), all relative to the carrier. With planet 0 at b = 0 that is
+//	Nr ring + Ns sun = Np (pi - pi / Np) (mod 2 pi),
+// which gives the ring's phase from the sun's, or the sun's from the ring's when the ring is the input.
+// The other planets fit too at the directions of PlanetarySet::GetPlanetDirection( ).
+// The planets' teeth are fitted to the sun's, and when that moves them out, the ring's teeth move out with
+// their orbit, on the same base circle. The ring's teeth are fitted to the planets' by FitRingMesh( ), with the
+// same backlash: its line of action is tilted like the sun's.
+// Seen from the carrier, the member that delivers the power drives the planets and they drive the other one:
+// the input, or the fixed member when the carrier is the input. Like a driven gear in Build( ), the planets and
+// the other member are turned back by half their backlash against the way they turn, so the driving flanks touch.
+// A member moved after the planets first moves with them, to stay centered on them:
+// the ring by Np / Nr of the planets' turn, the sun by -Np / Ns.
+void
+GearTrain::BuildPlanetary(const PlanetarySet& set, float backlash)
+{
+	int members[3];
+	members[PLANETARY_SUN] = set.FirstGear;
+	members[PLANETARY_RING] = set.FirstGear + 1;
+	members[PLANETARY_CARRIER] = set.FirstGear + 2;
+	double ns = set.SunTeeth;
+	double nr = set.GetRingTeeth();
+	double np = set.PlanetTeeth;
+	double coefficients[3] = { ns, nr, -(ns + nr) };
+
+	double ratios[3] = { 0., 0., 0. };
+	double phases[3] = { 0., 0., 0. };
+	int third = PLANETARY_SUN + PLANETARY_RING + PLANETARY_CARRIER - set.Input - set.Fixed;
+	ratios[set.Input] = Ratios[set.Parent];
+	phases[set.Input] = Phases[set.Parent];
+	ratios[third] = -coefficients[set.Input] * ratios[set.Input] / coefficients[third];
+
+	double carrier = phases[PLANETARY_CARRIER];
+	double mesh = np * M_PI - M_PI;
+	if (set.Input == PLANETARY_RING) {
+		double sun = (mesh - nr * (phases[PLANETARY_RING] - carrier)) / ns;
+		phases[PLANETARY_SUN] = NearestPitch(carrier + sun, set.SunTeeth);
+	}
+	else {
+		double ring = (mesh - ns * (phases[PLANETARY_SUN] - carrier)) / nr;
+		phases[PLANETARY_RING] = NearestPitch(carrier + ring, set.GetRingTeeth());
+	}
+
+	// the planets turn against the sun as seen from the carrier:
+	const GearParams& sunParams = Params[members[PLANETARY_SUN]];
+	const GearParams& planetParams = Params[set.FirstGear + 3];
+	GearMeshFit fit = FitGearMesh(sunParams.NumTeeth, sunParams.Radius, sunParams.ToothShare,
+		planetParams.NumTeeth, planetParams.Radius, planetParams.TeethHeight, backlash);
+	float orbit = (float)fit.CenterDistance;
+	GearParams& ringParams = Params[members[PLANETARY_RING]];
+	GearRingFit ringFit = FitRingMesh(planetParams.NumTeeth, planetParams.Radius, fit.ToothShare,
+		ringParams.NumTeeth, ringParams.Radius, ringParams.TeethHeight, orbit, backlash);
+	ringParams.ToothShare = (float)ringFit.ToothShare;
+	ringParams.ProfileOffset = (float)ringFit.ProfileOffset;
+
+	// the lags, from the speeds seen from the carrier, with the planets placed from the sun as it was:
+	double sun = phases[PLANETARY_SUN] - carrier;
+	double planetRatio = ratios[PLANETARY_CARRIER] - ns / np * (ratios[PLANETARY_SUN] - ratios[PLANETARY_CARRIER]);
+	double planetRate = planetRatio - ratios[PLANETARY_CARRIER];
+	double sunRate = ratios[PLANETARY_SUN] - ratios[PLANETARY_CARRIER];
+	double ringRate = ratios[PLANETARY_RING] - ratios[PLANETARY_CARRIER];
+	int source = set.Input == PLANETARY_CARRIER ? set.Fixed : set.Input;
+	double planetShift;
+	if (source == PLANETARY_SUN) {
+		double lag = fit.Backlash / (2. * planetParams.Radius);
+		planetShift = planetRate < 0. ? lag : -lag;
+		lag = ringFit.Backlash / (2. * ringParams.Radius);
+		phases[PLANETARY_RING] += np / nr * planetShift + (ringRate < 0. ? lag : -lag);
+		phases[PLANETARY_RING] = NearestPitch(phases[PLANETARY_RING], set.GetRingTeeth());
+	}
+	else {
+		double lag = ringFit.Backlash / (2. * planetParams.Radius);
+		planetShift = planetRate < 0. ? lag : -lag;
+		lag = fit.Backlash / (2. * sunParams.Radius);
+		phases[PLANETARY_SUN] += -np / ns * planetShift + (sunRate < 0. ? lag : -lag);
+	}
+
+	Vec3 center = Centers[set.Parent] + Vec3(0.f, 0.f, set.Offset);
+	for (int m = PLANETARY_SUN; m <= PLANETARY_CARRIER; m++) {
+		Ratios[members[m]] = ratios[m];
+		Phases[members[m]] = phases[m];
+		Centers[members[m]] = center;
+	}
+	Instances[members[PLANETARY_CARRIER]] = 0;
+
+	for (int k = 0; k < set.NumPlanets; k++) {
+		int planet = set.FirstGear + 3 + k;
+		Params[planet].ToothShare = (float)fit.ToothShare;
+		Drivers[planet] = members[source];
+		double direction = set.GetPlanetDirection(k);
+		Ratios[planet] = planetRatio;
+		double phase = carrier - ns / np * sun + ns / np * direction + direction + M_PI - M_PI / np;
+		Phases[planet] = NearestPitch(phase + planetShift, set.PlanetTeeth);
+		Centers[planet] = center;
+		Orbit planetOrbit = { members[PLANETARY_CARRIER], orbit, direction };
+		Orbits[planet] = planetOrbit;
+		Instances[planet] = (k == 0) ? set.NumPlanets : 0;
+	}
+}
+
+float
+GearTrain::GetAngle(int gear) const
+{
+	return Angles[gear];
+}
+
+const Vec3&
+GearTrain::GetCenter(int gear) const
+{
+	return Centers[gear];
+}
+
+// the gear whose driving flanks turn the gear, seen from the carrier for a planet: the parent of a meshing gear,
+// the sun or the ring of a planet, which drives the other one in turn; -1 for gears that do not mesh with a driver
+int
+GearTrain::GetDriver(int gear) const
+{
+	return Drivers[gear];
+}
+
+const LinkedGear&
+GearTrain::GetLink(int gear) const
+{
+	return Links[gear];
+}
+
+int
+GearTrain::GetNumGears() const
+{
+	return (int)Params.size();
+}
+
+// the planets of a set are drawn together, as instances of the first one: it has NumPlanets instances
+// and the others none, like the carrier, which has nothing to draw; every other gear has one,
+// and the transforms of a gear's instances follow each other
+int
+GearTrain::GetNumInstances(int gear) const
+{
+	return Instances[gear];
+}
+
+const GearParams&
+GearTrain::GetParams(int gear) const
+{
+	return Params[gear];
+}
+
+double
+GearTrain::GetRatio(int gear) const
+{
+	return Ratios[gear];
+}
+
+// the model matrices of all gears, GetNumGears( ) of them:
+const Matrix4*
+GearTrain::GetTransforms() const
+{
+	return Transforms.empty() ? NULL : &Transforms[0];
+}
+
+// turns the driver to driverAngle radians and everything else with it:
+// a rotation about z and the translation to the center, written straight into the matrix
+// (a planet's carrier comes before it, so its center is moved from the carrier's angle)
+void
+GearTrain::Update(double driverAngle)
+{
+	int numGears = (int)Params.size();
+	for (int i = 0; i < numGears; i++) {
+		double angle = fmod(Ratios[i] * driverAngle + Phases[i], 2. * M_PI);
+		Angles[i] = (float)angle;
+
+		const Orbit& orbit = Orbits[i];
+		if (orbit.Carrier >= 0) {
+			double around = Ratios[orbit.Carrier] * driverAngle + Phases[orbit.Carrier] + orbit.Direction;
+			Centers[i] = Centers[orbit.Carrier] + Vec3(orbit.Radius * (float)cos(around), orbit.Radius * (float)sin(around), 0.f);
+		}
+
+		float c = (float)cos(angle);
+		float s = (float)sin(angle);
+		Matrix4& m = Transforms[i];
+		m = Matrix4();
+		m.M[0] = c;		m.M[4] = -s;
+		m.M[1] = s;		m.M[5] = c;
+		m.M[12] = Centers[i].x;
+		m.M[13] = Centers[i].y;
+		m.M[14] = Centers[i].z;
+	}
+}
+
+
+// Is the point in the metal of the gear, in its teeth or inside them? The arms and holes are left out.
+// thickness is the angle of a tooth, or of a ring's space, on its base circle.
+static bool
+IsInsideGear(const GearParams& params, double thickness, const Vec3& center, float angle, double x, double y)
+{
+	double dx = x - center.x;
+	double dy = y - center.y;
+	double r = sqrt(dx * dx + dy * dy);
+	double inner = params.Radius + params.ProfileOffset;
+	double outer = inner + params.TeethHeight;
+	if (r <= inner || r >= outer) {
+		return (r <= inner) != params.Internal;
+	}
+
+	// how far from the middle of the nearest tooth, against half its thickness at r:
+	double pitch = 2. * M_PI / params.NumTeeth;
+	double a = atan2(dy, dx) - angle - pitch / 2.;
+	a -= pitch * floor(a / pitch + 0.5);
+	double t = sqrt(r * r / (params.Radius * params.Radius) - 1.);
+	return (fabs(a) <= thickness / 2. - (t - atan(t))) != params.Internal;
+}
+
+// the area both gears' metal takes, on a grid of step across the box that both of them reach:
+static double
+GetOverlapArea(const GearTrain& train, int first, int second, const double thickness[2], double step)
+{
+	int gears[2] = { first, second };
+	double box[4] = { -HUGE_VAL, -HUGE_VAL, HUGE_VAL, HUGE_VAL };
+	for (int k = 0; k < 2; k++) {
+		const GearParams& params = train.GetParams(gears[k]);
+		if (params.Internal) {
+			continue;
+		}
+		const Vec3& c = train.GetCenter(gears[k]);
+		double reach = params.Radius + params.TeethHeight;
+		box[0] = fmax(box[0], c.x - reach);
+		box[1] = fmax(box[1], c.y - reach);
+		box[2] = fmin(box[2], c.x + reach);
+		box[3] = fmin(box[3], c.y + reach);
+	}
+
+	int count = 0;
+	for (double y = box[1] + step / 2.; y < box[3]; y += step) {
+		for (double x = box[0] + step / 2.; x < box[2]; x += step) {
+			if (IsInsideGear(train.GetParams(first), thickness[0], train.GetCenter(first), train.GetAngle(first), x, y) &&
+				IsInsideGear(train.GetParams(second), thickness[1], train.GetCenter(second), train.GetAngle(second), x, y)) {
+				count++;
+			}
+		}
+	}
+	return count * step * step;
+}
+
+// Turns the train through one turn of gear 1 in frames steps, and measures how much of the metal of every
+// meshing pair overlaps, a planet with its sun and with its ring too. Gears that mesh right only touch:
+// false when any pair overlaps.
+bool
+CheckGearTrain(const GearTrainConfig& config, int frames)
+{
+	GearTrain train;
+	train.Build(config, Vec3(0.f, 0.f, 0.f));
+
+	std::vector<int> firsts, seconds;
+	for (int gear = 0; gear < train.GetNumGears(); gear++) {
+		const LinkedGear& link = train.GetLink(gear);
+		if (link.Link == GEAR_MESH) {
+			firsts.push_back(link.Parent);
+			seconds.push_back(gear);
+		}
+		else if (link.Link == GEAR_PLANET) {
+			int sun = config.Planetaries[link.Set].FirstGear;
+			firsts.push_back(sun);
+			seconds.push_back(gear);
+			firsts.push_back(sun + 1);
+			seconds.push_back(gear);
+		}
+	}
+
+	int numPairs = (int)firsts.size();
+	std::vector<double> thickness(2 * numPairs), maxOverlap(numPairs, 0.);
+	std::vector<int> overlapping(numPairs, 0);
+	for (int i = 0; i < numPairs; i++) {
+		int gears[2] = { firsts[i], seconds[i] };
+		for (int k = 0; k < 2; k++) {
+			const GearParams& params = train.GetParams(gears[k]);
+			thickness[2 * i + k] = GetBaseThickness(params.NumTeeth, params.Radius, params.TeethHeight, params.ToothShare, params.ProfileOffset);
+		}
+	}
+	double step = config.TeethHeight / 50.;
+	for (int frame = 0; frame < frames; frame++) {
+		train.Update(2. * M_PI * frame / frames);
+		for (int i = 0; i < numPairs; i++) {
+			double area = GetOverlapArea(train, firsts[i], seconds[i], &thickness[2 * i], step);
+			if (area > 0.) {
+				overlapping[i]++;
+			}
+			maxOverlap[i] = fmax(maxOverlap[i], area);
+		}
+	}
+
+	bool ok = true;
+	for (int i = 0; i < numPairs; i++) {
+		fprintf(stderr, "gear %d - gear %d%s: overlap in %d of %d frames, %.4f units^2 at most\n", firsts[i] + 1, seconds[i] + 1,
+			train.GetParams(firsts[i]).Internal ? " (ring)" : "", overlapping[i], frames, maxOverlap[i]);
+		ok = ok && overlapping[i] == 0;
+	}
+	return ok;
+}
@@ -0,0 +1,63 @@
+#ifndef GEARTRAIN_H
+#define GEARTRAIN_H
+
+// The kinematics of a train of spur gears on parallel shafts, all along z.
+// The train is a tree: gear 1 is driven, every other gear meshes with an earlier gear or sits on its shaft.
+// Build( ) walks the links once, parents before children, and leaves every gear with a center and an angle
+// that is linear in the driver's angle, Ratio * driver + Phase. A meshing gear turns the other way by the
+// ratio of the teeth, and its phase puts one of its gaps where its parent has a tooth; its teeth are fitted
+// to its parent's for the backlash of the config. A gear on a shaft turns with it. A planetary set is solved as a whole, from the Willis equation, and its planets go around
+// with the carrier, so their centers move too.
+// Update( ) only evaluates that line for every gear into flat arrays of angles and model matrices,
+// in gear order, which the renderer reads as they are.
+
+#include <vector>
+
+#include "gearconfig.h"
+#include "matrix4.h"
+
+class GearTrain
+{
+  private:
+	// the circle a planet goes around on with its carrier:
+	struct Orbit
+	{
+		int		Carrier;		// -1 for a gear on a fixed axis
+		float	Radius;
+		double	Direction;		// radians from the carrier's angle
+	};
+
+	std::vector<GearParams>	Params;
+	std::vector<LinkedGear>	Links;
+
+	// from Build( ):
+	std::vector<double>		Ratios;		// turns per turn of the driver
+	std::vector<double>		Phases;		// radians at driver angle 0
+	std::vector<Vec3>		Centers;	// Update( ) moves the planets'
+	std::vector<Orbit>		Orbits;
+	std::vector<int>		Drivers;	// see GetDriver( )
+	std::vector<int>		Instances;	// see GetNumInstances( )
+
+	// from Update( ):
+	std::vector<float>		Angles;		// radians
+	std::vector<Matrix4>	Transforms;	// model matrices
+
+	void				BuildPlanetary(const PlanetarySet&, float);
+
+  public:
+	void				Build(const GearTrainConfig&, const Vec3&);
+	float				GetAngle(int) const;
+	const Vec3&			GetCenter(int) const;
+	int					GetDriver(int) const;
+	const LinkedGear&	GetLink(int) const;
+	int					GetNumGears() const;
+	int					GetNumInstances(int) const;
+	const GearParams&	GetParams(int) const;
+	double				GetRatio(int) const;
+	const Matrix4*		GetTransforms() const;
+	void				Update(double);
+};
+
+bool	CheckGearTrain(const GearTrainConfig&, int);
+
+#endif		// #ifndef GEARTRAIN_H
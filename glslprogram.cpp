@@ -1,4 +1,5 @@
 #include "glslprogram.h"
+#include <algorithm>
 
 #define NVIDIA_SHADER_BINARY	0x00008e21		// nvidia binary enum
 
@@ -53,19 +54,36 @@ GetExtension( char *file )
 }
 
 
+// the context version as 10 * major + minor, 33 for OpenGL 3.3:
+
+static int
+GetGLVersion( )
+{
+	int major = 0, minor = 0;
+	const char *version = (const char *) glGetString( GL_VERSION );
+	if( version != NULL )
+		sscanf( version, "%d.%d", &major, &minor );
+	return 10 * major + minor;
+}
+
+
 GLSLProgram::GLSLProgram( )
 {
 	Verbose = false;
+	CacheFile = NULL;
 	InputTopology  = GL_TRIANGLES;
 	OutputTopology = GL_TRIANGLE_STRIP;
 
-	CanDoComputeShaders      = IsExtensionSupported( "GL_ARB_compute_shader" );
-	CanDoVertexShaders      = IsExtensionSupported( "GL_ARB_vertex_shader" );
-	CanDoTessControlShaders = IsExtensionSupported( "GL_ARB_tessellation_shader" );
+	// what became core OpenGL does not have to be in the extension list any more,
+	// a core profile context does not list the shader stages at all:
+	int glVersion = GetGLVersion( );
+	CanDoComputeShaders      = glVersion >= 43  ||  IsExtensionSupported( "GL_ARB_compute_shader" );
+	CanDoVertexShaders      = glVersion >= 20  ||  IsExtensionSupported( "GL_ARB_vertex_shader" );
+	CanDoTessControlShaders = glVersion >= 40  ||  IsExtensionSupported( "GL_ARB_tessellation_shader" );
 	CanDoTessEvaluationShaders = CanDoTessControlShaders;
-	CanDoGeometryShaders    = IsExtensionSupported( "GL_EXT_geometry_shader4" );
-	CanDoFragmentShaders    = IsExtensionSupported( "GL_ARB_fragment_shader" );
-	CanDoBinaryFiles        = IsExtensionSupported( "GL_ARB_get_program_binary" );
+	CanDoGeometryShaders    = glVersion >= 32  ||  IsExtensionSupported( "GL_EXT_geometry_shader4" );
+	CanDoFragmentShaders    = glVersion >= 20  ||  IsExtensionSupported( "GL_ARB_fragment_shader" );
+	CanDoBinaryFiles        = glVersion >= 41  ||  IsExtensionSupported( "GL_ARB_get_program_binary" );
 
 	fprintf( stderr, "Can do: " );
 	if( CanDoComputeShaders )		fprintf( stderr, "compute shaders, " );
@@ -104,7 +122,7 @@ GLSLProgram::CreateHelper( char *file0, ... )
 	Cshader = Vshader = TCshader = TEshader = Gshader = Fshader = 0;
 	Program = 0;
 	AttributeLocs.clear();
-	UniformLocs.clear();
+	Uniforms.clear();
 
 	if( Program == 0 )
 	{
@@ -120,10 +138,29 @@ GLSLProgram::CreateHelper( char *file0, ... )
 	// I am depending on the caller passing in a NULL as the final argument.
 	// If they don't, bad things will happen.
 
-	char *file = file0;
+	std::vector<char *> files;
+	for( char *file = file0; file != NULL; file = va_arg( args, char * ) )
+		files.push_back( file );
+
+	va_end( args );
+
+	// a binary of exactly these sources, made by this driver, saves compiling and linking them:
+
+	unsigned long long cacheKey = 0;
+	if( CacheFile != NULL  &&  CanDoBinaryFiles )
+	{
+		cacheKey = MakeCacheKey( files );
+		if( cacheKey != 0  &&  LoadCachedProgram( cacheKey ) )
+		{
+			LoadUniformTable( );
+			return Valid;
+		}
+	}
+
 	int type;
-	while( file != NULL )
+	for( size_t f = 0; f < files.size(); f++ )
 	{
+		char *file = files[f];
 		int maxBinaryTypes = sizeof(BinaryTypes) / sizeof(struct GLbinarytype);
 		type = -1;
 		char *extension = GetExtension( file );
@@ -343,18 +380,12 @@ GLSLProgram::CreateHelper( char *file0, ... )
 				}
 			}
 		}
-
-
-
-		// go to the next vararg file:
-
-		file = va_arg( args, char * );
 	}
 
-	va_end( args );
-
 	// link the entire shader program:
 
+	if( cacheKey != 0 )
+		glProgramParameteri( this->Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
 	glLinkProgram( Program );
 	CheckGlErrors( "Link Shader 1");
 
@@ -384,6 +415,8 @@ GLSLProgram::CreateHelper( char *file0, ... )
 	{
 		if( Verbose )
 			fprintf( stderr, "Shader Program linked.\n" );
+		LoadUniformTable( );
+
 		// validate the program:
 
 		GLint status;
@@ -401,6 +434,9 @@ GLSLProgram::CreateHelper( char *file0, ... )
 		}
 	}
 
+	if( Valid  &&  cacheKey != 0 )
+		SaveCachedProgram( cacheKey );
+
 	return Valid;
 }
 
@@ -526,7 +562,7 @@ GLSLProgram::SetAttributeVariable( char* name, float vals[3] )
 
 #ifdef VEC3_H
 void
-GLSLProgram::SetAttributeVariable( char* name, Vec3& v );
+GLSLProgram::SetAttributeVariable( char* name, Vec3& v )
 {
 	int loc;
 	if( ( loc = GetAttributeLocation( name ) )  >= 0 )
@@ -534,7 +570,7 @@ GLSLProgram::SetAttributeVariable( char* name, Vec3& v );
 		float vec[3];
 		v.GetVec3( vec );
 		this->Use();
-		glVertexAttrib3fv( loc, 3, vec );
+		glVertexAttrib3fv( loc, vec );
 	}
 };
 #endif
@@ -569,97 +605,195 @@ GLSLProgram::SetAttributeVariable( char *name, VertexBufferObject& vb, GLenum wh
 
 
 
-int
-GLSLProgram::GetUniformLocation( char *name )
+// ask the linked program for all of its active uniforms, once:
+// uniforms inside uniform blocks have no location and are left out,
+// arrays are entered under both "name[0]" and "name"
+
+static bool
+CompareUniformNames( const std::pair<std::string, UniformHandle>& a, const std::pair<std::string, UniformHandle>& b )
 {
-	std::map<char *, int>::iterator pos;
+	return a.first < b.first;
+}
 
-	pos = UniformLocs.find( name );
-	//if( Verbose )
-		//fprintf( stderr, "Uniform: pos = 0x%016x ; size = %d ; end = 0x%016x\n", pos, UniformLocs.size(), UniformLocs.end() );
-	if( pos == UniformLocs.end() )
+
+void
+GLSLProgram::LoadUniformTable( )
+{
+	Uniforms.clear();
+
+	GLint numUniforms, maxLength;
+	glGetProgramiv( this->Program, GL_ACTIVE_UNIFORMS, &numUniforms );
+	glGetProgramiv( this->Program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength );
+	GLchar *name = new GLchar[maxLength+1];
+
+	for( int i = 0; i < numUniforms; i++ )
 	{
-		GLuint loc = glGetUniformLocation( this->Program, name );
-		UniformLocs[name] = loc;
+		UniformHandle handle;
+		glGetActiveUniform( this->Program, i, maxLength+1, NULL, &handle.Size, &handle.Type, name );
+		handle.Location = glGetUniformLocation( this->Program, name );
+		if( handle.Location < 0 )
+			continue;
+
+		Uniforms.push_back( std::make_pair( std::string( name ), handle ) );
+		size_t n = strlen( name );
+		if( n > 3  &&  strcmp( &name[n-3], "[0]" ) == 0 )
+			Uniforms.push_back( std::make_pair( std::string( name, n-3 ), handle ) );
+
 		if( Verbose )
-			fprintf( stderr, "Location of '%s' in Program %d = %d\n", name, this->Program, loc );
+			fprintf( stderr, "Location of '%s' in Program %d = %d\n", name, this->Program, handle.Location );
 	}
-	else
+	delete [ ] name;
+
+	std::sort( Uniforms.begin(), Uniforms.end(), CompareUniformNames );
+	CheckGlErrors( "LoadUniformTable" );
+}
+
+
+UniformHandle
+GLSLProgram::GetUniformHandle( const char *name )
+{
+	std::pair<std::string, UniformHandle> key( name, UniformHandle( ) );
+	std::vector<std::pair<std::string, UniformHandle> >::iterator pos;
+
+	pos = std::lower_bound( Uniforms.begin(), Uniforms.end(), key, CompareUniformNames );
+	if( pos == Uniforms.end()  ||  pos->first != name )
 	{
 		if( Verbose )
-		{
-			fprintf( stderr, "Location = %d\n", UniformLocs[name] );
-			if( UniformLocs[name] == -1 )
-				fprintf( stderr, "Location of uniform variable '%s' is -1\n", name );
-		}
+			fprintf( stderr, "Uniform variable '%s' is not active in Program %d\n", name, this->Program );
+		return UniformHandle( );
 	}
 
-	return UniformLocs[name];
+	return pos->second;
 };
 
 
-void
-GLSLProgram::SetUniformVariable( char* name, int val )
+int
+GLSLProgram::GetUniformLocation( const char *name )
 {
-	int loc;
-	if( ( loc = GetUniformLocation( name ) )  >= 0 )
+	return GetUniformHandle( name ).Location;
+};
+
+
+// uniform blocks:
+// the program only records which binding point a block reads from,
+// the buffer itself is bound to that point with glBindBufferBase( GL_UNIFORM_BUFFER, ... )
+
+GLuint
+GLSLProgram::GetUniformBlockIndex( char *name )
+{
+	GLuint index = glGetUniformBlockIndex( this->Program, name );
+	if( Verbose )
+		fprintf( stderr, "Index of uniform block '%s' in Program %d = %d\n", name, this->Program, index );
+	return index;
+};
+
+
+// size in bytes the linked program expects the buffer behind a block to have, -1 if there is no such block:
+
+int
+GLSLProgram::GetUniformBlockSize( char *name )
+{
+	GLuint index = GetUniformBlockIndex( name );
+	if( index == GL_INVALID_INDEX )
+		return -1;
+
+	GLint size;
+	glGetActiveUniformBlockiv( this->Program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size );
+	return size;
+};
+
+
+bool
+GLSLProgram::SetUniformBlockBinding( char *name, GLuint binding )
+{
+	GLuint index = GetUniformBlockIndex( name );
+	if( index == GL_INVALID_INDEX )
 	{
-		this->Use();
-		glUniform1i( loc, val );
+		fprintf( stderr, "Uniform block '%s' is not in Program %d\n", name, this->Program );
+		return false;
 	}
+
+	glUniformBlockBinding( this->Program, index, binding );
+	CheckGlErrors( "glUniformBlockBinding" );
+	return true;
+};
+
+
+// the setters do not bind the program, Use( ) it before setting its uniforms:
+
+void
+GLSLProgram::SetUniformVariable( char* name, int val )
+{
+	SetUniformVariable( GetUniformHandle( name ), val );
 };
 
 
 void
 GLSLProgram::SetUniformVariable( char* name, float val )
 {
-	int loc;
-	if( ( loc = GetUniformLocation( name ) )  >= 0 )
-	{
-		this->Use();
-		glUniform1f( loc, val );
-	}
+	SetUniformVariable( GetUniformHandle( name ), val );
 };
 
 
 void
 GLSLProgram::SetUniformVariable( char* name, float val0, float val1, float val2 )
 {
-	int loc;
-	if( ( loc = GetUniformLocation( name ) )  >= 0 )
-	{
-		this->Use();
-		glUniform3f( loc, val0, val1, val2 );
-	}
+	SetUniformVariable( GetUniformHandle( name ), val0, val1, val2 );
 };
 
 
 void
 GLSLProgram::SetUniformVariable( char* name, float vals[3] )
 {
-	int loc;
-	fprintf( stderr, "Found a 3-element array\n" );
+	SetUniformVariable( GetUniformHandle( name ), vals );
+};
 
-	if( ( loc = GetUniformLocation( name ) )  >= 0 )
-	{
-		this->Use();
-		glUniform3fv( loc, 3, vals );
-	}
+
+void
+GLSLProgram::SetUniformVariable( const UniformHandle& u, int val )
+{
+	if( u.Location >= 0 )
+		glUniform1i( u.Location, val );
+};
+
+
+void
+GLSLProgram::SetUniformVariable( const UniformHandle& u, float val )
+{
+	if( u.Location >= 0 )
+		glUniform1f( u.Location, val );
+};
+
+
+void
+GLSLProgram::SetUniformVariable( const UniformHandle& u, float val0, float val1, float val2 )
+{
+	if( u.Location >= 0 )
+		glUniform3f( u.Location, val0, val1, val2 );
+};
+
+
+void
+GLSLProgram::SetUniformVariable( const UniformHandle& u, float vals[3] )
+{
+	if( u.Location >= 0 )
+		glUniform3fv( u.Location, 1, vals );
 };
 
 
 #ifdef VEC3_H
 void
-GLSLProgram::SetUniformVariable( char* name, Vec3& v );
+GLSLProgram::SetUniformVariable( char* name, Vec3& v )
 {
-	int loc;
-	if( ( loc = GetAttributeLocation( name ) )  >= 0 )
-	{
-		float vec[3];
-		v.GetVec3( vec );
-		this->Use();
-		glUniform3fv( loc, 3, vec );
-	}
+	SetUniformVariable( GetUniformHandle( name ), v );
+};
+
+
+void
+GLSLProgram::SetUniformVariable( const UniformHandle& u, const Vec3& v )
+{
+	if( u.Location >= 0 )
+		glUniform3f( u.Location, v.x, v.y, v.z );
 };
 #endif
 
@@ -668,14 +802,17 @@ GLSLProgram::SetUniformVariable( char* name, Vec3& v );
 void
 GLSLProgram::SetUniformVariable( char* name, Matrix4& m )
 {
-	int loc;
-	if( ( loc = GetUniformLocation( name ) )  >= 0 )
-	{
-		float mat[4][4];
-		m.GetMatrix4( mat );
-		this->Use();
-		glUniformMatrix4fv( loc, 16, true, mat );
-	}
+	SetUniformVariable( GetUniformHandle( name ), m );
+};
+
+
+// Matrix4 is column-major like GL, so it goes in without transposing:
+
+void
+GLSLProgram::SetUniformVariable( const UniformHandle& u, const Matrix4& m )
+{
+	if( u.Location >= 0 )
+		glUniformMatrix4fv( u.Location, 1, GL_FALSE, m.M );
 };
 #endif
 
@@ -716,6 +853,21 @@ GLSLProgram::IsExtensionSupported( const char *extension )
 	if( where != 0 )
 		return false;
 
+	// OpenGL 3.0 and up hand out the extensions one at a time,
+	// a core profile context has no glGetString( GL_EXTENSIONS ) at all:
+
+	if( GetGLVersion( ) >= 30 )
+	{
+		GLint numExtensions = 0;
+		glGetIntegerv( GL_NUM_EXTENSIONS, &numExtensions );
+		for( int i = 0; i < numExtensions; i++ )
+		{
+			if( strcmp( (const char *) glGetStringi( GL_EXTENSIONS, i ), extension ) == 0 )
+				return true;
+		}
+		return false;
+	}
+
 	// get the full list of extensions:
 
 	const GLubyte *extensions = glGetString( GL_EXTENSIONS );
@@ -834,6 +986,160 @@ GLSLProgram::LoadProgramBinary( const char * fileName, GLenum format )
 
 
 
+// program binary cache:
+// one file per program holds the binary and the key it was made for,
+// the key is a hash of the shader sources, the Gstap preamble and the GL vendor, renderer and version,
+// so editing a shader or updating the driver makes the file stale and it is simply written again
+
+#define CACHE_MAGIC	"GLSLBIN1"
+
+void
+GLSLProgram::SetProgramCache( const char *fileName )
+{
+	CacheFile = fileName;
+}
+
+
+// 64-bit FNV-1a:
+static unsigned long long
+HashCacheBytes( unsigned long long h, const void *data, size_t size )
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	for( size_t i = 0; i < size; i++ )
+	{
+		h ^= bytes[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+
+static unsigned long long
+HashCacheString( unsigned long long h, const char *str )
+{
+	if( str == NULL )
+		str = "";
+	return HashCacheBytes( h, str, strlen(str) + 1 );	// the '\0' keeps "ab"+"c" apart from "a"+"bc"
+}
+
+
+// 0 means the key cannot be made, so the program is not cached:
+
+unsigned long long
+GLSLProgram::MakeCacheKey( const std::vector<char *>& files )
+{
+	unsigned long long h = 14695981039346656037ull;
+	h = HashCacheString( h, (const char *) glGetString( GL_VENDOR ) );
+	h = HashCacheString( h, (const char *) glGetString( GL_RENDERER ) );
+	h = HashCacheString( h, (const char *) glGetString( GL_VERSION ) );
+	h = HashCacheString( h, IncludeGstap ? Gstap : "" );
+
+	for( size_t f = 0; f < files.size(); f++ )
+	{
+		FILE *in = fopen( files[f], "rb" );
+		if( in == NULL )
+			return 0;
+
+		char *extension = GetExtension( files[f] );
+		h = HashCacheString( h, extension );
+
+		char buf[4096];
+		size_t n;
+		while( ( n = fread( buf, 1, sizeof(buf), in ) ) > 0 )
+			h = HashCacheBytes( h, buf, n );
+		fclose( in );
+		h = HashCacheBytes( h, "", 1 );
+	}
+
+	return h != 0 ? h : 1;
+}
+
+
+bool
+GLSLProgram::LoadCachedProgram( unsigned long long key )
+{
+	FILE *fpin = fopen( CacheFile, "rb" );
+	if( fpin == NULL )
+		return false;
+
+	char magic[8];
+	unsigned long long fileKey;
+	GLenum format;
+	GLint length;
+	bool ok = fread( magic, sizeof(magic), 1, fpin ) == 1  &&  memcmp( magic, CACHE_MAGIC, sizeof(magic) ) == 0  &&
+		  fread( &fileKey, sizeof(fileKey), 1, fpin ) == 1  &&  fileKey == key  &&
+		  fread( &format, sizeof(format), 1, fpin ) == 1  &&
+		  fread( &length, sizeof(length), 1, fpin ) == 1  &&  length > 0;
+	if( ! ok )
+	{
+		fclose( fpin );
+		if( Verbose )
+			fprintf( stderr, "Program cache '%s' is stale\n", CacheFile );
+		return false;
+	}
+
+	GLubyte *buffer = new GLubyte[ length ];
+	ok = fread( buffer, length, 1, fpin ) == 1;
+	fclose( fpin );
+
+	GLint success = GL_FALSE;
+	if( ok )
+	{
+		glProgramBinary( this->Program, format, buffer, length );
+		glGetProgramiv( this->Program, GL_LINK_STATUS, &success );
+	}
+	delete [ ] buffer;
+
+	if( ! success )
+	{
+		// the driver may reject a binary for reasons the key does not see,
+		// start over with a fresh program object and compile:
+		fprintf( stderr, "Program cache '%s' was rejected, compiling the shaders\n", CacheFile );
+		glDeleteProgram( this->Program );
+		this->Program = glCreateProgram( );
+		CheckGlErrors( "LoadCachedProgram" );
+		return false;
+	}
+
+	if( Verbose )
+		fprintf( stderr, "Shader Program loaded from '%s'.\n", CacheFile );
+	return true;
+}
+
+
+void
+GLSLProgram::SaveCachedProgram( unsigned long long key )
+{
+	GLint length = 0;
+	glGetProgramiv( this->Program, GL_PROGRAM_BINARY_LENGTH, &length );
+	if( length <= 0 )
+		return;		// the driver has no binary format to give
+
+	GLubyte *buffer = new GLubyte[length];
+	GLenum format;
+	glGetProgramBinary( this->Program, length, &length, &format, buffer );
+	CheckGlErrors( "SaveCachedProgram" );
+
+	FILE *fpout = fopen( CacheFile, "wb" );
+	if( fpout == NULL )
+	{
+		fprintf( stderr, "Cannot create program cache '%s'\n", CacheFile );
+		delete [ ] buffer;
+		return;
+	}
+	fwrite( CACHE_MAGIC, 8, 1, fpout );
+	fwrite( &key, sizeof(key), 1, fpout );
+	fwrite( &format, sizeof(format), 1, fpout );
+	fwrite( &length, sizeof(length), 1, fpout );
+	fwrite( buffer, length, 1, fpout );
+	fclose( fpout );
+	delete [ ] buffer;
+
+	if( Verbose )
+		fprintf( stderr, "Shader Program saved to '%s'.\n", CacheFile );
+}
+
+
 void
 GLSLProgram::SetGstap( bool b )
 {
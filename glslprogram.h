@@ -15,6 +15,8 @@
 #include <GL/glu.h>
 #include "glut.h"
 #include <map>
+#include <string>
+#include <vector>
 #include <stdarg.h>
 
 #ifndef GL_COMPUTE_SHADER
@@ -33,11 +35,26 @@ inline int GetOSU( int flag )
 void	CheckGlErrors( const char* );
 
 
+// a uniform variable resolved once by GLSLProgram::GetUniformHandle( ),
+// setting it through the handle needs no lookup at all:
+
+struct UniformHandle
+{
+	GLint	Location;		// -1 if the program has no such active uniform
+	GLenum	Type;			// GL_FLOAT, GL_FLOAT_VEC3, ...
+	GLint	Size;			// number of array elements, 1 if it is not an array
+
+		UniformHandle( ) : Location( -1 ), Type( 0 ), Size( 0 ) { }
+	bool	IsValid( ) const { return Location >= 0; }
+};
+
+
 
 class GLSLProgram
 {
   private:
 	std::map<char *, int>	AttributeLocs;
+	const char *		CacheFile;
 	char *			Cfile;
 	unsigned int		Cshader;
 	char *			Ffile;
@@ -52,7 +69,7 @@ class GLSLProgram
 	GLuint			TCshader;
 	char *			TEfile;
 	GLuint			TEshader;
-	std::map<char *, int>	UniformLocs;
+	std::vector<std::pair<std::string, UniformHandle> >	Uniforms;	// sorted by name, filled at link time
 	bool			Valid;
 	char *			Vfile;
 	GLuint			Vshader;
@@ -71,7 +88,12 @@ class GLSLProgram
 	int	CompileShader( GLuint );
 	bool	CreateHelper( char *, ... );
 	int	GetAttributeLocation( char * );
-	int	GetUniformLocation( char * );
+	GLuint	GetUniformBlockIndex( char * );
+	int	GetUniformLocation( const char * );
+	bool	LoadCachedProgram( unsigned long long );
+	void	LoadUniformTable( );
+	unsigned long long	MakeCacheKey( const std::vector<char *>& );
+	void	SaveCachedProgram( unsigned long long );
 
 
   public:
@@ -79,6 +101,8 @@ class GLSLProgram
 
 	bool	Create( char *, char * = NULL, char * = NULL, char * = NULL, char * = NULL, char * = NULL );
 	void	DispatchCompute( GLuint, GLuint = 1, GLuint = 1 );
+	int	GetUniformBlockSize( char * );
+	UniformHandle	GetUniformHandle( const char * );
 	bool	IsExtensionSupported( const char * );
 	bool	IsNotValid( );
 	bool	IsValid( );
@@ -102,15 +126,23 @@ class GLSLProgram
 	void	SetGstap( bool );
 	void	SetInputTopology( GLenum );
 	void	SetOutputTopology( GLenum );
+	void	SetProgramCache( const char * );
+	bool	SetUniformBlockBinding( char *, GLuint );
 	void	SetUniformVariable( char *, int );
 	void	SetUniformVariable( char *, float );
 	void	SetUniformVariable( char *, float, float, float );
 	void	SetUniformVariable( char *, float[3] );
+	void	SetUniformVariable( const UniformHandle&, int );
+	void	SetUniformVariable( const UniformHandle&, float );
+	void	SetUniformVariable( const UniformHandle&, float, float, float );
+	void	SetUniformVariable( const UniformHandle&, float[3] );
 #ifdef VEC3_H
 	void	SetUniformVariable( char *, Vec3& );
+	void	SetUniformVariable( const UniformHandle&, const Vec3& );
 #endif
 #ifdef MATRIX4_H
 	void	SetUniformVariable( char *, Matrix4& );
+	void	SetUniformVariable( const UniformHandle&, const Matrix4& );
 #endif
 	void	SetVerbose( bool );
 	void	Use( );
@@ -0,0 +1,25 @@
+#version 330 core
+
+// linear fog, as glFog( GL_LINEAR ) used to do for the helpers:
+uniform bool		uFog;
+uniform float		uFogStart;
+uniform float		uFogEnd;
+uniform vec3		uFogColor;
+
+uniform vec3		uColor;
+
+in  float  vEyeDistance;
+
+out vec4  fFragColor;
+
+void
+main( )
+{
+	vec3 color = uColor;
+	if( uFog )
+	{
+		float f = clamp( ( uFogEnd - vEyeDistance ) / ( uFogEnd - uFogStart ), 0., 1. );
+		color = mix( uFogColor, color, f );
+	}
+	fFragColor = vec4( color, 1. );
+}
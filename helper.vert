@@ -0,0 +1,17 @@
+#version 330 core
+
+// The axes, the light marker and the contact lines: plain colored geometry from one buffer.
+layout(location = 0) in vec3	aVertex;	// HELPER_VERTEX_ATTRIB in sample.cpp
+
+uniform mat4		uModelViewMatrix;
+uniform mat4		uProjectionMatrix;
+
+out	float	vEyeDistance;	// for the depth cueing fog
+
+void
+main( )
+{
+	vec4 ECposition = uModelViewMatrix * vec4( aVertex, 1. );
+	vEyeDistance = -ECposition.z;
+	gl_Position = uProjectionMatrix * ECposition;
+}
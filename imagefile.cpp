@@ -0,0 +1,258 @@
+#include "imagefile.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// deflate's fixed length and distance codes, RFC 1951 3.2.5:
+static const int LengthBase[29] =
+{
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const int LengthExtraBits[29] =
+{
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const int DistanceBase[30] =
+{
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+	4097, 6145, 8193, 12289, 16385, 24577
+};
+static const int DistanceExtraBits[30] =
+{
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+#define DEFLATE_MAX_MATCH		258
+#define DEFLATE_MAX_DISTANCE	32768
+
+// deflate packs its bits from the least significant end, except for the Huffman codes themselves:
+struct BitWriter
+{
+	std::vector<unsigned char>&	Out;
+	unsigned int	Bits;
+	int				NumBits;
+
+	BitWriter(std::vector<unsigned char>& out) : Out(out), Bits(0), NumBits(0) { }
+
+	void
+	Put(unsigned int value, int numBits)
+	{
+		Bits |= value << NumBits;
+		NumBits += numBits;
+		while (NumBits >= 8) {
+			Out.push_back((unsigned char)(Bits & 0xff));
+			Bits >>= 8;
+			NumBits -= 8;
+		}
+	}
+
+	void
+	PutCode(unsigned int code, int numBits)
+	{
+		unsigned int reversed = 0;
+		for (int i = 0; i < numBits; i++) {
+			reversed = (reversed << 1) | ((code >> i) & 1);
+		}
+		Put(reversed, numBits);
+	}
+
+	void
+	Flush()
+	{
+		if (NumBits > 0) {
+			Out.push_back((unsigned char)(Bits & 0xff));
+		}
+		Bits = 0;
+		NumBits = 0;
+	}
+};
+
+static void
+PutLiteralOrLength(BitWriter& writer, int symbol)
+{
+	if (symbol < 144)
+		writer.PutCode(0x30 + symbol, 8);
+	else if (symbol < 256)
+		writer.PutCode(0x190 + symbol - 144, 9);
+	else if (symbol < 280)
+		writer.PutCode(symbol - 256, 7);
+	else
+		writer.PutCode(0xc0 + symbol - 280, 8);
+}
+
+static void
+PutMatch(BitWriter& writer, int length, int distance)
+{
+	int code = 28;
+	while (LengthBase[code] > length) {
+		code--;
+	}
+	PutLiteralOrLength(writer, 257 + code);
+	writer.Put(length - LengthBase[code], LengthExtraBits[code]);
+
+	code = 29;
+	while (DistanceBase[code] > distance) {
+		code--;
+	}
+	writer.PutCode(code, 5);
+	writer.Put(distance - DistanceBase[code], DistanceExtraBits[code]);
+}
+
+// one fixed Huffman block; a run is copied from the pixel on the left or from the row above,
+// whichever repeats longer -- other matches would need a hash chain search and gain little here:
+static void
+Deflate(const std::vector<unsigned char>& data, int rowBytes, std::vector<unsigned char>& out)
+{
+	BitWriter writer(out);
+	writer.Put(1, 1);		// last block
+	writer.Put(1, 2);		// fixed Huffman codes
+
+	int distances[2] = { 3, rowBytes };
+	int size = (int)data.size();
+	for (int i = 0; i < size; ) {
+		int bestLength = 0;
+		int bestDistance = 0;
+		for (int d = 0; d < 2; d++) {
+			int distance = distances[d];
+			if (distance > i || distance > DEFLATE_MAX_DISTANCE) {
+				continue;
+			}
+			int length = 0;
+			while (length < DEFLATE_MAX_MATCH && i + length < size && data[i + length] == data[i + length - distance]) {
+				length++;
+			}
+			if (length > bestLength) {
+				bestLength = length;
+				bestDistance = distance;
+			}
+		}
+
+		if (bestLength >= 3) {
+			PutMatch(writer, bestLength, bestDistance);
+			i += bestLength;
+		}
+		else {
+			PutLiteralOrLength(writer, data[i]);
+			i++;
+		}
+	}
+	PutLiteralOrLength(writer, 256);		// end of block
+	writer.Flush();
+}
+
+static unsigned int
+Adler32(const std::vector<unsigned char>& data)
+{
+	unsigned int a = 1, b = 0;
+	for (size_t i = 0; i < data.size(); i++) {
+		a = (a + data[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	return (b << 16) | a;
+}
+
+// the table is made once, by whichever writer thread gets here first:
+struct Crc32Table
+{
+	unsigned int	Entries[256];
+
+	Crc32Table()
+	{
+		for (unsigned int n = 0; n < 256; n++) {
+			unsigned int c = n;
+			for (int k = 0; k < 8; k++) {
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			}
+			Entries[n] = c;
+		}
+	}
+};
+
+static unsigned int
+Crc32(unsigned int crc, const unsigned char* data, size_t length)
+{
+	static const Crc32Table table;
+	crc = ~crc;
+	for (size_t i = 0; i < length; i++) {
+		crc = table.Entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static void
+PutBigEndian(std::vector<unsigned char>& out, unsigned int value)
+{
+	out.push_back((unsigned char)(value >> 24));
+	out.push_back((unsigned char)(value >> 16));
+	out.push_back((unsigned char)(value >> 8));
+	out.push_back((unsigned char)value);
+}
+
+static void
+WriteChunk(FILE* fp, const char* type, const std::vector<unsigned char>& data)
+{
+	std::vector<unsigned char> chunk;
+	PutBigEndian(chunk, (unsigned int)data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	PutBigEndian(chunk, Crc32(0, &chunk[4], chunk.size() - 4));
+	fwrite(&chunk[0], 1, chunk.size(), fp);
+}
+
+bool
+WriteImage(const char* file, int width, int height, const unsigned char* rgb, int format)
+{
+	return format == IMAGE_PNG ? WritePng(file, width, height, rgb) : WritePpm(file, width, height, rgb);
+}
+
+bool
+WritePng(const char* file, int width, int height, const unsigned char* rgb)
+{
+	FILE* fp = fopen(file, "wb");
+	if (fp == NULL) {
+		return false;
+	}
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	fwrite(signature, 1, sizeof(signature), fp);
+
+	std::vector<unsigned char> header;
+	PutBigEndian(header, width);
+	PutBigEndian(header, height);
+	header.push_back(8);		// bits per channel
+	header.push_back(2);		// RGB
+	header.push_back(0);		// deflate
+	header.push_back(0);		// adaptive filtering
+	header.push_back(0);		// no interlace
+	WriteChunk(fp, "IHDR", header);
+
+	// every row starts with its filter type, 0 leaves the row as it is:
+	int rowBytes = 1 + 3 * width;
+	std::vector<unsigned char> rows((size_t)rowBytes * height);
+	for (int row = 0; row < height; row++) {
+		rows[(size_t)rowBytes * row] = 0;
+		memcpy(&rows[(size_t)rowBytes * row + 1], &rgb[(size_t)3 * width * row], 3 * width);
+	}
+
+	std::vector<unsigned char> zlib;
+	zlib.push_back(0x78);		// deflate with a 32K window
+	zlib.push_back(0x01);		// no dictionary, the header check bits
+	Deflate(rows, rowBytes, zlib);
+	PutBigEndian(zlib, Adler32(rows));
+	WriteChunk(fp, "IDAT", zlib);
+
+	WriteChunk(fp, "IEND", std::vector<unsigned char>());
+	return fclose(fp) == 0;
+}
+
+bool
+WritePpm(const char* file, int width, int height, const unsigned char* rgb)
+{
+	FILE* fp = fopen(file, "wb");
+	if (fp == NULL) {
+		return false;
+	}
+	fprintf(fp, "P6\n%d %d\n255\n", width, height);
+	fwrite(rgb, 1, (size_t)3 * width * height, fp);
+	return fclose(fp) == 0;
+}
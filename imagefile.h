@@ -0,0 +1,16 @@
+#ifndef IMAGEFILE_H
+#define IMAGEFILE_H
+
+// Writes 8 bit RGB images, rows from the top down, without any image library.
+// PPM is the raw pixels behind a short header. PNG is compressed by a small deflate encoder of its own:
+// fixed Huffman codes and back references only to the pixel on the left and the pixel above,
+// which is what the flat backgrounds and gear faces of a rendered frame need.
+
+#define IMAGE_PPM	0
+#define IMAGE_PNG	1
+
+bool	WriteImage(const char*, int, int, const unsigned char*, int);
+bool	WritePng(const char*, int, int, const unsigned char*);
+bool	WritePpm(const char*, int, int, const unsigned char*);
+
+#endif		// #ifndef IMAGEFILE_H
@@ -0,0 +1,169 @@
+#include "matrix4.h"
+
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MATRIX4_SSE
+#include <xmmintrin.h>
+#endif
+
+Matrix4::Matrix4()
+{
+	memset(M, 0, sizeof(M));
+	M[0] = M[5] = M[10] = M[15] = 1.f;
+}
+
+// column j of A * B is the columns of A weighted by column j of B:
+Matrix4
+Matrix4::operator*(const Matrix4& b) const
+{
+	Matrix4 c;
+#ifdef MATRIX4_SSE
+	__m128 a0 = _mm_loadu_ps(&M[0]);
+	__m128 a1 = _mm_loadu_ps(&M[4]);
+	__m128 a2 = _mm_loadu_ps(&M[8]);
+	__m128 a3 = _mm_loadu_ps(&M[12]);
+	for (int j = 0; j < 4; j++) {
+		const float* bj = &b.M[4 * j];
+		__m128 column = _mm_mul_ps(a0, _mm_set1_ps(bj[0]));
+		column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(bj[1])));
+		column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(bj[2])));
+		column = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(bj[3])));
+		_mm_storeu_ps(&c.M[4 * j], column);
+	}
+#else
+	for (int j = 0; j < 4; j++) {
+		for (int row = 0; row < 4; row++) {
+			c.M[4 * j + row] = M[row] * b.M[4 * j] + M[4 + row] * b.M[4 * j + 1] +
+				M[8 + row] * b.M[4 * j + 2] + M[12 + row] * b.M[4 * j + 3];
+		}
+	}
+#endif
+	return c;
+}
+
+void
+Matrix4::GetMatrix4(float mat[4][4]) const
+{
+	memcpy(mat, M, sizeof(M));
+}
+
+// the cofactors of the upper 3x3 divided by its determinant:
+// (a singular matrix gives the identity, there is no sensible normal transform for it)
+Matrix4
+Matrix4::GetNormalMatrix() const
+{
+	float a00 = M[0], a01 = M[4], a02 = M[8];
+	float a10 = M[1], a11 = M[5], a12 = M[9];
+	float a20 = M[2], a21 = M[6], a22 = M[10];
+
+	float c00 = a11 * a22 - a12 * a21;
+	float c01 = a12 * a20 - a10 * a22;
+	float c02 = a10 * a21 - a11 * a20;
+	float det = a00 * c00 + a01 * c01 + a02 * c02;
+
+	Matrix4 n;
+	if (det == 0.f) {
+		return n;
+	}
+	float s = 1.f / det;
+	n.M[0] = s * c00;
+	n.M[4] = s * c01;
+	n.M[8] = s * c02;
+	n.M[1] = s * (a02 * a21 - a01 * a22);
+	n.M[5] = s * (a00 * a22 - a02 * a20);
+	n.M[9] = s * (a01 * a20 - a00 * a21);
+	n.M[2] = s * (a01 * a12 - a02 * a11);
+	n.M[6] = s * (a02 * a10 - a00 * a12);
+	n.M[10] = s * (a00 * a11 - a01 * a10);
+	return n;
+}
+
+Vec3
+Matrix4::TransformPoint(const Vec3& p) const
+{
+	return Vec3(M[0] * p.x + M[4] * p.y + M[8] * p.z + M[12],
+		M[1] * p.x + M[5] * p.y + M[9] * p.z + M[13],
+		M[2] * p.x + M[6] * p.y + M[10] * p.z + M[14]);
+}
+
+Matrix4
+Matrix4::LookAt(const Vec3& eye, const Vec3& center, const Vec3& up)
+{
+	Vec3 f = (center - eye).Unit();
+	Vec3 s = f.Cross(up).Unit();
+	Vec3 u = s.Cross(f);
+
+	Matrix4 m;
+	m.M[0] = s.x;	m.M[4] = s.y;	m.M[8] = s.z;
+	m.M[1] = u.x;	m.M[5] = u.y;	m.M[9] = u.z;
+	m.M[2] = -f.x;	m.M[6] = -f.y;	m.M[10] = -f.z;
+	m.M[12] = -s.Dot(eye);
+	m.M[13] = -u.Dot(eye);
+	m.M[14] = f.Dot(eye);
+	return m;
+}
+
+Matrix4
+Matrix4::Ortho(float left, float right, float bottom, float top, float zNear, float zFar)
+{
+	Matrix4 m;
+	m.M[0] = 2.f / (right - left);
+	m.M[5] = 2.f / (top - bottom);
+	m.M[10] = -2.f / (zFar - zNear);
+	m.M[12] = -(right + left) / (right - left);
+	m.M[13] = -(top + bottom) / (top - bottom);
+	m.M[14] = -(zFar + zNear) / (zFar - zNear);
+	return m;
+}
+
+Matrix4
+Matrix4::Perspective(float fovyDegrees, float aspect, float zNear, float zFar)
+{
+	float f = 1.f / tanf(fovyDegrees * (float)M_PI / 360.f);
+	Matrix4 m;
+	m.M[0] = f / aspect;
+	m.M[5] = f;
+	m.M[10] = (zFar + zNear) / (zNear - zFar);
+	m.M[11] = -1.f;
+	m.M[14] = 2.f * zFar * zNear / (zNear - zFar);
+	m.M[15] = 0.f;
+	return m;
+}
+
+Matrix4
+Matrix4::Rotate(float degrees, float x, float y, float z)
+{
+	Vec3 axis = Vec3(x, y, z).Unit();
+	x = axis.x;
+	y = axis.y;
+	z = axis.z;
+	float a = degrees * (float)M_PI / 180.f;
+	float c = cosf(a);
+	float s = sinf(a);
+	float t = 1.f - c;
+
+	Matrix4 m;
+	m.M[0] = x * x * t + c;		m.M[4] = x * y * t - z * s;	m.M[8] = x * z * t + y * s;
+	m.M[1] = y * x * t + z * s;	m.M[5] = y * y * t + c;		m.M[9] = y * z * t - x * s;
+	m.M[2] = x * z * t - y * s;	m.M[6] = y * z * t + x * s;	m.M[10] = z * z * t + c;
+	return m;
+}
+
+Matrix4
+Matrix4::Scale(float s)
+{
+	Matrix4 m;
+	m.M[0] = m.M[5] = m.M[10] = s;
+	return m;
+}
+
+Matrix4
+Matrix4::Translate(float x, float y, float z)
+{
+	Matrix4 m;
+	m.M[12] = x;
+	m.M[13] = y;
+	m.M[14] = z;
+	return m;
+}
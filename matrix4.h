@@ -0,0 +1,35 @@
+#ifndef MATRIX4_H
+#define MATRIX4_H
+
+// 4x4 float matrices that replace the fixed-function matrix stack.
+// The elements are in OpenGL's column-major order, M[4 * column + row], so they go to glUniformMatrix4fv
+// and glLoadMatrixf as they are. The product combines whole columns, which is four SSE multiply-adds
+// per column on x86.
+// The factories build the same matrices as their glTranslatef, glRotatef, glScalef, gluLookAt,
+// glOrtho and gluPerspective namesakes, and A * B applies B first, like glMultMatrixf( ).
+// glslprogram.h sees MATRIX4_H and adds SetUniformVariable( ) for it.
+
+#include "vec3.h"
+
+class Matrix4
+{
+  public:
+	float	M[16];
+
+		Matrix4();		// identity
+
+	Matrix4	operator*(const Matrix4&) const;
+
+	void	GetMatrix4(float[4][4]) const;		// [column][row]
+	Matrix4	GetNormalMatrix() const;			// inverse transpose of the upper 3x3, for transforming normals
+	Vec3	TransformPoint(const Vec3&) const;
+
+	static Matrix4	LookAt(const Vec3& eye, const Vec3& center, const Vec3& up);
+	static Matrix4	Ortho(float left, float right, float bottom, float top, float zNear, float zFar);
+	static Matrix4	Perspective(float fovyDegrees, float aspect, float zNear, float zFar);
+	static Matrix4	Rotate(float degrees, float x, float y, float z);
+	static Matrix4	Scale(float s);
+	static Matrix4	Translate(float x, float y, float z);
+};
+
+#endif		// #ifndef MATRIX4_H
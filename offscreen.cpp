@@ -0,0 +1,168 @@
+#include "offscreen.h"
+
+#include <stdio.h>
+
+OffscreenRenderer::OffscreenRenderer()
+{
+	Width = Height = 0;
+	Fbo = ColorBuffer = DepthBuffer = 0;
+#ifndef WIN32
+	Display = EGL_NO_DISPLAY;
+	Context = EGL_NO_CONTEXT;
+#endif
+}
+
+OffscreenRenderer::~OffscreenRenderer()
+{
+#ifndef WIN32
+	if (Context != EGL_NO_CONTEXT) {
+		eglMakeCurrent(Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(Display, Context);
+	}
+	if (Display != EGL_NO_DISPLAY) {
+		eglTerminate(Display);
+	}
+#endif
+}
+
+// draw into the framebuffer object, all of it:
+void
+OffscreenRenderer::Bind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, Fbo);
+	glViewport(0, 0, Width, Height);
+}
+
+// makes the context current and the framebuffer object of width x height pixels with a depth buffer:
+bool
+OffscreenRenderer::Create(int width, int height, bool coreProfile)
+{
+	if (!CreateContext(coreProfile)) {
+		return false;
+	}
+
+	Width = width;
+	Height = height;
+	glGenFramebuffers(1, &Fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, Fbo);
+
+	glGenRenderbuffers(1, &ColorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, ColorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, Width, Height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, ColorBuffer);
+
+	glGenRenderbuffers(1, &DepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, DepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, Width, Height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, DepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "Offscreen framebuffer of %d x %d is not complete: 0x%x\n", Width, Height, status);
+		return false;
+	}
+	Bind();
+	return true;
+}
+
+#ifdef WIN32
+
+// a hidden glut window only lends its context, nothing is ever drawn into it:
+bool
+OffscreenRenderer::CreateContext(bool coreProfile)
+{
+	int argc = 1;
+	char* argv[] = { (char*)"offscreen", NULL };
+	glutInit(&argc, argv);
+	if (coreProfile) {
+		glutInitContextVersion(3, 3);
+		glutInitContextProfile(GLUT_CORE_PROFILE);
+	}
+	glutInitDisplayMode(GLUT_RGBA);
+	glutInitWindowSize(1, 1);
+	glutCreateWindow("offscreen");
+	glutHideWindow();
+
+	glewExperimental = GL_TRUE;
+	if (glewInit() != GLEW_OK) {
+		fprintf(stderr, "glewInit Error\n");
+		return false;
+	}
+	return true;
+}
+
+#else
+
+// an EGL context with no surface at all, on the surfaceless platform when Mesa has it:
+bool
+OffscreenRenderer::CreateContext(bool coreProfile)
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay != NULL) {
+		Display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (Display == EGL_NO_DISPLAY) {
+		Display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	if (Display == EGL_NO_DISPLAY || !eglInitialize(Display, NULL, NULL)) {
+		fprintf(stderr, "Cannot open an EGL display\n");
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		fprintf(stderr, "EGL cannot do desktop OpenGL\n");
+		return false;
+	}
+
+	// no surface type, the config would ask for window surfaces otherwise, which surfaceless has none of:
+	EGLint configAttributes[] = { EGL_SURFACE_TYPE, 0, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if (!eglChooseConfig(Display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0) {
+		fprintf(stderr, "EGL has no OpenGL config\n");
+		return false;
+	}
+
+	// the same 3.3 context the window asks for, compatibility or core:
+	EGLint contextAttributes[] =
+	{
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK,
+		coreProfile ? EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT : EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+		EGL_NONE
+	};
+	Context = eglCreateContext(Display, config, EGL_NO_CONTEXT, contextAttributes);
+	if (Context == EGL_NO_CONTEXT) {
+		fprintf(stderr, "Cannot create an OpenGL 3.3 context with EGL: 0x%x\n", eglGetError());
+		return false;
+	}
+	if (!eglMakeCurrent(Display, EGL_NO_SURFACE, EGL_NO_SURFACE, Context)) {
+		fprintf(stderr, "Cannot make the EGL context current without a surface: 0x%x\n", eglGetError());
+		return false;
+	}
+
+	// glew loads the OpenGL functions first, then it may give up on glX, which has no display here:
+	glewExperimental = GL_TRUE;
+	glewInit();
+	if (glGenFramebuffers == NULL) {
+		fprintf(stderr, "glew cannot load the OpenGL functions\n");
+		return false;
+	}
+	return true;
+}
+
+#endif
+
+int
+OffscreenRenderer::GetHeight() const
+{
+	return Height;
+}
+
+int
+OffscreenRenderer::GetWidth() const
+{
+	return Width;
+}
@@ -0,0 +1,58 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+// An OpenGL context without a window, for rendering on servers and CI machines with no display.
+// On Linux it is an EGL context on Mesa's surfaceless platform, which is llvmpipe when there is no GPU;
+// on Windows it is a hidden glut window. Either way the frames are drawn into a framebuffer object
+// of the requested size, which stays bound for reading them back.
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "glew.h"
+#include <GL/gl.h>
+#include "glut.h"
+
+// freeglut_ext.h does not come with the project, these two are in freeglut.lib:
+// (C functions, like the rest of freeglut, or the linker looks for C++ names)
+#ifndef GLUT_CORE_PROFILE
+#define GLUT_CORE_PROFILE	0x0001
+#ifdef __cplusplus
+extern "C" {
+#endif
+FGAPI void FGAPIENTRY	glutInitContextVersion(int, int);
+FGAPI void FGAPIENTRY	glutInitContextProfile(int);
+#ifdef __cplusplus
+}
+#endif
+#endif
+
+class OffscreenRenderer
+{
+  private:
+	int		Width, Height;
+	GLuint	Fbo;
+	GLuint	ColorBuffer;
+	GLuint	DepthBuffer;
+#ifndef WIN32
+	EGLDisplay	Display;
+	EGLContext	Context;
+#endif
+
+	bool	CreateContext(bool);
+
+  public:
+		OffscreenRenderer();
+		~OffscreenRenderer();
+
+	void	Bind();
+	bool	Create(int, int, bool);
+	int		GetHeight() const;
+	int		GetWidth() const;
+};
+
+#endif		// #ifndef OFFSCREEN_H
@@ -1,31 +1,51 @@
-#version 330 compatibility
+#version 330 core
 
-in vec2				vST;			// texture coords
+in vec3				vMC;			// model coordinates
 
-uniform bool		isSecond;		// indicates if it's the second wheel
-uniform bool		isCorroded;		// if the shader is corroded
+// the same blocks as pattern.vert:
+layout(std140) uniform FrameBlock
+{
+	vec4	uLightPosition;		// eye coordinates
+	vec4	uEyePosition;		// eye coordinates
+	vec4	uSpecularColor;		// light color
+};
 
-uniform float		uKa, uKd, uKs;	// coefficients of each type of lighting -- make sum to 1.0
-uniform vec3		uColor;			// object color
-uniform vec3		uSpecularColor;	// light color
-uniform float		uShininess;		// specular exponent
+layout(std140) uniform MaterialBlock
+{
+	vec4	uColor;				// object color
+	float	uKa, uKd, uKs;		// coefficients of each type of lighting -- make sum to 1.0
+	float	uShininess;			// specular exponent
+	vec4	uCorrosionSeed;		// xyz: offset into the noise, so every gear and seed looks different
+	float	uCorrosionScale;	// noise cells per unit of length
+	float	uCorrosionDensity;	// noise level below which the metal is eaten away, 0. is clean, 1. is gone
+	float	uToothAngle;		// angle between instanced teeth
+	bool	isCorroded;			// if the gear is corroded, only ever set for the second wheel
+};
 
 in  vec3  vN;			// normal vector
 in  vec3  vL;			// vector from point to light
 in  vec3  vE;			// vector from point to eye
 
+out vec4  fFragColor;
+
+// in corrosion.frag, or in corrosiondepth.frag after a depth prepass:
+void	Corrode( vec3 mc );
+
 void
 main( )
 {
+	// corrosion only depends on where the fragment is on the gear, not on the mesh
+	Corrode( vMC );
+
 	vec3 Normal	= normalize(vN);
 	vec3 Light	= normalize(vL);
 	vec3 Eye	= normalize(vE);
 
 	// Adding per fragment lighting code
-	vec3 ambient = uKa * uColor;
+	vec3 ambient = uKa * uColor.rgb;
 
 	float d = max( dot(Normal,Light), 0. );	// only do diffuse if the light can see the point
-	vec3 diffuse = uKd * d * uColor;
+	vec3 diffuse = uKd * d * uColor.rgb;
 
 	float s = 0.;
 	if( dot(Normal,Light) > 0. )			// only do specular if the light can see the point
@@ -33,10 +53,6 @@ main( )
 		vec3 ref = normalize(  reflect( -Light, Normal )  );
 		s = pow( max( dot(Eye,ref),0. ), uShininess );
 	}
-	vec3 specular = uKs * s * uSpecularColor;
-	gl_FragColor = vec4( ambient + diffuse + specular,  1. );
-
-	if (isSecond && isCorroded) {
-		if( vST.s > 4. ) discard;
-	}
+	vec3 specular = uKs * s * uSpecularColor.rgb;
+	fFragColor = vec4( ambient + diffuse + specular,  1. );
 }
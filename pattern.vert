@@ -1,30 +1,66 @@
-#version 330 compatibility
+#version 330 core
 
-uniform float		xLight;
-uniform float		yLight;
-uniform float		zLight;
+// Runs in core and compatibility contexts alike: nothing comes from the fixed-function state,
+// the vertices come from the gear VAOs and the matrices from Matrix4 in sample.cpp.
+layout(location = 0) in vec3	aVertex;	// GEAR_VERTEX_ATTRIB in sample.cpp
+layout(location = 1) in vec3	aNormal;	// GEAR_NORMAL_ATTRIB in sample.cpp
+layout(location = 2) in mat4	aModel;		// GEAR_MODEL_ATTRIB in sample.cpp, one per instanced planet,
+											// the identity for everything else, a rotation and a translation
 
-out	vec2	vST;	// texture coords
+uniform mat4		uModelViewMatrix;
+uniform mat4		uProjectionMatrix;
+uniform mat4		uNormalMatrix;		// inverse transpose of the model-view, only its 3x3 is used
+
+// per-frame state, uploaded once per frame (binding FRAME_BLOCK_BINDING in sample.cpp):
+layout(std140) uniform FrameBlock
+{
+	vec4	uLightPosition;		// eye coordinates
+	vec4	uEyePosition;		// eye coordinates
+	vec4	uSpecularColor;		// light color
+};
+
+// per-gear state, one buffer per gear (binding MATERIAL_BLOCK_BINDING in sample.cpp):
+layout(std140) uniform MaterialBlock
+{
+	vec4	uColor;				// object color
+	float	uKa, uKd, uKs;		// coefficients of each type of lighting -- make sum to 1.0
+	float	uShininess;			// specular exponent
+	vec4	uCorrosionSeed;		// xyz: offset into the noise, so every gear and seed looks different
+	float	uCorrosionScale;	// noise cells per unit of length
+	float	uCorrosionDensity;	// noise level below which the metal is eaten away, 0. is clean, 1. is gone
+	float	uToothAngle;		// angle between instanced teeth
+	bool	isCorroded;			// if the gear is corroded
+};
+
+// the depth prepass and the shading pass after it link this same shader into different programs,
+// and the shading pass keeps the fragments whose depth is equal, so the positions must match exactly:
+invariant gl_Position;
+
+out	vec3	vMC;	// model coordinates, for the procedural corrosion
 
 out	vec3	vN;		// normal vector
 out	vec3	vL;		// vector from point to light
 out	vec3	vE;		// vector from point to eye
 
-vec3 LightPosition = vec3(xLight, yLight, zLight);
-
 void
 main( )
 {
-	vST = gl_MultiTexCoord0.st;
-	vec3 vert = gl_Vertex.xyz;
+	// Instanced teeth: rotate the tooth sector to its place around the gear axis
+	// (gl_InstanceID is 0 for everything that is not instanced, and instanced planets count their teeth
+	// on, whole turns apart)
+	float a = uToothAngle * float(gl_InstanceID);
+	mat2 rot = mat2( cos(a), sin(a), -sin(a), cos(a) );
+	vec3 vert = vec3( rot * aVertex.xy, aVertex.z );
+	vec3 norm = vec3( rot * aNormal.xy, aNormal.z );
+	vMC = vert;
 
 	// Per-fragment lighing
-	vec4 ECposition = gl_ModelViewMatrix * vec4( vert, 1. );
-	vN = normalize( gl_NormalMatrix * gl_Normal );	// normal vector
-	vL = LightPosition - ECposition.xyz;			// vector from the point
+	vec4 ECposition = uModelViewMatrix * ( aModel * vec4( vert, 1. ) );
+	vN = normalize( mat3( uNormalMatrix ) * ( mat3( aModel ) * norm ) );	// normal vector
+	vL = uLightPosition.xyz - ECposition.xyz;		// vector from the point
 													// to the light position
-	vE = vec3( 0., 0., 0. ) - ECposition.xyz;		// vector from the point
+	vE = uEyePosition.xyz - ECposition.xyz;			// vector from the point
 													// to the eye position
 
-	gl_Position = gl_ModelViewProjectionMatrix * vec4( vert, 1. );
+	gl_Position = uProjectionMatrix * ECposition;
 }
@@ -0,0 +1,226 @@
+#include "profiler.h"
+
+#include <algorithm>
+
+// names[0] ... names[numSections - 1] name the sections, their indices are the section numbers:
+Profiler::Profiler(int numSections, const char* const* names)
+{
+	if (numSections > PROFILER_MAX_SECTIONS) {
+		numSections = PROFILER_MAX_SECTIONS;
+	}
+	NumSections = numSections;
+	for (int i = 0; i < NumSections; i++) {
+		Sections[i].Name = names[i];
+		Sections[i].Gpu = false;
+		Sections[i].NumSamples = 0;
+		Sections[i].NextSample = 0;
+	}
+	for (int i = 0; i < PROFILER_QUERY_FRAMES; i++) {
+		QueryFrames[i].NumQueries = 0;
+		QueryFrames[i].FrameNumber = 0;
+	}
+	QueriesCreated = false;
+	Enabled = true;
+	FrameNumber = 0;
+	ActiveSection = -1;
+	NumDropped = 0;
+}
+
+void
+Profiler::AddCpuSample(int section, float ms)
+{
+	Sections[section].Gpu = false;
+	AddSample(section, ms, FrameNumber);
+}
+
+void
+Profiler::AddSample(int section, float ms, int frameNumber)
+{
+	Section& s = Sections[section];
+	s.Ms[s.NextSample] = ms;
+	s.FrameNumbers[s.NextSample] = frameNumber;
+	s.NextSample = (s.NextSample + 1) % PROFILER_SAMPLES;
+	if (s.NumSamples < PROFILER_SAMPLES) {
+		s.NumSamples++;
+	}
+}
+
+// starts a frame and reads the queries of PROFILER_QUERY_FRAMES frames ago, whose place it takes:
+// the queries are made here, at the first frame, when there surely is a context
+void
+Profiler::BeginFrame()
+{
+	if (!QueriesCreated) {
+		for (int i = 0; i < PROFILER_QUERY_FRAMES; i++) {
+			glGenQueries(PROFILER_MAX_QUERIES, QueryFrames[i].Queries);
+		}
+		QueriesCreated = true;
+	}
+
+	FrameNumber++;
+	QueryFrame& queryFrame = QueryFrames[FrameNumber % PROFILER_QUERY_FRAMES];
+	CollectQueries(queryFrame);
+	queryFrame.NumQueries = 0;
+	queryFrame.FrameNumber = FrameNumber;
+}
+
+// timer queries cannot nest, a pass inside another one is not timed by itself:
+void
+Profiler::BeginGpu(int section)
+{
+	QueryFrame& queryFrame = QueryFrames[FrameNumber % PROFILER_QUERY_FRAMES];
+	if (!QueriesCreated || !Enabled || ActiveSection >= 0 || queryFrame.NumQueries == PROFILER_MAX_QUERIES) {
+		return;
+	}
+	glBeginQuery(GL_TIME_ELAPSED, queryFrame.Queries[queryFrame.NumQueries]);
+	queryFrame.Sections[queryFrame.NumQueries] = section;
+	queryFrame.NumQueries++;
+	ActiveSection = section;
+}
+
+// waits for the GPU and reads every query still out, oldest frame first, at the end of a run:
+void
+Profiler::CollectAll()
+{
+	if (!QueriesCreated) {
+		return;
+	}
+	EndGpu();
+	glFinish();
+	for (int i = 1; i <= PROFILER_QUERY_FRAMES; i++) {
+		QueryFrame& queryFrame = QueryFrames[(FrameNumber + i) % PROFILER_QUERY_FRAMES];
+		CollectQueries(queryFrame);
+		queryFrame.NumQueries = 0;
+	}
+}
+
+// a section timed more than once in a frame gets one sample, the sum:
+void
+Profiler::CollectQueries(QueryFrame& queryFrame)
+{
+	float ms[PROFILER_MAX_SECTIONS];
+	bool timed[PROFILER_MAX_SECTIONS];
+	bool dropped[PROFILER_MAX_SECTIONS];
+	for (int i = 0; i < NumSections; i++) {
+		ms[i] = 0.f;
+		timed[i] = dropped[i] = false;
+	}
+
+	for (int i = 0; i < queryFrame.NumQueries; i++) {
+		int section = queryFrame.Sections[i];
+		GLint available = 0;
+		glGetQueryObjectiv(queryFrame.Queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			dropped[section] = true;
+			NumDropped++;
+			continue;
+		}
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(queryFrame.Queries[i], GL_QUERY_RESULT, &nanoseconds);
+		ms[section] += 1.e-6f * (float)nanoseconds;
+		timed[section] = true;
+	}
+
+	for (int i = 0; i < NumSections; i++) {
+		if (timed[i] && !dropped[i]) {
+			Sections[i].Gpu = true;
+			AddSample(i, ms[i], queryFrame.FrameNumber);
+		}
+	}
+}
+
+void
+Profiler::EndGpu()
+{
+	if (ActiveSection < 0) {
+		return;
+	}
+	glEndQuery(GL_TIME_ELAPSED);
+	ActiveSection = -1;
+}
+
+int
+Profiler::GetNumDropped() const
+{
+	return NumDropped;
+}
+
+int
+Profiler::GetNumSections() const
+{
+	return NumSections;
+}
+
+const char*
+Profiler::GetSectionName(int section) const
+{
+	return Sections[section].Name;
+}
+
+ProfileStats
+Profiler::GetStats(int section) const
+{
+	const Section& s = Sections[section];
+	ProfileStats stats;
+	stats.NumSamples = s.NumSamples;
+	stats.AverageMs = stats.P99Ms = stats.MaxMs = 0.f;
+	if (s.NumSamples == 0) {
+		return stats;
+	}
+
+	float sorted[PROFILER_SAMPLES];
+	float sum = 0.f;
+	for (int i = 0; i < s.NumSamples; i++) {
+		sorted[i] = s.Ms[i];
+		sum += s.Ms[i];
+	}
+	std::sort(sorted, sorted + s.NumSamples);
+	stats.AverageMs = sum / s.NumSamples;
+	stats.P99Ms = sorted[(99 * s.NumSamples + 99) / 100 - 1];
+	stats.MaxMs = sorted[s.NumSamples - 1];
+	return stats;
+}
+
+bool
+Profiler::IsGpuSection(int section) const
+{
+	return Sections[section].Gpu;
+}
+
+// GL_TIME_ELAPSED queries cannot nest, so the GPU passes are not timed while someone else has one running:
+void
+Profiler::SetEnabled(bool enabled)
+{
+	Enabled = enabled;
+}
+
+// one line per sample, oldest first within each section, which spreadsheets and pandas can pivot by frame:
+bool
+Profiler::WriteCsv(const char* file) const
+{
+	FILE* fp = fopen(file, "w");
+	if (fp == NULL) {
+		return false;
+	}
+	fprintf(fp, "frame,section,timer,ms\n");
+	for (int i = 0; i < NumSections; i++) {
+		const Section& s = Sections[i];
+		int first = (s.NextSample - s.NumSamples + PROFILER_SAMPLES) % PROFILER_SAMPLES;
+		for (int j = 0; j < s.NumSamples; j++) {
+			int sample = (first + j) % PROFILER_SAMPLES;
+			fprintf(fp, "%d,%s,%s,%.4f\n", s.FrameNumbers[sample], s.Name, s.Gpu ? "gpu" : "cpu", s.Ms[sample]);
+		}
+	}
+	return fclose(fp) == 0;
+}
+
+ScopedCpuTimer::ScopedCpuTimer(Profiler& owner, int section) : Owner(owner), Section(section)
+{
+	Start = std::chrono::steady_clock::now();
+}
+
+ScopedCpuTimer::~ScopedCpuTimer()
+{
+	float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - Start).count();
+	Owner.AddCpuSample(Section, ms);
+}
@@ -0,0 +1,102 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Where the frame time goes: GPU time of the render passes and CPU time of the callbacks, per section.
+// A GPU pass is timed by a GL_TIME_ELAPSED query between BeginGpu( ) and EndGpu( ). The queries of a frame
+// are only read PROFILER_QUERY_FRAMES frames later, when the GPU is long done with them, so reading them
+// never stalls; a result that is still not there is dropped rather than waited for.
+// CPU sections are timed by a ScopedCpuTimer around the code.
+// SetEnabled( false ) keeps the GPU passes out of the way of another timer query the caller runs.
+// Every section keeps the samples of its last PROFILER_SAMPLES frames for the statistics and the CSV file.
+
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+#include "glew.h"
+#include <GL/gl.h>
+
+#define PROFILER_MAX_SECTIONS	16
+#define PROFILER_QUERY_FRAMES	4		// frames a query result has to come back
+#define PROFILER_MAX_QUERIES	32		// GPU passes in one frame
+#define PROFILER_SAMPLES		240
+
+// the rolling statistics of one section:
+struct ProfileStats
+{
+	int		NumSamples;
+	float	AverageMs;
+	float	P99Ms;			// 99th percentile
+	float	MaxMs;
+};
+
+class Profiler
+{
+  private:
+	// the samples of a section, a ring of the last PROFILER_SAMPLES frames it ran in:
+	struct Section
+	{
+		const char*	Name;
+		bool	Gpu;
+		float	Ms[PROFILER_SAMPLES];
+		int		FrameNumbers[PROFILER_SAMPLES];
+		int		NumSamples;
+		int		NextSample;
+	};
+
+	// the queries one frame started:
+	struct QueryFrame
+	{
+		GLuint	Queries[PROFILER_MAX_QUERIES];
+		int		Sections[PROFILER_MAX_QUERIES];
+		int		NumQueries;
+		int		FrameNumber;
+	};
+
+	Section		Sections[PROFILER_MAX_SECTIONS];
+	int			NumSections;
+	QueryFrame	QueryFrames[PROFILER_QUERY_FRAMES];
+	bool		QueriesCreated;
+	bool		Enabled;
+	int			FrameNumber;
+	int			ActiveSection;		// the section of the running query, -1 when none is
+	int			NumDropped;			// query results that were not back in time
+
+	void	AddSample(int, float, int);
+	void	CollectQueries(QueryFrame&);
+
+  public:
+		Profiler(int, const char* const*);
+
+	void			AddCpuSample(int, float);
+	void			BeginFrame();
+	void			BeginGpu(int);
+	void			CollectAll();
+	void			EndGpu();
+	int				GetNumDropped() const;
+	int				GetNumSections() const;
+	const char*		GetSectionName(int) const;
+	ProfileStats	GetStats(int) const;
+	bool			IsGpuSection(int) const;
+	void			SetEnabled(bool);
+	bool			WriteCsv(const char*) const;
+};
+
+// times the CPU from its construction to the end of the scope:
+class ScopedCpuTimer
+{
+  private:
+	Profiler&	Owner;
+	int			Section;
+	std::chrono::steady_clock::time_point	Start;
+
+  public:
+		ScopedCpuTimer(Profiler&, int);
+		~ScopedCpuTimer();
+};
+
+#endif		// #ifndef PROFILER_H
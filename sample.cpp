@@ -15,8 +15,33 @@
 //		7. The program to quit
 //
 //	The "glslprogram.cpp" program, provided by Professor Mike Bailey, handles the shaders infrastructure.
+//	"matrix4.cpp" comes first, so glslprogram.cpp can set Matrix4 and Vec3 uniforms.
+#include "matrix4.cpp"
 #include "glslprogram.cpp"
 
+// The "gearmesh.cpp" program generates the gear geometry into plain memory, without an OpenGL context.
+#include "gearsimd.cpp"
+#include "workerpool.cpp"
+#include "gearmesh.cpp"
+#include "gearconfig.cpp"
+#include "geartrain.cpp"
+
+// The "gearcontact.cpp" program follows where the teeth of every meshing pair touch, frame by frame.
+#include "gearcontact.cpp"
+
+// The "framepacer.cpp" program decides when the next frame is due, so the program sleeps between frames.
+#include "framepacer.cpp"
+
+// The "offscreen.cpp" program gives an OpenGL context and a framebuffer without a window, for --headless.
+#include "offscreen.cpp"
+
+// The "framecapture.cpp" program reads the frames back asynchronously and writes them with "imagefile.cpp".
+#include "imagefile.cpp"
+#include "framecapture.cpp"
+
+// The "profiler.cpp" program times the render passes on the GPU and the callbacks on the CPU.
+#include "profiler.cpp"
+
 // window title:
 const char* WINDOWTITLE = "CS 550 Final Project -- Evgeny Ovechnikov";
 
@@ -60,6 +85,52 @@ enum Projections
 	PERSP
 };
 
+// what the gears menu and keys do:
+enum GearChanges
+{
+	SELECT_GEAR,
+	MORE_TEETH,
+	FEWER_TEETH,
+	MORE_ARMS,
+	FEWER_ARMS,
+	HIGHER_TEETH,
+	LOWER_TEETH,
+	RELOAD_CONFIG,
+	SAVE_CONFIG
+};
+
+// which gear render path:
+enum RenderModes
+{
+	DISPLAY_LISTS,
+	VERTEX_BUFFERS,
+	INSTANCED_TEETH
+};
+
+char* RenderModeNames[] =
+{
+	(char*)"Display Lists",
+	(char*)"Vertex Buffers",
+	(char*)"Instanced Teeth"
+};
+
+// how the corrosion holes are cut:
+// a discard anywhere in a fragment shader makes most GPUs test the depth only after running it, for
+// every fragment of the draw. The depth prepass first draws the corroded gears without color, with
+// nothing but the corrosion test, then shades all gears with a program that has no discard and keeps
+// only the fragments at the depth the prepass left, so hidden fragments never run the lighting.
+enum CorrosionModes
+{
+	CORROSION_DISCARD,
+	CORROSION_DEPTH_PREPASS
+};
+
+char* CorrosionModeNames[] =
+{
+	(char*)"Discard",
+	(char*)"Depth Prepass"
+};
+
 // which button:
 enum ButtonVals
 {
@@ -123,13 +194,14 @@ const GLfloat FOGEND = 4.f;
 
 // non-constant global variables:
 int		ActiveButton;			// current button that is down
-GLuint	AxesList;				// list to hold the axes
 bool	AxesOn;					// != 0 means to draw the axes
 int		DebugOn;				// != 0 means to print debugging info
 int		DepthCueOn;				// != 0 means to use intensity depth cueing
 int		DepthBufferOn;			// != 0 means to use the z-buffer
 int		DepthFightingOn;		// != 0 means to force the creation of z-fighting
 int		MainWindow;				// window id for main graphics window
+int		WindowWidth = INIT_WINDOW_SIZE;		// size of the window or the offscreen frames
+int		WindowHeight = INIT_WINDOW_SIZE;
 float	Scale;					// scaling factor
 int		WhichColor;				// index into Colors[ ]
 int		WhichProjection;		// ORTHO or PERSP
@@ -144,74 +216,351 @@ float	angle = 0;
 float	Time;
 bool	ControlLinesAreShown = false;
 
-GLuint	Gear1List;				// Gear 1 display list
-GLuint	Gear2List;				// Gear 2 display list
-GLuint	DebugLinesList;			// Debugging Lines display list
+int		WhichRenderMode = VERTEX_BUFFERS;	// DISPLAY_LISTS, VERTEX_BUFFERS or INSTANCED_TEETH
+int		WhichLod = -1;			// -1 picks the LOD from the size on the screen
+int		CurrentLod;				// LOD drawn in this frame
+
+// a gear uploaded once into static vertex/index buffer objects:
+struct GearBuffers
+{
+	GLuint	Vao;				// vertex array object holding the attribute setup
+	GLuint	Vbo;				// interleaved vertices
+	GLuint	Ibo;				// triangle strip indices
+	GLsizei	NumIndices;
+};
+
+// Levels of detail:
+// LOD 0 keeps every curve within GEAR_LOD_ERROR of the true shape, each further LOD allows 4 times more.
+// Display( ) draws the coarsest LOD whose error stays below LOD_PIXEL_ERROR pixels on the screen.
+#define NUM_GEAR_LODS		4
+#define GEAR_LOD_ERROR		0.0005
+#define LOD_PIXEL_ERROR		0.5
+
+// one level of detail of a gear in all render paths:
+struct GearLod
+{
+	GLuint		List;			// the full gear in a display list
+	GearBuffers	Whole;			// the full gear in one set of buffers
+	GearBuffers	Tooth;			// a single tooth sector, drawn once per tooth with instancing
+	GearBuffers	Hub;			// the hob and arms that go with the instanced teeth
+};
+
+// everything needed to draw one gear with any of the render paths:
+struct GearDrawable
+{
+	GearLod		Lods[NUM_GEAR_LODS];
+	int			NumTeeth;
+	float		ToothAngle;		// radians between two neighbouring teeth
+	bool		Built;
+	unsigned int	ParamHash;	// GearParams::Hash( ) of the parameters the meshes were made from
+};
+
+// gears with the same parameters share their meshes:
+std::vector<GearDrawable>	Drawables;		// one per different gear of the train
+std::vector<int>			DrawableOf;		// the drawable of each gear of the train, -1 when it has none
+
+// the model matrices of all gears of the train, uploaded every frame: the planets of a planetary set are drawn
+// as instances of one gear, and each instance reads its own matrix from here
+GLuint	GearModelVbo;
+
+// Helper geometry: the axes and the light marker share one static vertex buffer,
+// made again only when the gears change. Each part is a list of vertex ranges of one primitive type,
+// so it is drawn with one glMultiDrawArrays( ), and all of them in one pass with one VAO and one program.
+enum HelperPartNames
+{
+	HELPER_AXES,
+	HELPER_LIGHT,
+	NUM_HELPER_PARTS
+};
+
+struct HelperPart
+{
+	GLenum					Mode;
+	std::vector<GLint>		First;		// first vertex of each range
+	std::vector<GLsizei>	Count;		// vertices in each range
+};
+
+HelperPart			HelperParts[NUM_HELPER_PARTS];
+std::vector<Vec3>	HelperVertices;		// the buffer contents while they are made
+int		CurrentHelperPart;
+GLuint	HelperVao;
+GLuint	HelperVbo;
+
+// the light marker used to be glutSolidSphere(2.0, 180, 180) in immediate mode every frame:
+#define LIGHT_RADIUS	2.
+#define LIGHT_SLICES	24
+#define LIGHT_STACKS	12
+
+#define HELPER_VERTEX_ATTRIB	0
+
+// The contact points and lines of action move every frame, so they stream through a buffer of their own,
+// orphaned and filled again each frame, and drawn with the helper program:
+GearContacts	Contacts;
+GLuint	ContactVao;
+GLuint	ContactVbo;
 
 #define MS_PER_CYCLE	500000
 #define MS_SPEED		400
 
+// Frame pacing: instead of an idle callback that redraws as fast as it can, a glut timer wakes the program
+// when the next frame is due, and only while the gears animate or an input asked for a redraw.
+// In between, glutMainLoop( ) sleeps in the window system.
+#define DEFAULT_FPS		60.f
+
+FramePacer	Pacer(DEFAULT_FPS);
+float	TargetFps = DEFAULT_FPS;	// 0. means following the display refresh with vsync
+bool	FrameTimerArmed = false;	// a timer for the next frame is on its way
+
+// --headless draws a number of frames into an offscreen framebuffer, with no window and no glut,
+// and writes them to image files -- on a server with no display and no GPU too, through Mesa's llvmpipe.
+// The frames are WindowWidth x WindowHeight and HeadlessTimeStep seconds of animation apart.
+int		HeadlessFrames = 0;
+float	HeadlessTimeStep = 1.f / 60.f;
+
+// the headless frames, and the window's while the 'm' key has the capture on, go to CapturePrefix00000.png, ...
+FrameCapture	Capture;
+const char *	CapturePrefix = "frame";
+int		CaptureFormat = IMAGE_PNG;
+
+// what the profiler times: GPU passes first, then CPU sections
+enum ProfileSections
+{
+	PROFILE_AXES,
+	PROFILE_CONTACT_LINES,
+	PROFILE_LIGHT,
+	PROFILE_GEAR1,
+	PROFILE_OTHER_GEARS,
+	PROFILE_OVERLAY,
+	PROFILE_DISPLAY,
+	PROFILE_ANIMATE,
+	PROFILE_MESH,
+	PROFILE_CONTACTS,
+	NUM_PROFILE_SECTIONS
+};
+
+const char* ProfileSectionNames[] =
+{
+	"Axes",
+	"Contact lines",
+	"Light marker",
+	"Gear 1",
+	"Other gears",
+	"Overlay",
+	"Display",
+	"Animate",
+	"Mesh generation",
+	"Contacts"
+};
+
+Profiler	Profile(NUM_PROFILE_SECTIONS, ProfileSectionNames);
+bool	HudOn = false;					// the 'k' key shows the timing over the scene
+double	LastHudPrint = 0.;				// a core profile has no bitmap fonts, the HUD goes to stderr every second
+const char *	ProfileCsvFile = NULL;	// 'K' writes the timing here, or to profile.csv; --headless only with --profile-csv
+
 // Gear transmission input parameters
 #define GEAR_NUMTEETH1	23
 #define GEAR_NUMTEETH2	47
 #define GEAR_RADIUS1	10.
 #define GEAR_TEETH_HGT	2.
 #define GEAR_THICKNESS	2.
+#define GEAR_BACKLASH	0.
 #define GEAR_ARMS1		3
 #define GEAR_ARMS2		5
 
-#define GEAR_DUMMY_COEFFICIENT	0.35
-#define GEAR_GLOBAL_TOLERANCE	0.0000001
-
 #define GEAR_POLYGONS	20
 
+// the sizes shared by both gears, for GearGeometry<>:
+struct TransmissionDims
+{
+	static constexpr double RadiusPerTooth = GEAR_RADIUS1 / GEAR_NUMTEETH1;
+	static constexpr double TeethHeight = GEAR_TEETH_HGT;
+};
+
+// the levels of detail CreateGearDrawable( ) makes, for the compile time profiles of GearGeometry<>:
+struct GearLods
+{
+	static constexpr int Count = NUM_GEAR_LODS;
+	static constexpr float MaxError = GEAR_LOD_ERROR;
+	static constexpr float ErrorStep = 4.f;
+};
+
+typedef GearGeometry<GEAR_NUMTEETH1, TransmissionDims, GearLods>	Gear1Geometry;
+typedef GearGeometry<GEAR_NUMTEETH2, TransmissionDims, GearLods, GEAR_NUMTEETH1>	Gear2Geometry;
+
+// the transmission actually drawn: starts from the values above, then the config file,
+// the command line and the keyboard can change it
+const GearTrainConfig	DefaultConfig =
+{
+	{ GEAR_NUMTEETH1, GEAR_NUMTEETH2 },
+	{ GEAR_ARMS1, GEAR_ARMS2 },
+	GEAR_RADIUS1, GEAR_TEETH_HGT, GEAR_THICKNESS, GEAR_BACKLASH,
+	{},			// no gears past the two of the transmission
+	{}			// and no planetary sets
+};
+GearTrainConfig	Config = DefaultConfig;
+const char *	ConfigFile = "gears.cfg";
+int		SelectedGear = 0;		// gear the keyboard changes
+GearTrain	Train;				// where the gears of Config are and how they turn, gear 1 at (-radius1, 0, 0)
+
 // Parameters from Project 4
 #define ORBIT_HEIGHT	24.
 #define ORBIT_SLOWDOWN	4.
 
+// Mesh generation threads
+int		MeshThreads = 0;		// 0 means one per hardware thread
+int		BenchMeshThreads = -1;	// >= 0 runs the mesh generation benchmark instead of the program
+WorkerPool*	MeshWorkers;		// pool the gear meshes are generated on
+bool	BenchSimd = false;		// runs the profile sampling benchmark instead of the program
+bool	BenchContacts = false;	// runs the contact tracking benchmark instead of the program
+int		CheckTrainFrames = 0;	// > 0 checks the train of the config for overlapping teeth instead of the program
+unsigned int	CorrosionSeed = 0;	// the same seed makes the same corroded gear on every machine
+float	CorrosionScale = 3.;		// corrosion noise cells per unit of length
+float	CorrosionDensity = 0.45;	// noise level below which the metal is eaten away
+
 // Added for Shaders
-GLSLProgram* Pattern;
+// every gear program runs pattern.vert, they differ in the fragment shaders linked to it:
+enum GearShaderNames
+{
+	SHADER_DISCARD,			// pattern.frag + corrosion.frag, corrosion discards while shading
+	SHADER_EARLY_Z,			// pattern.frag + corrosiondepth.frag, the holes come from the depth prepass
+	SHADER_DEPTH_ONLY,		// depth.frag + corrosion.frag, the depth prepass of the corroded gears
+	NUM_GEAR_SHADERS
+};
+
+// a gear program and its matrices, which are plain uniforms resolved once after it is linked:
+struct GearShader
+{
+	GLSLProgram*	Program;
+	UniformHandle	ModelViewMatrix;
+	UniformHandle	ProjectionMatrix;
+	UniformHandle	NormalMatrix;
+};
+
+GearShader	GearShaders[NUM_GEAR_SHADERS];
+GearShader*	CurrentGearShader;				// the program DrawGear( ) sets the matrices of
+GLSLProgram* Helper;					// flat colored helper geometry
 bool IsCorroded = false;
+int		WhichCorrosionMode = CORROSION_DEPTH_PREPASS;
+bool	MeasureCorrosionRequested = false;	// Display( ) times every corrosion mode once
+
+// frames drawn for each corrosion mode by MeasureCorrosion( ):
+#define CORROSION_MEASURE_FRAMES	20
+
+// Shading state goes to pattern.vert/.frag in two std140 uniform blocks, each one buffer:
+// the frame block is uploaded once per frame, every gear has its own material block that is only
+// uploaded again when it changed, so drawing a gear is binding its block and drawing.
+// The layouts must match the blocks in the shaders, InitGraphics( ) checks the sizes.
+#define FRAME_BLOCK_BINDING		0
+#define MATERIAL_BLOCK_BINDING	1
+
+struct FrameBlock
+{
+	float	LightPosition[4];	// eye coordinates
+	float	EyePosition[4];		// eye coordinates
+	float	SpecularColor[4];	// light color
+};
+
+struct MaterialBlock
+{
+	float	Color[4];
+	float	Ka, Kd, Ks;
+	float	Shininess;
+	float	CorrosionSeed[4];	// xyz: offset into the corrosion noise
+	float	CorrosionScale;
+	float	CorrosionDensity;
+	float	ToothAngle;			// radians between instanced teeth
+	int		IsCorroded;			// a GLSL bool is 4 bytes in std140
+};
+
+GLuint			FrameUbo;
+std::vector<GLuint>			MaterialUbos;		// one per gear of the train
+std::vector<MaterialBlock>	Materials;			// what MaterialUbos hold right now
+
+// --core asks for a core profile context: no fixed-function pipeline, no display lists,
+// everything else is drawn exactly as in the compatibility profile.
+UniformHandle	HelperModelViewUniform;
+UniformHandle	HelperProjectionUniform;
+UniformHandle	HelperColorUniform;
+UniformHandle	HelperFogUniform;
+UniformHandle	HelperFogStartUniform;
+UniformHandle	HelperFogEndUniform;
+UniformHandle	HelperFogColorUniform;
+bool	CoreProfile = false;
+
+// vertex attributes of the gear meshes, the locations pattern.vert declares:
+#define GEAR_VERTEX_ATTRIB	0
+#define GEAR_NORMAL_ATTRIB	1
+#define GEAR_MODEL_ATTRIB	2		// a mat4, locations 2 to 5
 
 // function prototypes:
-void	Animate();
+void	Animate(int);
+void	ChangeConfig(const GearTrainConfig&);
+void	CreateHelperBuffers();
+void	CreateLightMarker(float, int, int);
 void	Display();
 void	DoAxesMenu(int);
 void	DoColorMenu(int);
+void	DoCorrosionMenu(int);
 void	DoDepthBufferMenu(int);
 void	DoDepthFightingMenu(int);
 void	DoDebugMenu(int);
+void	DoGearsMenu(int);
 void	DoDepthMenu(int);
+void	DoLodMenu(int);
 void	DoMainMenu(int);
 void	DoProjectMenu(int);
-void	DoRasterString(float, float, float, char*);
+void	DoRenderModeMenu(int);
+void	DoRasterString(float, float, float, char*, void* = GLUT_BITMAP_TIMES_ROMAN_24);
 void	DoStrokeString(float, float, float, float, char*);
+void	CreateGearShader(int, char*, char*, char*, char*);
+void	DrawContacts();
+void	DrawGear(int, const Matrix4&, const Matrix4*);
+void	DrawGears(const Matrix4&, const Matrix4&, int);
+void	DrawHelperPart(int);
+void	DrawHelpers(const Matrix4&, const Matrix4&, float, float, float);
+void	DrawHud(float);
+void	FormatContactLine(char*, size_t);
+void	FormatProfileLine(int, char*, size_t);
+void	DrawScene();
 float	ElapsedSeconds();
+float	GetAnimationTime(int);
+int		GetGearLod();
 void	InitGraphics();
 void	InitLists();
 void	InitMenus();
+void	InitShaders();
+bool	IsGearCorroded(int);
 void	Keyboard(unsigned char, int, int);
 void	MouseButton(int, int, int, int);
+void	MeasureCorrosion(const Matrix4&, const Matrix4&);
 void	MouseMotion(int, int);
+void	ParseCommandLine(int, char* []);
+bool	RenderHeadless();
 void	Reset();
+void	UpdateGears();
+void	UpdateMaterialBuffers(int);
+void	GetCorrosionSeed(int, float[4]);
+void	UpdateFrameBlock(float, float, float);
+void	UpdateMaterialBlock(int);
+void	UseGearShader(int, const Matrix4&);
 void	Resize(int, int);
+void	PostRedraw();
+void	PrintFrameStats();
+void	PrintProfile(FILE*);
+void	ScheduleFrame();
+bool	SetSwapInterval(int);
 void	Visibility(int);
 void	Axes(float);
+void	HelperBegin(int, GLenum);
+void	HelperVertex(float, float, float);
 
-struct point
-{
-	float x, y, z;		// coordinates
-	float nx, ny, nz;	// surface normal
-	float s, t;			// texture coords
-};
-
+// the same attributes the VAOs feed pattern.vert, attribute 0 last since it emits the vertex:
 inline
 void
 DrawPoint(struct point* p)
 {
-	glNormal3fv(&p->nx);
-	glTexCoord2fv(&p->s);
-	glVertex3fv(&p->x);
+	glVertexAttrib3fv(GEAR_NORMAL_ATTRIB, &p->nx);
+	glVertexAttrib3fv(GEAR_VERTEX_ATTRIB, &p->x);
 }
 
 // a multiplier and an array utility to create an array from:
@@ -226,647 +575,147 @@ MulArray3(float factor, float array0[3])
 	return array;
 }
 
-// Function to create gear display list
+// Function to create gear display list:
+// the display list only records the triangle strips of a mesh made by the GearMeshBuilder
 GLuint
-CreateGearDisplayList(int gNumTeeth, float gRadius, float gTeethHeight, float gThickness, int gArms, int gPolygons, bool gCorrosion) {
-	point* contactPoints = new point[gPolygons + 1];
-	point* smallCirclePoints = new point[gPolygons + 1];
-	point* bigCirclePoints = new point[gPolygons + 1];
-
-	// Calculating point on involute using binary search
-	float pAlpha = 0;
-	float qAlpha = M_PI / 2;
-	float tAlpha;
-	float xt;
-	float yt;
-	float rt;
-	do {
-		tAlpha = (pAlpha + qAlpha) / 2.;
-		xt = gRadius * (cos(tAlpha) + tAlpha * sin(tAlpha));
-		yt = gRadius * (sin(tAlpha) - tAlpha * cos(tAlpha));
-		rt = sqrt(xt * xt + yt * yt);
-		if (rt > gRadius + gTeethHeight) {
-			qAlpha = tAlpha;
-		}
-		else {
-			pAlpha = tAlpha;
-		}
-	} while (abs(rt - gRadius - gTeethHeight) > GEAR_GLOBAL_TOLERANCE);
-
-	float contactAlpha = atan(yt / xt);
-	float toothAngle = 2 * M_PI / gNumTeeth;
-	if (2 * contactAlpha > toothAngle) {
-		fprintf(stderr, "Incorrect Gear Parameters!\n");
-		return NULL;
-	}
-	float thetaBig = (toothAngle - 2 * contactAlpha) * GEAR_DUMMY_COEFFICIENT;
-	float thetaSmall = (toothAngle - 2 * contactAlpha) * (1 - GEAR_DUMMY_COEFFICIENT);
-
-	for (int i = 0; i <= gPolygons; i++) {
-		float c = i * tAlpha / gPolygons;
-		contactPoints[i].x = gRadius * (cos(c) + c * sin(c));
-		contactPoints[i].y = gRadius * (sin(c) - c * cos(c));
-		contactPoints[i].z = 0.;
-		contactPoints[i].nx = sin(c);
-		contactPoints[i].ny = -cos(c);
-		contactPoints[i].nz = 0.;
-		contactPoints[i].s = gCorrosion ? rand() % 10 : 0;
-	}
-
-	for (int i = 0; i <= gPolygons; i++) {
-		float cSmall = -thetaSmall / 2 + i * thetaSmall / gPolygons;
-		smallCirclePoints[i].x = gRadius * cos(cSmall);
-		smallCirclePoints[i].y = gRadius * sin(cSmall);
-		smallCirclePoints[i].z = 0.;
-		smallCirclePoints[i].nx = cos(cSmall);
-		smallCirclePoints[i].ny = sin(cSmall);
-		smallCirclePoints[i].nz = 0.;
-		smallCirclePoints[i].s = gCorrosion ? rand() % 10 : 0;
-
-		float cBig = thetaSmall / 2 + contactAlpha + i * thetaBig / gPolygons;
-		bigCirclePoints[i].x = (gRadius + gTeethHeight) * cos(cBig);
-		bigCirclePoints[i].y = (gRadius + gTeethHeight) * sin(cBig);
-		bigCirclePoints[i].z = 0.;
-		bigCirclePoints[i].nx = cos(cBig);
-		bigCirclePoints[i].ny = sin(cBig);
-		bigCirclePoints[i].nz = 0.;
-		bigCirclePoints[i].s = gCorrosion ? rand() % 10 : 0;
+CreateGearDisplayList(GearMesh& mesh) {
+	if (mesh.NumIndices() == 0 || CoreProfile) {
+		return 0;
 	}
 
 	// Gear Display List
 	GLuint dList = glGenLists(1);
 	glNewList(dList, GL_COMPILE);
-
-	// Let's draw the gear in 3D
-	point p0, p1;
-	for (float phi = 0; phi < 360; phi += 360. / gNumTeeth) {
-		glPushMatrix();
-		glRotatef(phi, 0., 0., 1.);
-
-		// Contact Surface left
-		glPushMatrix();
-		glRotatef(thetaSmall * 90 / M_PI, 0., 0., 1.);
-		glBegin(GL_QUAD_STRIP);
-		for (int i = 1; i <= gPolygons; i++) {
-			DrawPoint(&contactPoints[i]);
-			DrawPoint(&contactPoints[i - 1]);
-			for (int j = 0; j <= gPolygons; j++) {
-				p0 = contactPoints[i];
-				p0.z -= j * gThickness / gPolygons;
-				p0.s = gCorrosion ? rand() % 10 : 0;
-				p1 = contactPoints[i - 1];
-				p1.z -= j * gThickness / gPolygons;
-				p1.s = gCorrosion ? rand() % 10 : 0;
-				DrawPoint(&p0);
-				DrawPoint(&p1);
-			}
-		}
-		glEnd();
-		glPopMatrix();
-
-		// Contact Surface right
-		glPushMatrix();
-		glRotatef(180., 1., 0., 0.);
-		glRotatef(thetaSmall * 90 / M_PI, 0., 0., 1.);
-		glBegin(GL_QUAD_STRIP);
-		for (int i = 1; i <= gPolygons; i++) {
-			DrawPoint(&contactPoints[i]);
-			DrawPoint(&contactPoints[i - 1]);
-			for (int j = 0; j <= gPolygons; j++) {
-				p0 = contactPoints[i];
-				p0.z += j * gThickness / gPolygons;
-				p0.s = gCorrosion ? rand() % 10 : 0;
-				p1 = contactPoints[i - 1];
-				p1.z += j * gThickness / gPolygons;
-				p1.s = gCorrosion ? rand() % 10 : 0;
-				DrawPoint(&p0);
-				DrawPoint(&p1);
-			}
-		}
-		glEnd();
-		glPopMatrix();
-
-		// Outer and Inner tooth radiuses
-		glPushMatrix();
-		glBegin(GL_QUAD_STRIP);
-		for (int i = 1; i <= gPolygons; i++) {
-			DrawPoint(&smallCirclePoints[i]);
-			DrawPoint(&smallCirclePoints[i - 1]);
-			for (int j = 0; j <= gPolygons; j++) {
-				p0 = smallCirclePoints[i];
-				p0.z -= j * gThickness / gPolygons;
-				p0.s = gCorrosion ? rand() % 10 : 0;
-				p1 = smallCirclePoints[i - 1];
-				p1.z -= j * gThickness / gPolygons;
-				p1.s = gCorrosion ? rand() % 10 : 0;
-				DrawPoint(&p0);
-				DrawPoint(&p1);
-			}
-		}
-		glEnd();
-		glBegin(GL_QUAD_STRIP);
-		for (int i = 1; i <= gPolygons; i++) {
-			DrawPoint(&bigCirclePoints[i]);
-			DrawPoint(&bigCirclePoints[i - 1]);
-			for (int j = 0; j <= gPolygons; j++) {
-				p0 = bigCirclePoints[i];
-				p0.z -= j * gThickness / gPolygons;
-				p0.s = gCorrosion ? rand() % 10 : 0;
-				p1 = bigCirclePoints[i - 1];
-				p1.z -= j * gThickness / gPolygons;
-				p1.s = gCorrosion ? rand() % 10 : 0;
-				DrawPoint(&p0);
-				DrawPoint(&p1);
-			}
-		}
-		glEnd();
-		glPopMatrix();
-
-		// Filling Teeth Surfaces
-		for (float zNorm = 1.; zNorm >= -1.; zNorm -= 2.) {
-			glPushMatrix();
-			glRotatef(thetaSmall * 90 / M_PI, 0., 0., 1.);
-			glBegin(GL_QUAD_STRIP);
-
-			for (int i = 0; i < gPolygons; i++) {	// contactPoints loop
-				float tempR = sqrt(contactPoints[i].x * contactPoints[i].x + contactPoints[i].y * contactPoints[i].y);
-				float tempR1 = sqrt(contactPoints[i + 1].x * contactPoints[i + 1].x + contactPoints[i + 1].y * contactPoints[i + 1].y);
-				float phi0R = atan(contactPoints[i].y / contactPoints[i].x);
-				float phi1R = 2 * contactAlpha + thetaBig - phi0R;
-				float phi0R1 = atan(contactPoints[i + 1].y / contactPoints[i + 1].x);
-				float phi1R1 = 2 * contactAlpha + thetaBig - phi0R1;
-
-				for (int j = 0; j <= gPolygons; j++) {
-					p0.x = tempR * cos(phi0R + j * (phi1R - phi0R) / gPolygons);
-					p0.y = tempR * sin(phi0R + j * (phi1R - phi0R) / gPolygons);
-					p0.z = (zNorm == 1.) ? 0. : -gThickness;
-					p0.nx = 0.;
-					p0.ny = 0.;
-					p0.nz = zNorm;
-					p0.s = gCorrosion ? rand() % 10 : 0;
-
-					p1.x = tempR1 * cos(phi0R1 + j * (phi1R1 - phi0R1) / gPolygons);
-					p1.y = tempR1 * sin(phi0R1 + j * (phi1R1 - phi0R1) / gPolygons);
-					p1.z = (zNorm == 1.) ? 0. : -gThickness;
-					p1.nx = 0.;
-					p1.ny = 0.;
-					p1.nz = zNorm;
-					p1.s = gCorrosion ? rand() % 10 : 0;
-
-					DrawPoint(&p0);
-					DrawPoint(&p1);
-				}
-			}
+	glBegin(GL_TRIANGLE_STRIP);
+	for (int i = 0; i < mesh.NumIndices(); i++) {
+		if (mesh.Indices[i] == GEAR_MESH_RESTART) {
 			glEnd();
-			glPopMatrix();
+			glBegin(GL_TRIANGLE_STRIP);
 		}
-
-		// Drawing rim
-		for (float zNorm = 1.; zNorm >= -1.; zNorm -= 2.) {
-			glPushMatrix();
-			glRotatef(thetaSmall * 90 / M_PI, 0., 0., 1.);
-
-			for (int i = 0; i < gPolygons; i++) {
-				glBegin(GL_QUAD_STRIP);
-				float tempR = gRadius - i * 0.2 / gPolygons * gRadius;
-				float tempRNext = gRadius - (i + 1) * 0.2 / gPolygons * gRadius;
-				float phi0R = 0;
-				float phi1R = 2 * contactAlpha + thetaBig;
-
-				for (int j = 0; j <= gPolygons; j++) {
-					p0.x = tempR * cos(phi0R + j * (phi1R - phi0R) / gPolygons);
-					p0.y = tempR * sin(phi0R + j * (phi1R - phi0R) / gPolygons);
-					p0.z = (zNorm == 1.) ? 0. : -gThickness;
-					p0.nx = 0.;
-					p0.ny = 0.;
-					p0.nz = zNorm;
-					p0.s = gCorrosion ? rand() % 10 : 0;
-
-					p1.x = tempRNext * cos(phi0R + j * (phi1R - phi0R) / gPolygons);
-					p1.y = tempRNext * sin(phi0R + j * (phi1R - phi0R) / gPolygons);
-					p1.z = (zNorm == 1.) ? 0. : -gThickness;
-					p1.nx = 0.;
-					p1.ny = 0.;
-					p1.nz = zNorm;
-					p1.s = gCorrosion ? rand() % 10 : 0;
-
-					DrawPoint(&p0);
-					DrawPoint(&p1);
-				}
-				glEnd();
-			}
-
-			for (int i = 0; i < gPolygons; i++) {
-				glBegin(GL_QUAD_STRIP);
-				float tempR = gRadius - i * 0.2 / gPolygons * gRadius;
-				float tempRNext = gRadius - (i + 1) * 0.2 / gPolygons * gRadius;
-				float phi0R = -thetaSmall;
-				float phi1R = 0.;
-
-				for (int j = 0; j <= gPolygons; j++) {
-					p0.x = tempR * cos(phi0R + j * (phi1R - phi0R) / gPolygons);
-					p0.y = tempR * sin(phi0R + j * (phi1R - phi0R) / gPolygons);
-					p0.z = (zNorm == 1.) ? 0. : -gThickness;
-					p0.nx = 0.;
-					p0.ny = 0.;
-					p0.nz = zNorm;
-					p0.s = gCorrosion ? rand() % 10 : 0;
-
-					p1.x = tempRNext * cos(phi0R + j * (phi1R - phi0R) / gPolygons);
-					p1.y = tempRNext * sin(phi0R + j * (phi1R - phi0R) / gPolygons);
-					p1.z = (zNorm == 1.) ? 0. : -gThickness;
-					p1.nx = 0.;
-					p1.ny = 0.;
-					p1.nz = zNorm;
-					p1.s = gCorrosion ? rand() % 10 : 0;
-
-					DrawPoint(&p0);
-					DrawPoint(&p1);
-				}
-				glEnd();
-			}
-			glPopMatrix();
+		else {
+			DrawPoint(&mesh.Vertices[mesh.Indices[i]]);
 		}
+	}
+	glEnd();
+	glEndList();
 
-		// Filling inner radius, 1st part
-		glPushMatrix();
-		glRotatef(thetaSmall * 90 / M_PI, 0., 0., 1.);
-		float tempR = 0.8 * gRadius;
-		float phi0R = 0;
-		float phi1R = 2 * contactAlpha + thetaBig;
-
-		for (int i = 1; i <= gPolygons; i++) {
-			p0.x = tempR * cos(phi0R + (i - 1) * (phi1R - phi0R) / gPolygons);
-			p0.y = tempR * sin(phi0R + (i - 1) * (phi1R - phi0R) / gPolygons);
-			p0.z = 0.;
-			p0.nx = -cos(phi0R + (i - 1) * (phi1R - phi0R) / gPolygons);
-			p0.ny = -sin(phi0R + (i - 1) * (phi1R - phi0R) / gPolygons);
-			p0.nz = 0.;
-			p0.s = gCorrosion ? rand() % 10 : 0;
-
-			p1.x = tempR * cos(phi0R + (i) * (phi1R - phi0R) / gPolygons);
-			p1.y = tempR * sin(phi0R + (i) * (phi1R - phi0R) / gPolygons);
-			p1.z = 0.;
-			p1.nx = -cos(phi0R + (i) * (phi1R - phi0R) / gPolygons);
-			p1.ny = -sin(phi0R + (i) * (phi1R - phi0R) / gPolygons);
-			p1.nz = 0.;
-			p1.s = gCorrosion ? rand() % 10 : 0;
-
-			glBegin(GL_QUAD_STRIP);
-			DrawPoint(&p0);
-			DrawPoint(&p1);
-			for (int j = 1; j <= gPolygons; j++) {
-				p0.z -= gThickness / gPolygons;
-				p0.s = gCorrosion ? rand() % 10 : 0;
-				p1.z -= gThickness / gPolygons;
-				p1.s = gCorrosion ? rand() % 10 : 0;
-				DrawPoint(&p0);
-				DrawPoint(&p1);
-			}
-			glEnd();
-		}
-		glPopMatrix();
-
-		// Filling inner radius, 2nd part
-		glPushMatrix();
-		glRotatef(thetaSmall * 90 / M_PI, 0., 0., 1.);
-		phi0R = -thetaSmall;
-		phi1R = 0.;
-
-		for (int i = 1; i <= gPolygons; i++) {
-			p0.x = tempR * cos(phi0R + (i - 1) * (phi1R - phi0R) / gPolygons);
-			p0.y = tempR * sin(phi0R + (i - 1) * (phi1R - phi0R) / gPolygons);
-			p0.z = 0.;
-			p0.nx = -cos(phi0R + (i - 1) * (phi1R - phi0R) / gPolygons);
-			p0.ny = -sin(phi0R + (i - 1) * (phi1R - phi0R) / gPolygons);
-			p0.nz = 0.;
-			p0.s = gCorrosion ? rand() % 10 : 0;
-
-			p1.x = tempR * cos(phi0R + (i) * (phi1R - phi0R) / gPolygons);
-			p1.y = tempR * sin(phi0R + (i) * (phi1R - phi0R) / gPolygons);
-			p1.z = 0.;
-			p1.nx = -cos(phi0R + (i) * (phi1R - phi0R) / gPolygons);
-			p1.ny = -sin(phi0R + (i) * (phi1R - phi0R) / gPolygons);
-			p1.nz = 0.;
-			p1.s = gCorrosion ? rand() % 10 : 0;
-
-			glBegin(GL_QUAD_STRIP);
-			DrawPoint(&p0);
-			DrawPoint(&p1);
-			for (int j = 1; j <= gPolygons; j++) {
-				p0.z -= gThickness / gPolygons;
-				p0.s = gCorrosion ? rand() % 10 : 0;
-				p1.z -= gThickness / gPolygons;
-				p1.s = gCorrosion ? rand() % 10 : 0;
-				DrawPoint(&p0);
-				DrawPoint(&p1);
-			}
-			glEnd();
-		}
-		glPopMatrix();
+	return dList;
+}
 
-		glPopMatrix();
+// Function to upload a gear mesh into static vertex/index buffer objects:
+// the VAO keeps the client array setup, so drawing is a bind and a glDrawElements( )
+GearBuffers
+CreateGearBuffers(GearMesh& mesh) {
+	GearBuffers buffers = { 0, 0, 0, 0 };
+	if (mesh.NumIndices() == 0) {
+		return buffers;
 	}
 
-	// Drawing hob
-	glPushMatrix();
-	for (double phi = 1; phi <= 360; phi++) {
-		// outer circle
-		p0.x = gRadius * 0.2 * cos((phi - 1) * M_PI / 180);
-		p0.y = gRadius * 0.2 * sin((phi - 1) * M_PI / 180);
-		p0.z = 0.;
-		p0.nx = cos((phi - 1) * M_PI / 180);
-		p0.ny = sin((phi - 1) * M_PI / 180);
-		p0.nz = 0.;
-		p0.s = gCorrosion ? rand() % 10 : 0;
-
-		p1.x = gRadius * 0.2 * cos((phi)*M_PI / 180);
-		p1.y = gRadius * 0.2 * sin((phi)*M_PI / 180);
-		p1.z = 0.;
-		p1.nx = cos((phi)*M_PI / 180);
-		p1.ny = sin((phi)*M_PI / 180);
-		p1.nz = 0.;
-		p1.s = gCorrosion ? rand() % 10 : 0;
-
-		glBegin(GL_QUAD_STRIP);
-
-		DrawPoint(&p0);
-		DrawPoint(&p1);
-
-		for (int j = 1; j <= gPolygons; j++) {
-			p0.z -= gThickness / gPolygons;
-			p0.s = gCorrosion ? rand() % 10 : 0;
-			p1.z -= gThickness / gPolygons;
-			p1.s = gCorrosion ? rand() % 10 : 0;
-			DrawPoint(&p0);
-			DrawPoint(&p1);
-		}
-		glEnd();
-
-		// inner circle
-		p0.x = gRadius * 0.1 * cos((phi - 1) * M_PI / 180);
-		p0.y = gRadius * 0.1 * sin((phi - 1) * M_PI / 180);
-		p0.z = 0.;
-		p0.nx = -cos((phi - 1) * M_PI / 180);
-		p0.ny = -sin((phi - 1) * M_PI / 180);
-		p0.nz = 0.;
-		p0.s = gCorrosion ? rand() % 10 : 0;
-
-		p1.x = gRadius * 0.1 * cos((phi)*M_PI / 180);
-		p1.y = gRadius * 0.1 * sin((phi)*M_PI / 180);
-		p1.z = 0.;
-		p1.nx = -cos((phi)*M_PI / 180);
-		p1.ny = -sin((phi)*M_PI / 180);
-		p1.nz = 0.;
-		p1.s = gCorrosion ? rand() % 10 : 0;
-
-		glBegin(GL_QUAD_STRIP);
-
-		DrawPoint(&p0);
-		DrawPoint(&p1);
-
-		for (int j = 1; j <= gPolygons; j++) {
-			p0.z -= gThickness / gPolygons;
-			p0.s = gCorrosion ? rand() % 10 : 0;
-			p1.z -= gThickness / gPolygons;
-			p1.s = gCorrosion ? rand() % 10 : 0;
-			DrawPoint(&p0);
-			DrawPoint(&p1);
-		}
-		glEnd();
-
-		// filling top surface
-		glBegin(GL_QUAD_STRIP);
-		for (int j = 0; j <= gPolygons; j++) {
-			p0.x = gRadius * (0.2 - 0.1 * j / gPolygons) * cos((phi - 1) * M_PI / 180);
-			p0.y = gRadius * (0.2 - 0.1 * j / gPolygons) * sin((phi - 1) * M_PI / 180);
-			p0.z = 0.;
-			p0.nx = 0.;
-			p0.ny = 0.;
-			p0.nz = 1.;
-			p0.s = gCorrosion ? rand() % 10 : 0;
-
-			p1.x = gRadius * (0.2 - 0.1 * j / gPolygons) * cos((phi) * M_PI / 180);
-			p1.y = gRadius * (0.2 - 0.1 * j / gPolygons) * sin((phi) * M_PI / 180);
-			p1.z = 0.;
-			p1.nx = 0.;
-			p1.ny = 0.;
-			p1.nz = 1.;
-			p1.s = gCorrosion ? rand() % 10 : 0;
-
-			DrawPoint(&p0);
-			DrawPoint(&p1);
-		}
-		glEnd();
-
-		// filling bottom surface
-		glBegin(GL_QUAD_STRIP);
-		for (int j = 0; j <= gPolygons; j++) {
-			p0.x = gRadius * (0.2 - 0.1 * j / gPolygons) * cos((phi - 1) * M_PI / 180);
-			p0.y = gRadius * (0.2 - 0.1 * j / gPolygons) * sin((phi - 1) * M_PI / 180);
-			p0.z = -gThickness;
-			p0.nx = 0.;
-			p0.ny = 0.;
-			p0.nz = -1.;
-			p0.s = gCorrosion ? rand() % 10 : 0;
-
-			p1.x = gRadius * (0.2 - 0.1 * j / gPolygons) * cos((phi) * M_PI / 180);
-			p1.y = gRadius * (0.2 - 0.1 * j / gPolygons) * sin((phi) * M_PI / 180);
-			p1.z = -gThickness;
-			p1.nx = 0.;
-			p1.ny = 0.;
-			p1.nz = -1.;
-			p1.s = gCorrosion ? rand() % 10 : 0;
-
-			DrawPoint(&p0);
-			DrawPoint(&p1);
-		}
-		glEnd();
-	}
-	glPopMatrix();
+	glGenVertexArrays(1, &buffers.Vao);
+	glBindVertexArray(buffers.Vao);
 
-	// Drawing arms of Wheel
-	for (float phi = 0; phi < 360; phi += 360. / gArms) {
-		glPushMatrix();
-		if (Freeze) {
-			glRotatef(phi, 0., 0., 1.);
-		}
-		else {
-			glRotatef(phi + 2 * M_PI * Time, 0., 0., 1.);
-		}
+	glGenBuffers(1, &buffers.Vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers.Vbo);
+	glBufferData(GL_ARRAY_BUFFER, mesh.Vertices.size() * sizeof(point), &mesh.Vertices[0], GL_STATIC_DRAW);
 
-		float phi0p0 = asin(0.05 / 0.2);
-		float phi1p0 = -phi0p0;
-		float phi0p1 = asin(0.05 / 0.8);
-		float phi1p1 = -phi0p1;
-
-		for (int i = 1; i <= gPolygons; i++) {
-			float phip0 = phi1p0 + i * (phi0p0 - phi1p0) / gPolygons;
-			float phip1 = phi1p1 + i * (phi0p1 - phi1p1) / gPolygons;
-			float phip0prev = phi1p0 + (i - 1) * (phi0p0 - phi1p0) / gPolygons;
-			float phip1prev = phi1p1 + (i - 1) * (phi0p1 - phi1p1) / gPolygons;
-			float xp0 = 0.2 * gRadius * cos(phip0);
-			float yp0 = 0.2 * gRadius * sin(phip0);
-			float xp0prev = 0.2 * gRadius * cos(phip0prev);
-			float yp0prev = 0.2 * gRadius * sin(phip0prev);
-			float xp1 = 0.8 * gRadius * cos(phip1);
-			float xp1prev = 0.8 * gRadius * cos(phip1prev);
-
-			// Drawing top surface
-			p0.x = xp0prev;
-			p0.y = yp0prev;
-			p0.z = 0.;
-			p0.nx = 0.;
-			p0.ny = 0.;
-			p0.nz = 1.;
-			p0.s = gCorrosion ? rand() % 10 : 0;
-
-			p1.x = xp0;
-			p1.y = yp0;
-			p1.z = 0.;
-			p1.nx = 0.;
-			p1.ny = 0.;
-			p1.nz = 1.;
-			p1.s = gCorrosion ? rand() % 10 : 0;
-
-			glBegin(GL_QUAD_STRIP);
-
-			DrawPoint(&p0);
-			DrawPoint(&p1);
-
-			for (int j = 1; j <= gPolygons; j++) {
-				p0.x += (xp1prev - xp0prev) / gPolygons;
-				p0.s = gCorrosion ? rand() % 10 : 0;
-				p1.x += (xp1 - xp0) / gPolygons;
-				p1.s = gCorrosion ? rand() % 10 : 0;
-				DrawPoint(&p0);
-				DrawPoint(&p1);
-			}
-			glEnd();
+	glGenBuffers(1, &buffers.Ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.Ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.Indices.size() * sizeof(unsigned int), &mesh.Indices[0], GL_STATIC_DRAW);
+	buffers.NumIndices = mesh.NumIndices();
 
-			// Drawing bot surface
-			p0.x = xp0prev;
-			p0.y = yp0prev;
-			p0.z = -gThickness;
-			p0.nx = 0.;
-			p0.ny = 0.;
-			p0.nz = -1.;
-			p0.s = gCorrosion ? rand() % 10 : 0;
-
-			p1.x = xp0;
-			p1.y = yp0;
-			p1.z = -gThickness;
-			p1.nx = 0.;
-			p1.ny = 0.;
-			p1.nz = -1.;
-			p1.s = gCorrosion ? rand() % 10 : 0;
-
-			glBegin(GL_QUAD_STRIP);
-
-			DrawPoint(&p0);
-			DrawPoint(&p1);
-
-			for (int j = 1; j <= gPolygons; j++) {
-				p0.x += (xp1prev - xp0prev) / gPolygons;
-				p0.s = gCorrosion ? rand() % 10 : 0;
-				p1.x += (xp1 - xp0) / gPolygons;
-				p1.s = gCorrosion ? rand() % 10 : 0;
-				DrawPoint(&p0);
-				DrawPoint(&p1);
-			}
-			glEnd();
-		}
+	glEnableVertexAttribArray(GEAR_VERTEX_ATTRIB);
+	glVertexAttribPointer(GEAR_VERTEX_ATTRIB, 3, GL_FLOAT, GL_FALSE, sizeof(point), (GLvoid*)offsetof(point, x));
+	glEnableVertexAttribArray(GEAR_NORMAL_ATTRIB);
+	glVertexAttribPointer(GEAR_NORMAL_ATTRIB, 3, GL_FLOAT, GL_FALSE, sizeof(point), (GLvoid*)offsetof(point, nx));
 
-		for (int i = 1; i <= gPolygons; i++) {
-			float xp0 = 0.2 * gRadius * cos(phi0p0);
-			float yp0 = 0.2 * gRadius * sin(phi0p0);
-			float xp1 = 0.8 * gRadius * cos(phi0p1);
-
-			// Drawing top surface
-			p0.x = xp0;
-			p0.y = yp0;
-			p0.z = -(i - 1) * gThickness / gPolygons;
-			p0.nx = 0.;
-			p0.ny = 1.;
-			p0.nz = 0.;
-			p0.s = gCorrosion ? rand() % 10 : 0;
-
-			p1.x = xp0;
-			p1.y = yp0;
-			p1.z = -i * gThickness / gPolygons;
-			p1.nx = 0.;
-			p1.ny = 1.;
-			p1.nz = 0.;
-			p1.s = gCorrosion ? rand() % 10 : 0;
-
-			glBegin(GL_QUAD_STRIP);
-
-			DrawPoint(&p0);
-			DrawPoint(&p1);
-
-			for (int j = 1; j <= gPolygons; j++) {
-				p0.x += (xp1 - xp0) / gPolygons;
-				p0.s = gCorrosion ? rand() % 10 : 0;
-				p1.x += (xp1 - xp0) / gPolygons;
-				p1.s = gCorrosion ? rand() % 10 : 0;
-				DrawPoint(&p0);
-				DrawPoint(&p1);
-			}
-			glEnd();
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	CheckGlErrors("CreateGearBuffers");
 
-			// Drawing bot surface
-			p0.x = xp0;
-			p0.y = -yp0;
-			p0.z = -(i - 1) * gThickness / gPolygons;
-			p0.nx = 0.;
-			p0.ny = -1.;
-			p0.nz = 0.;
-			p0.s = gCorrosion ? rand() % 10 : 0;
-
-			p1.x = xp0;
-			p1.y = -yp0;
-			p1.z = -i * gThickness / gPolygons;
-			p1.nx = 0.;
-			p1.ny = -1.;
-			p1.nz = 0.;
-			p1.s = gCorrosion ? rand() % 10 : 0;
-
-			glBegin(GL_QUAD_STRIP);
-
-			DrawPoint(&p0);
-			DrawPoint(&p1);
-
-			for (int j = 1; j <= gPolygons; j++) {
-				p0.x += (xp1 - xp0) / gPolygons;
-				p0.s = gCorrosion ? rand() % 10 : 0;
-				p1.x += (xp1 - xp0) / gPolygons;
-				p1.s = gCorrosion ? rand() % 10 : 0;
-				DrawPoint(&p0);
-				DrawPoint(&p1);
-			}
-			glEnd();
-		}
+	return buffers;
+}
 
-		glPopMatrix();
+// Function to create a gear in every render path and level of detail:
+// the whole gear goes into a display list and a set of buffers, the instanced path keeps
+// only one tooth sector and the hub, so its memory does not depend on the number of teeth
+GearDrawable
+CreateGearDrawable(GearMeshBuilder builder, const char* name) {
+	GearDrawable gear;
+	GearMesh mesh;
+
+	float maxError = GearLods::MaxError;
+	for (int lod = 0; lod < NUM_GEAR_LODS; lod++) {
+		GearLod& gearLod = gear.Lods[lod];
+		builder.SetTessellation(builder.MakeTessellation(maxError));
+		maxError *= GearLods::ErrorStep;
+
+		char lodName[64];
+		sprintf(lodName, "%s LOD %d", name, lod);
+		builder.Build(mesh, MeshWorkers);
+		mesh.PrintStats(lodName);
+		gearLod.List = CreateGearDisplayList(mesh);
+		gearLod.Whole = CreateGearBuffers(mesh);
+
+		builder.BuildToothSector(mesh, MeshWorkers);
+		mesh.PrintStats("  instanced tooth sector");
+		gearLod.Tooth = CreateGearBuffers(mesh);
+
+		builder.BuildHub(mesh, MeshWorkers);
+		mesh.PrintStats("  instanced hub");
+		gearLod.Hub = CreateGearBuffers(mesh);
 	}
-	// End of Gear List
-	glEndList();
-
-	delete[] contactPoints;
-	delete[] smallCirclePoints;
-	delete[] bigCirclePoints;
 
-	return dList;
+	gear.NumTeeth = builder.GetNumTeeth();
+	gear.ToothAngle = builder.GetToothAngle();
+	return gear;
 }
 
 // main program:
 int
 main(int argc, char* argv[])
 {
+	// our own options all start with "--", glut ignores them:
+	// (the mesh benchmark runs without a window, so this happens before glut opens a display)
+	ParseCommandLine(argc, argv);
+	if (!Config.IsValid())
+	{
+		fprintf(stderr, "Incorrect Gear Parameters! Using the built-in transmission.\n");
+		Config = DefaultConfig;
+	}
+	if (BenchMeshThreads >= 0)
+	{
+		BenchmarkGearMeshBuilder(BenchMeshThreads);
+		return 0;
+	}
+	if (BenchSimd)
+	{
+		BenchmarkGearSimd();
+		return 0;
+	}
+	if (BenchContacts)
+	{
+		BenchmarkGearContacts();
+		return 0;
+	}
+	if (CheckTrainFrames > 0)
+	{
+		return CheckGearTrain(Config, CheckTrainFrames) ? 0 : 1;
+	}
+	if (HeadlessFrames > 0)
+	{
+		return RenderHeadless() ? 0 : 1;
+	}
+
 	// turn on the glut package:
 	// (do this before checking argc and argv since it might
 	// pull some command line arguments out)
 	glutInit(&argc, argv);
+	if (CoreProfile)
+	{
+		glutInitContextVersion(3, 3);
+		glutInitContextProfile(GLUT_CORE_PROFILE);
+	}
 
 	// setup all the graphics stuff:
 	InitGraphics();
@@ -892,24 +741,66 @@ main(int argc, char* argv[])
 }
 
 
-// this is where one would put code that is to be called
-// everytime the glut main loop has nothing to do
+// the frame timer ScheduleFrame( ) arms:
 //
-// this is typically where animation parameters are set
+// this is where the animation parameters are set
 //
 // do not call Display( ) from here -- let glutPostRedisplay( ) do it
 void
-Animate()
+Animate(int)
 {
+	ScopedCpuTimer timer(Profile, PROFILE_ANIMATE);
+	FrameTimerArmed = false;
+	if (!Pacer.WantsFrame())
+	{
+		return;
+	}
+
+	// glut timers only have milliseconds, so a timer that came early waits for the rest:
+	if (Pacer.GetSecondsToNextFrame() >= 0.001)
+	{
+		ScheduleFrame();
+		return;
+	}
+
 	// put animation stuff in here -- change some global variables
-	int ms = glutGet(GLUT_ELAPSED_TIME);
-	ms %= MS_PER_CYCLE;
-	Time = MS_SPEED * (float)ms / (float)MS_PER_CYCLE;
+	if (Pacer.IsAnimating())
+	{
+		Time = GetAnimationTime(glutGet(GLUT_ELAPSED_TIME));
+	}
 
 	glutSetWindow(MainWindow);
 	glutPostRedisplay();
 }
 
+// the animation parameter Time at ms milliseconds, the light orbit and the gear angles follow from it:
+float
+GetAnimationTime(int ms)
+{
+	ms %= MS_PER_CYCLE;
+	return MS_SPEED * (float)ms / (float)MS_PER_CYCLE;
+}
+
+// arm the timer for the next frame, when one is wanted and no timer is on its way yet:
+void
+ScheduleFrame()
+{
+	if (FrameTimerArmed || !Pacer.WantsFrame())
+	{
+		return;
+	}
+	FrameTimerArmed = true;
+	glutTimerFunc((unsigned int)(1000. * Pacer.GetSecondsToNextFrame() + 0.5), Animate, 0);
+}
+
+// ask for a frame at the paced rate, for inputs that come faster than the frames:
+void
+PostRedraw()
+{
+	Pacer.RequestRedraw();
+	ScheduleFrame();
+}
+
 
 // draw the complete scene:
 void
@@ -923,10 +814,43 @@ Display()
 
 	//Window in which we wnat graphics 
 	glutSetWindow(MainWindow);
+	Pacer.BeginFrame();
+	Profile.BeginFrame();
+	ScopedCpuTimer timer(Profile, PROFILE_DISPLAY);
+
+	glDrawBuffer(GL_BACK);
+	DrawScene();
+
+	// the back buffer is undefined after the swap, so the capture reads it now:
+	if (Capture.IsCapturing())
+	{
+		glReadBuffer(GL_BACK);
+		Capture.Capture(0, 0, WindowWidth, WindowHeight);
+	}
+
+	// swap the double-buffered framebuffers:
+	glutSwapBuffers();
+
+	// be sure the graphics buffer has been sent:
+	// note: be sure to use glFlush( ) here, not glFinish( ) !
+	glFlush();
+
+	if (HudOn && CoreProfile && Pacer.GetSeconds() - LastHudPrint >= 1.)
+	{
+		LastHudPrint = Pacer.GetSeconds();
+		PrintProfile(stderr);
+	}
 
+	// the next frame, if there is one, comes from the frame timer:
+	Pacer.EndFrame();
+	ScheduleFrame();
+}
 
+// draw the scene into the current framebuffer, the window's or the offscreen one:
+void
+DrawScene()
+{
 	// erase the background:
-	glDrawBuffer(GL_BACK);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	glEnable(GL_DEPTH_TEST);
@@ -936,11 +860,12 @@ Display()
 #endif
 
 	// specify shading to be Flat:
-	glShadeModel(GL_SMOOTH);
+	if (!CoreProfile)
+		glShadeModel(GL_SMOOTH);
 
 	// set the viewport to a square centered in the window:
-	GLsizei vx = glutGet(GLUT_WINDOW_WIDTH);
-	GLsizei vy = glutGet(GLUT_WINDOW_HEIGHT);
+	GLsizei vx = WindowWidth;
+	GLsizei vy = WindowHeight;
 	GLsizei v = vx < vy ? vx : vy;			// minimum dimension
 	GLint xl = (vx - v) / 2;
 	GLint yb = (vy - v) / 2;
@@ -950,155 +875,88 @@ Display()
 	// set the viewing volume:
 	// remember that the Z clipping  values are actually
 	// given as DISTANCES IN FRONT OF THE EYE
-	// USE gluOrtho2D( ) IF YOU ARE DOING 2D !
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
+	// the matrices are made on the CPU, the shaders get them as uniforms
+	Matrix4 projection;
 	if (WhichProjection == ORTHO)
-		glOrtho(-2.f, 2.f, -2.f, 2.f, 0.1f, 1000.f);
+		projection = Matrix4::Ortho(-2.f, 2.f, -2.f, 2.f, 0.1f, 1000.f);
 	else
-		gluPerspective(70.f, 1.f, 0.1f, 1000.f);
+		projection = Matrix4::Perspective(70.f, 1.f, 0.1f, 1000.f);
 
-	// place the objects into the scene:
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-
-	// set the eye position, look-at position, and up-vector:
-	gluLookAt(0., 0., 30., 0., 0., 0., 0., 1., 0.);
-
-	// rotate the scene:
-	glRotatef((GLfloat)Yrot, 0.f, 1.f, 0.f);
-	glRotatef((GLfloat)Xrot, 1.f, 0.f, 0.f);
-
-	// uniformly scale the scene:
+	// set the eye position, look-at position, and up-vector, rotate the scene and uniformly scale it:
 	if (Scale < MINSCALE)
 		Scale = MINSCALE;
-	glScalef((GLfloat)Scale, (GLfloat)Scale, (GLfloat)Scale);
-
-		// set the fog parameters:
-	if (DepthCueOn != 0)
-	{
-		glFogi(GL_FOG_MODE, FOGMODE);
-		glFogfv(GL_FOG_COLOR, FOGCOLOR);
-		glFogf(GL_FOG_DENSITY, FOGDENSITY);
-		glFogf(GL_FOG_START, FOGSTART);
-		glFogf(GL_FOG_END, FOGEND);
-		glEnable(GL_FOG);
-	}
-	else
-	{
-		glDisable(GL_FOG);
-	}
+	Matrix4 view = Matrix4::LookAt(Vec3(0.f, 0.f, 30.f), Vec3(0.f, 0.f, 0.f), Vec3(0.f, 1.f, 0.f)) *
+		Matrix4::Rotate(Yrot, 0.f, 1.f, 0.f) * Matrix4::Rotate(Xrot, 1.f, 0.f, 0.f) * Matrix4::Scale(Scale);
 
-	// possibly draw the axes:
-	if (AxesOn)
+	// the gear LOD depends on the projection and the scale, so pick it once they are set:
+	CurrentLod = GetGearLod();
+	if (DebugOn != 0)
 	{
-		glColor3fv(&Colors[WhichColor][0]);
-		glCallList(AxesList);
+		fprintf(stderr, "Gear LOD %d\n", CurrentLod);
 	}
 
-	// since we are using glScalef( ), be sure the normals get unitized:
-	glEnable(GL_NORMALIZE);
-	glLightModelfv(GL_LIGHT_MODEL_AMBIENT, MulArray3(.2, White));
-	glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_FALSE);
-
 	// Light 0
 	float xLight = -ORBIT_HEIGHT * sin(2 * M_PI * Time / ORBIT_SLOWDOWN);
 	float yLight = 0.;
 	float zLight = ORBIT_HEIGHT * cos(2 * M_PI * Time / ORBIT_SLOWDOWN);
-	//SetPointLight(GL_LIGHT0, xLight, yLight, zLight, 1., 1., 1.);
-	if (Light0On) {
-		glPushMatrix();
-		//glDisable(GL_LIGHTING);
-		glColor3f(1., 1., 1.);
-		glTranslatef(xLight, yLight, zLight);
-		glutSolidSphere(2.0, 180, 180);
-		glEnd();
-		//glEnable(GL_LIGHTING);
-		glPopMatrix();
-	}
-
-	if (Light0On) {
-		glEnable(GL_LIGHT0);
-	}
-	else {
-		glDisable(GL_LIGHT0);
+	if (!Light0On) {
 		xLight = -60.;
 		yLight = 10.;
 		zLight = 10.;
 	}
 
-	if (ControlLinesAreShown) {
-		glPushMatrix();
-		glTranslatef(-GEAR_RADIUS1, 0., 0.);
-		glCallList(DebugLinesList);
-		glPopMatrix();
-	}
-
-	// Shaders part
-	Pattern->Use();
-
 	// Components for per-fragment lighting
-	Pattern->SetUniformVariable("xLight", xLight);
-	Pattern->SetUniformVariable("yLight", yLight);
-	Pattern->SetUniformVariable("zLight", zLight);
-	Pattern->SetUniformVariable("uKa", (float)0.33);
-	Pattern->SetUniformVariable("uKd", (float)0.33);
-	Pattern->SetUniformVariable("uKs", (float)0.33);
-	Pattern->SetUniformVariable("uColor", 0.039, 0.492, 0.547);
-	Pattern->SetUniformVariable("uSpecularColor", 0.7, 0.7, 0.6);
-	Pattern->SetUniformVariable("uShininess", (float)20.);
-	Pattern->SetUniformVariable("isSecond", false);
-	Pattern->SetUniformVariable("isCorroded", IsCorroded);
+	UpdateFrameBlock(xLight, yLight, zLight);
+	for (int gear = 0; gear < Train.GetNumGears(); gear++)
+		UpdateMaterialBlock(gear);
 
-	glPushMatrix();
-	glTranslatef(-GEAR_RADIUS1, 0., 0.);
-	if (!Freeze) {
-		glRotatef(2 * M_PI * Time, 0., 0., 1.);
+	// gear 1 turns 2 pi Time degrees, as it always did, and the train solver turns the rest with it:
+	Train.Update(Freeze ? 0. : 2. * M_PI * Time * M_PI / 180.);
+	if (ControlLinesAreShown)
+	{
+		// Time goes MS_SPEED / MS_PER_CYCLE a millisecond, which makes gear 1 turn this many radians a second:
+		ScopedCpuTimer timer(Profile, PROFILE_CONTACTS);
+		Contacts.Update(Train, Freeze ? 0. : 2. * M_PI * M_PI / 180. * 1000. * MS_SPEED / MS_PER_CYCLE);
 	}
-	glCallList(Gear1List);
-	glPopMatrix();
-
-	// Components for per-fragment lighting
-	Pattern->SetUniformVariable("uColor", 0.715, 0.254, 0.055);
-	Pattern->SetUniformVariable("isSecond", true);
 
-	glPushMatrix();
-	glTranslatef(GEAR_TEETH_HGT + GEAR_RADIUS1 * GEAR_NUMTEETH2 / GEAR_NUMTEETH1, 0., 0.);
-	if (!Freeze) {
-		glRotatef(- 2 * M_PI * Time * GEAR_NUMTEETH1 / GEAR_NUMTEETH2, 0., 0., 1.);
+	// the measurement draws the gears over and over, then clears what it drew:
+	if (MeasureCorrosionRequested)
+	{
+		MeasureCorrosionRequested = false;
+		MeasureCorrosion(projection, view);
 	}
-	glCallList(Gear2List);
-	glPopMatrix();
 
-	// Shaders off
-	Pattern->Use(0);
+	// the axes, the light and the contact lines:
+	DrawHelpers(projection, view, xLight, yLight, zLight);
 
-	glDisable(GL_DEPTH_TEST);
-	glColor3f(0.f, 1.f, 1.f);
-	//DoRasterString( 0.f, 1.f, 0.f, (char *)"Gear Transmission" );
-
-	// the projection matrix is reset to define a scene whose
-	// world coordinate system goes from 0-100 in each axis
-	//
-	// this is called "percent units", and is just a convenience
-	//
-	// the modelview matrix is reset to identity as we don't
-	// want to transform these coordinates
-	glDisable(GL_DEPTH_TEST);
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluOrtho2D(0.f, 100.f, 0.f, 100.f);
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-	glColor3f(1.f, 1.f, 1.f);
-	//DoRasterString(5.f, 5.f, 0.f, (char*)"Lighting");
-
-	// swap the double-buffered framebuffers:
-	glutSwapBuffers();
+	// Shaders part
+	DrawGears(projection, view, WhichCorrosionMode);
 
-	// be sure the graphics buffer has been sent:
-	// note: be sure to use glFlush( ) here, not glFinish( ) !
-	glFlush();
+	glDisable(GL_DEPTH_TEST);
+	if (!CoreProfile)
+	{
+		Profile.BeginGpu(PROFILE_OVERLAY);
+		glColor3f(0.f, 1.f, 1.f);
+		//DoRasterString( 0.f, 1.f, 0.f, (char *)"Gear Transmission" );
+
+		// the projection matrix is reset to define a scene whose
+		// world coordinate system goes from 0-100 in each axis
+		//
+		// this is called "percent units", and is just a convenience
+		//
+		// the modelview matrix is reset to identity as we don't
+		// want to transform these coordinates
+		glMatrixMode(GL_PROJECTION);
+		glLoadIdentity();
+		gluOrtho2D(0.f, 100.f, 0.f, 100.f);
+		glMatrixMode(GL_MODELVIEW);
+		glLoadIdentity();
+		glColor3f(1.f, 1.f, 1.f);
+		//DoRasterString(5.f, 5.f, 0.f, (char*)"Lighting");
+		if (HudOn)
+			DrawHud(100.f * 15.f / v);
+		Profile.EndGpu();
+	}
 }
 
 void
@@ -1119,6 +977,15 @@ DoColorMenu(int id)
 	glutPostRedisplay();
 }
 
+void
+DoCorrosionMenu(int id)
+{
+	WhichCorrosionMode = id;
+
+	glutSetWindow(MainWindow);
+	glutPostRedisplay();
+}
+
 void
 DoDebugMenu(int id)
 {
@@ -1170,6 +1037,11 @@ DoMainMenu(int id)
 		// gracefully close the graphics window:
 		// gracefully exit the program:
 		glutSetWindow(MainWindow);
+		if (Capture.IsCapturing())
+		{
+			Capture.Stop();
+			Capture.PrintStats(stderr);
+		}
 		glFinish();
 		glutDestroyWindow(MainWindow);
 		exit(0);
@@ -1192,25 +1064,371 @@ DoProjectMenu(int id)
 	glutPostRedisplay();
 }
 
-// use glut to display a string of characters using a raster font:
+// changes the configuration, the gears that change are generated again:
 void
-DoRasterString(float x, float y, float z, char* s)
+DoGearsMenu(int id)
 {
-	glRasterPos3f((GLfloat)x, (GLfloat)y, (GLfloat)z);
-
-	char c;			// one character to print
-	for (; (c = *s) != '\0'; s++)
+	GearTrainConfig config = Config;
+	switch (id)
 	{
-		glutBitmapCharacter(GLUT_BITMAP_TIMES_ROMAN_24, c);
-	}
-}
+	case SELECT_GEAR:
+		SelectedGear = (SelectedGear + 1) % Config.GetNumGears();
+		fprintf(stderr, "Selected gear %d\n", SelectedGear + 1);
+		break;
 
-// use glut to display a string of characters using a stroke font:
-void
-DoStrokeString(float x, float y, float z, float ht, char* s)
-{
-	glPushMatrix();
-	glTranslatef((GLfloat)x, (GLfloat)y, (GLfloat)z);
+	case MORE_TEETH:
+	case FEWER_TEETH:
+		if (!config.ChangeTeeth(SelectedGear, id == MORE_TEETH ? 1 : -1))
+			fprintf(stderr, "Gear %d gets its teeth from the rest of its planetary set\n", SelectedGear + 1);
+		break;
+
+	case MORE_ARMS:
+	case FEWER_ARMS:
+		if (!config.ChangeArms(SelectedGear, id == MORE_ARMS ? 1 : -1))
+			fprintf(stderr, "Gear %d has no arms\n", SelectedGear + 1);
+		break;
+
+	case HIGHER_TEETH:
+		config.TeethHeight += 0.25f;
+		break;
+
+	case LOWER_TEETH:
+		config.TeethHeight -= 0.25f;
+		break;
+
+	case RELOAD_CONFIG:
+		if (!config.Load(ConfigFile))
+			fprintf(stderr, "Cannot read the config file '%s'\n", ConfigFile);
+		if (SelectedGear >= config.GetNumGears())
+			SelectedGear = 0;
+		break;
+
+	case SAVE_CONFIG:
+		if (Config.Save(ConfigFile))
+			fprintf(stderr, "Saved the gears to '%s'\n", ConfigFile);
+		else
+			fprintf(stderr, "Cannot write the config file '%s'\n", ConfigFile);
+		break;
+	}
+
+	if (id != SELECT_GEAR && id != SAVE_CONFIG)
+	{
+		ChangeConfig(config);
+		Config.Print(stderr);
+	}
+
+	glutSetWindow(MainWindow);
+	glutPostRedisplay();
+}
+
+void
+DoLodMenu(int id)
+{
+	WhichLod = id;
+
+	glutSetWindow(MainWindow);
+	glutPostRedisplay();
+}
+
+// one part of the helper buffer, with the helper VAO bound:
+void
+DrawHelperPart(int part)
+{
+	HelperPart& helperPart = HelperParts[part];
+	if (helperPart.First.empty())
+		return;
+	glMultiDrawArrays(helperPart.Mode, &helperPart.First[0], &helperPart.Count[0], (GLsizei)helperPart.First.size());
+}
+
+// the axes, the light marker and the contact lines, whichever are on, in one pass:
+void
+DrawHelpers(const Matrix4& projection, const Matrix4& view, float xLight, float yLight, float zLight)
+{
+	if (!AxesOn && !Light0On && !ControlLinesAreShown)
+		return;
+
+	Helper->Use();
+	Helper->SetUniformVariable(HelperProjectionUniform, projection);
+
+	// depth cueing, with the fog parameters glFog( ) used to get:
+	float fogColor[3] = { FOGCOLOR[0], FOGCOLOR[1], FOGCOLOR[2] };
+	Helper->SetUniformVariable(HelperFogUniform, DepthCueOn != 0 ? 1 : 0);
+	Helper->SetUniformVariable(HelperFogStartUniform, FOGSTART);
+	Helper->SetUniformVariable(HelperFogEndUniform, FOGEND);
+	Helper->SetUniformVariable(HelperFogColorUniform, fogColor);
+
+	glBindVertexArray(HelperVao);
+	if (AxesOn)
+	{
+		float color[3] = { Colors[WhichColor][0], Colors[WhichColor][1], Colors[WhichColor][2] };
+		Helper->SetUniformVariable(HelperModelViewUniform, view);
+		Helper->SetUniformVariable(HelperColorUniform, color);
+		glLineWidth(AXES_WIDTH);
+		Profile.BeginGpu(PROFILE_AXES);
+		DrawHelperPart(HELPER_AXES);
+		Profile.EndGpu();
+		glLineWidth(1.);
+	}
+
+	if (Light0On)
+	{
+		Helper->SetUniformVariable(HelperModelViewUniform, view * Matrix4::Translate(xLight, yLight, zLight));
+		Helper->SetUniformVariable(HelperColorUniform, 1.f, 1.f, 1.f);
+		Profile.BeginGpu(PROFILE_LIGHT);
+		DrawHelperPart(HELPER_LIGHT);
+		Profile.EndGpu();
+	}
+
+	glBindVertexArray(0);
+
+	if (ControlLinesAreShown)
+	{
+		Helper->SetUniformVariable(HelperModelViewUniform, view);
+		Helper->SetUniformVariable(HelperColorUniform, 1.f, 1.f, 1.f);
+		Profile.BeginGpu(PROFILE_CONTACT_LINES);
+		DrawContacts();
+		Profile.EndGpu();
+	}
+}
+
+// the lines of action and the contact points on them, as Contacts left them in this frame:
+// the buffer is orphaned before it is filled, so the driver never waits for the frames still drawing from it
+void
+DrawContacts()
+{
+	const std::vector<Vec3>& lines = Contacts.GetLines();
+	const std::vector<Vec3>& points = Contacts.GetPoints();
+	if (lines.empty())
+		return;
+
+	if (ContactVao == 0)
+	{
+		glGenVertexArrays(1, &ContactVao);
+		glBindVertexArray(ContactVao);
+		glGenBuffers(1, &ContactVbo);
+		glBindBuffer(GL_ARRAY_BUFFER, ContactVbo);
+		glEnableVertexAttribArray(HELPER_VERTEX_ATTRIB);
+		glVertexAttribPointer(HELPER_VERTEX_ATTRIB, 3, GL_FLOAT, GL_FALSE, sizeof(Vec3), (GLvoid*)0);
+	}
+	glBindVertexArray(ContactVao);
+	glBindBuffer(GL_ARRAY_BUFFER, ContactVbo);
+	glBufferData(GL_ARRAY_BUFFER, (lines.size() + points.size()) * sizeof(Vec3), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, lines.size() * sizeof(Vec3), &lines[0]);
+	if (!points.empty())
+		glBufferSubData(GL_ARRAY_BUFFER, lines.size() * sizeof(Vec3), points.size() * sizeof(Vec3), &points[0]);
+
+	glDrawArrays(GL_LINES, 0, (GLsizei)lines.size());
+	glPointSize(5.);
+	glDrawArrays(GL_POINTS, (GLint)lines.size(), (GLsizei)points.size());
+	glPointSize(1.);
+	glBindVertexArray(0);
+}
+
+void
+DoRenderModeMenu(int id)
+{
+	WhichRenderMode = id;
+	if (CoreProfile && WhichRenderMode == DISPLAY_LISTS)
+		WhichRenderMode = VERTEX_BUFFERS;		// a core profile has no display lists
+
+	glutSetWindow(MainWindow);
+	glutPostRedisplay();
+}
+
+// draw a set of gear buffers, instances > 1 repeats them with gl_InstanceID counting up:
+// with instancesPerModel > 0 the instances take their model matrices from GearModelVbo, from the one
+// of gear firstModel on, a matrix for every instancesPerModel instances
+void
+DrawGearBuffers(GearBuffers& buffers, int instances, int firstModel, int instancesPerModel)
+{
+	if (buffers.NumIndices == 0)
+		return;
+	glBindVertexArray(buffers.Vao);
+	if (instancesPerModel > 0)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, GearModelVbo);
+		for (int column = 0; column < 4; column++)
+		{
+			glEnableVertexAttribArray(GEAR_MODEL_ATTRIB + column);
+			glVertexAttribPointer(GEAR_MODEL_ATTRIB + column, 4, GL_FLOAT, GL_FALSE, sizeof(Matrix4),
+				(GLvoid*)(firstModel * sizeof(Matrix4) + column * 4 * sizeof(float)));
+			glVertexAttribDivisor(GEAR_MODEL_ATTRIB + column, instancesPerModel);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	glEnable(GL_PRIMITIVE_RESTART);
+	glPrimitiveRestartIndex(GEAR_MESH_RESTART);
+	if (instances > 1)
+		glDrawElementsInstanced(GL_TRIANGLE_STRIP, buffers.NumIndices, GL_UNSIGNED_INT, (GLvoid*)0, instances);
+	else
+		glDrawElements(GL_TRIANGLE_STRIP, buffers.NumIndices, GL_UNSIGNED_INT, (GLvoid*)0);
+	glDisable(GL_PRIMITIVE_RESTART);
+	if (instancesPerModel > 0)
+	{
+		for (int column = 0; column < 4; column++)
+			glDisableVertexAttribArray(GEAR_MODEL_ATTRIB + column);
+	}
+	glBindVertexArray(0);
+}
+
+// draw one gear with the selected render path, in the LOD of the current frame:
+// both passes of the depth prepass count for the gear's GPU time.
+// The planets of a set are instances of their first one, drawn by one call that reads their model matrices
+// from GearModelVbo, so they share its mesh and its material; display lists cannot be instanced and draw
+// them one after the other.
+void
+DrawGear(int gearIndex, const Matrix4& view, const Matrix4* models)
+{
+	GearDrawable& gear = Drawables[DrawableOf[gearIndex]];
+	GearLod& lod = gear.Lods[CurrentLod];
+	glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, MaterialUbos[gearIndex]);
+	Profile.BeginGpu(gearIndex == 0 ? PROFILE_GEAR1 : PROFILE_OTHER_GEARS);
+
+	// the model matrix is in the model-view for everything that is not instanced, pattern.vert gets the identity:
+	// (an instanced draw leaves the attribute undefined)
+	for (int column = 0; column < 4; column++)
+		glVertexAttrib4f(GEAR_MODEL_ATTRIB + column, column == 0, column == 1, column == 2, column == 3);
+
+	int numInstances = Train.GetNumInstances(gearIndex);
+	bool instanced = numInstances > 1 && WhichRenderMode != DISPLAY_LISTS;
+	int instances = instanced ? numInstances : 1;
+	int perModel = instanced ? 1 : 0;
+	for (int i = 0; i < (instanced ? 1 : numInstances); i++)
+	{
+		Matrix4 modelView = instanced ? view : view * models[gearIndex + i];
+		CurrentGearShader->Program->SetUniformVariable(CurrentGearShader->ModelViewMatrix, modelView);
+		CurrentGearShader->Program->SetUniformVariable(CurrentGearShader->NormalMatrix, modelView.GetNormalMatrix());
+		switch (WhichRenderMode)
+		{
+		case DISPLAY_LISTS:
+			glCallList(lod.List);
+			break;
+
+		case VERTEX_BUFFERS:
+			DrawGearBuffers(lod.Whole, instances, gearIndex, perModel);
+			break;
+
+		case INSTANCED_TEETH:
+			// pattern.vert rotates every instance by gl_InstanceID * uToothAngle from the material block,
+			// instanced planets take the next matrix after every NumTeeth instances
+			DrawGearBuffers(lod.Tooth, gear.NumTeeth * instances, gearIndex, gear.NumTeeth * perModel);
+			DrawGearBuffers(lod.Hub, instances, gearIndex, perModel);
+			break;
+		}
+	}
+	Profile.EndGpu();
+}
+
+// make one of the gear programs current, DrawGear( ) then sets its matrices:
+void
+UseGearShader(int shader, const Matrix4& projection)
+{
+	CurrentGearShader = &GearShaders[shader];
+	CurrentGearShader->Program->Use();
+	CurrentGearShader->Program->SetUniformVariable(CurrentGearShader->ProjectionMatrix, projection);
+}
+
+// draw all gears of the train, cutting the corrosion holes the given way:
+// with the depth prepass, the corroded gears are drawn twice -- first only into the depth buffer,
+// then shaded where the depth is exactly what the prepass left (pattern.vert has an invariant gl_Position)
+void
+DrawGears(const Matrix4& projection, const Matrix4& view, int corrosionMode)
+{
+	int numGears = Train.GetNumGears();
+	const Matrix4* models = Train.GetTransforms();
+
+	// the instanced planets read their model matrices from the buffer:
+	if (GearModelVbo == 0)
+		glGenBuffers(1, &GearModelVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, GearModelVbo);
+	glBufferData(GL_ARRAY_BUFFER, numGears * sizeof(Matrix4), models, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// gears with no instances are drawn with another one, or are carriers with nothing to draw:
+	if (corrosionMode == CORROSION_DISCARD) {
+		UseGearShader(SHADER_DISCARD, projection);
+		for (int gear = 0; gear < numGears; gear++) {
+			if (Train.GetNumInstances(gear) > 0) {
+				DrawGear(gear, view, models);
+			}
+		}
+		CurrentGearShader->Program->Use(0);
+		return;
+	}
+
+	UseGearShader(SHADER_DEPTH_ONLY, projection);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	for (int gear = 0; gear < numGears; gear++) {
+		if (IsGearCorroded(gear) && Train.GetNumInstances(gear) > 0) {
+			DrawGear(gear, view, models);
+		}
+	}
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	UseGearShader(SHADER_EARLY_Z, projection);
+	for (int gear = 0; gear < numGears; gear++) {
+		if (Train.GetNumInstances(gear) == 0) {
+			continue;
+		}
+		if (IsGearCorroded(gear)) {
+			glDepthFunc(GL_EQUAL);
+			glDepthMask(GL_FALSE);
+			DrawGear(gear, view, models);
+			glDepthMask(GL_TRUE);
+			glDepthFunc(GL_LESS);
+		}
+		else {
+			DrawGear(gear, view, models);
+		}
+	}
+	CurrentGearShader->Program->Use(0);
+}
+
+// the coarsest gear LOD whose chord error stays below LOD_PIXEL_ERROR on the screen:
+// the gears sit about at the look-at point, 30 units in front of the eye, and Display( ) maps
+// the square viewport to 4 units in ortho and to 70 degrees in perspective
+int
+GetGearLod()
+{
+	if (WhichLod >= 0)
+		return WhichLod;
+
+	float v = (float)(WindowWidth < WindowHeight ? WindowWidth : WindowHeight);
+	float pixelsPerUnit;
+	if (WhichProjection == ORTHO)
+		pixelsPerUnit = Scale * v / 4.f;
+	else
+		pixelsPerUnit = Scale * v / (2.f * 30.f * tan(35.f * M_PI / 180.f));
+
+	int lod = NUM_GEAR_LODS - 1;
+	float maxError = GEAR_LOD_ERROR * pow(4., NUM_GEAR_LODS - 1);
+	while (lod > 0 && maxError * pixelsPerUnit > LOD_PIXEL_ERROR)
+	{
+		lod--;
+		maxError /= 4.;
+	}
+	return lod;
+}
+
+// use glut to display a string of characters using a raster font:
+void
+DoRasterString(float x, float y, float z, char* s, void* font)
+{
+	glRasterPos3f((GLfloat)x, (GLfloat)y, (GLfloat)z);
+
+	char c;			// one character to print
+	for (; (c = *s) != '\0'; s++)
+	{
+		glutBitmapCharacter(font, c);
+	}
+}
+
+// use glut to display a string of characters using a stroke font:
+void
+DoStrokeString(float x, float y, float z, float ht, char* s)
+{
+	glPushMatrix();
+	glTranslatef((GLfloat)x, (GLfloat)y, (GLfloat)z);
 	float sf = ht / (119.05f + 33.33f);
 	glScalef((GLfloat)sf, (GLfloat)sf, (GLfloat)sf);
 	char c;			// one character to print
@@ -1269,12 +1487,50 @@ InitMenus()
 	glutAddMenuEntry("Orthographic", ORTHO);
 	glutAddMenuEntry("Perspective", PERSP);
 
+	int numRenderModes = sizeof(RenderModeNames) / sizeof(char*);
+	int rendermodemenu = glutCreateMenu(DoRenderModeMenu);
+	for (int i = 0; i < numRenderModes; i++)
+	{
+		glutAddMenuEntry(RenderModeNames[i], i);
+	}
+
+	int numCorrosionModes = sizeof(CorrosionModeNames) / sizeof(char*);
+	int corrosionmenu = glutCreateMenu(DoCorrosionMenu);
+	for (int i = 0; i < numCorrosionModes; i++)
+	{
+		glutAddMenuEntry(CorrosionModeNames[i], i);
+	}
+
+	int lodmenu = glutCreateMenu(DoLodMenu);
+	glutAddMenuEntry("Automatic", -1);
+	for (int i = 0; i < NUM_GEAR_LODS; i++)
+	{
+		char lodName[32];
+		sprintf(lodName, "LOD %d", i);
+		glutAddMenuEntry(lodName, i);
+	}
+
+	int gearsmenu = glutCreateMenu(DoGearsMenu);
+	glutAddMenuEntry("Select Next Gear", SELECT_GEAR);
+	glutAddMenuEntry("More Teeth", MORE_TEETH);
+	glutAddMenuEntry("Fewer Teeth", FEWER_TEETH);
+	glutAddMenuEntry("More Arms", MORE_ARMS);
+	glutAddMenuEntry("Fewer Arms", FEWER_ARMS);
+	glutAddMenuEntry("Higher Teeth", HIGHER_TEETH);
+	glutAddMenuEntry("Lower Teeth", LOWER_TEETH);
+	glutAddMenuEntry("Reload Config File", RELOAD_CONFIG);
+	glutAddMenuEntry("Save Config File", SAVE_CONFIG);
+
 	int mainmenu = glutCreateMenu(DoMainMenu);
 	glutAddSubMenu("Axes", axesmenu);
 	glutAddSubMenu("Axis Colors", colormenu);
 
 	glutAddSubMenu("Depth Cue", depthcuemenu);
 	glutAddSubMenu("Projection", projmenu);
+	glutAddSubMenu("Render Mode", rendermodemenu);
+	glutAddSubMenu("Level of Detail", lodmenu);
+	glutAddSubMenu("Corrosion", corrosionmenu);
+	glutAddSubMenu("Gears", gearsmenu);
 	glutAddMenuEntry("Reset", RESET);
 	glutAddSubMenu("Debug", debugmenu);
 	glutAddMenuEntry("Quit", QUIT);
@@ -1283,6 +1539,37 @@ InitMenus()
 	glutAttachMenu(GLUT_RIGHT_BUTTON);
 }
 
+// link pattern.vert with two fragment shaders into one of the gear programs and resolve its uniforms:
+void
+CreateGearShader(int shader, char* cacheFile, char* fragFile, char* corrosionFile, char* name)
+{
+	GearShader& gearShader = GearShaders[shader];
+	gearShader.Program = new GLSLProgram();
+	gearShader.Program->SetProgramCache(cacheFile);
+	if (!gearShader.Program->Create((char*)"pattern.vert", fragFile, corrosionFile))
+	{
+		fprintf(stderr, "%s cannot be created!\n", name);
+	}
+	else
+	{
+		fprintf(stderr, "%s created.\n", name);
+	}
+	gearShader.Program->SetVerbose(false);
+
+	gearShader.ModelViewMatrix = gearShader.Program->GetUniformHandle("uModelViewMatrix");
+	gearShader.ProjectionMatrix = gearShader.Program->GetUniformHandle("uProjectionMatrix");
+	gearShader.NormalMatrix = gearShader.Program->GetUniformHandle("uNormalMatrix");
+
+	// the uniform blocks, the frame block stays bound, DrawGear( ) binds the material block of each gear:
+	gearShader.Program->SetUniformBlockBinding((char*)"FrameBlock", FRAME_BLOCK_BINDING);
+	gearShader.Program->SetUniformBlockBinding((char*)"MaterialBlock", MATERIAL_BLOCK_BINDING);
+	if (gearShader.Program->GetUniformBlockSize((char*)"FrameBlock") != (int)sizeof(FrameBlock) ||
+		gearShader.Program->GetUniformBlockSize((char*)"MaterialBlock") != (int)sizeof(MaterialBlock))
+	{
+		fprintf(stderr, "Uniform blocks in the shaders do not match FrameBlock and MaterialBlock!\n");
+	}
+}
+
 // initialize the glut and OpenGL libraries:
 // also setup callback functions
 void
@@ -1343,14 +1630,13 @@ InitGraphics()
 	glutMenuStateFunc(NULL);
 	glutTimerFunc(-1, NULL, 0);
 
-	// setup glut to call Animate( ) every time it has
-	// nothing it needs to respond to (which is most of the time)
-	// we don't need to do this for this program, and really should set the argument to NULL
-	// but, this sets us up nicely for doing animation
-	glutIdleFunc(Animate);
+	// there is no idle function, it would redraw as fast as the CPU allows:
+	// Display( ) arms a timer for Animate( ) when the next frame is due
+	glutIdleFunc(NULL);
 
 	// init the glew package (a window must be open to do this):
 #ifdef WIN32
+	glewExperimental = GL_TRUE;		// glew only finds the core profile functions with this
 	GLenum err = glewInit();
 	if (err != GLEW_OK)
 	{
@@ -1361,102 +1647,261 @@ InitGraphics()
 	fprintf(stderr, "Status: Using GLEW %s\n", glewGetString(GLEW_VERSION));
 #endif
 
-	// do this *after* opening the window and init'ing glew:
-	Pattern = new GLSLProgram();
-	bool valid = Pattern->Create("pattern.vert", "pattern.frag");
-	if (!valid)
+	// the shaders and the uniform buffers:
+	InitShaders();
+
+	// --fps 0 lets the buffer swap wait for the display instead of the frame timer:
+	if (TargetFps == 0.f && !SetSwapInterval(1))
 	{
-		fprintf(stderr, "Shader cannot be created!\n");
+		fprintf(stderr, "Vsync is not available, drawing at %.0f fps\n", DEFAULT_FPS);
+		TargetFps = DEFAULT_FPS;
 	}
-	else
+	Pacer.SetTargetFps(TargetFps);
+}
+
+// create the shader programs and their uniform buffers:
+// do this *after* opening the window and init'ing glew -- or making the offscreen context current
+void
+InitShaders()
+{
+	// each linked program is kept in its .glslcache file, so later starts skip compiling it
+	// as long as the shaders and the driver stay the same:
+	CreateGearShader(SHADER_DISCARD, (char*)"pattern.glslcache", (char*)"pattern.frag", (char*)"corrosion.frag", (char*)"Shader");
+	CreateGearShader(SHADER_EARLY_Z, (char*)"patternearlyz.glslcache", (char*)"pattern.frag", (char*)"corrosiondepth.frag", (char*)"Early-Z shader");
+	CreateGearShader(SHADER_DEPTH_ONLY, (char*)"depth.glslcache", (char*)"depth.frag", (char*)"corrosion.frag", (char*)"Depth prepass shader");
+
+	Helper = new GLSLProgram();
+	Helper->SetProgramCache("helper.glslcache");
+	if (!Helper->Create("helper.vert", "helper.frag"))
 	{
-		fprintf(stderr, "Shader created.\n");
+		fprintf(stderr, "Helper shader cannot be created!\n");
 	}
-	Pattern->SetVerbose(false);
+	HelperModelViewUniform = Helper->GetUniformHandle("uModelViewMatrix");
+	HelperProjectionUniform = Helper->GetUniformHandle("uProjectionMatrix");
+	HelperColorUniform = Helper->GetUniformHandle("uColor");
+	HelperFogUniform = Helper->GetUniformHandle("uFog");
+	HelperFogStartUniform = Helper->GetUniformHandle("uFogStart");
+	HelperFogEndUniform = Helper->GetUniformHandle("uFogEnd");
+	HelperFogColorUniform = Helper->GetUniformHandle("uFogColor");
+
+	glGenBuffers(1, &FrameUbo);
+	glBindBuffer(GL_UNIFORM_BUFFER, FrameUbo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, FrameUbo);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
-// initialize the display lists that will not change:
-// (a display list is a way to store opengl commands in
-//  memory so that they can be played back efficiently at a later time
-//  with a call to glCallList( )
+// initialize the geometry:
+// the gears and the helper buffer
 void
 InitLists()
 {
-	glutSetWindow(MainWindow);
+	if (MainWindow != 0)
+		glutSetWindow(MainWindow);
+
+	// All render paths are made by the same builder, so they can be benchmarked against each other
+	// the teeth, hob steps and arms of each gear are generated in parallel
+	MeshWorkers = new WorkerPool(MeshThreads);
+	UpdateGears();
+	CreateHelperBuffers();
+}
+
+// a low-poly sphere around the origin, one triangle strip per stack:
+void
+CreateLightMarker(float radius, int slices, int stacks)
+{
+	for (int stack = 0; stack < stacks; stack++)
+	{
+		float phi0 = (float)M_PI * stack / stacks;
+		float phi1 = (float)M_PI * (stack + 1) / stacks;
+		HelperBegin(HELPER_LIGHT, GL_TRIANGLE_STRIP);
+		for (int slice = 0; slice <= slices; slice++)
+		{
+			float theta = 2.f * (float)M_PI * slice / slices;
+			HelperVertex(radius * sin(phi0) * cos(theta), radius * cos(phi0), radius * sin(phi0) * sin(theta));
+			HelperVertex(radius * sin(phi1) * cos(theta), radius * cos(phi1), radius * sin(phi1) * sin(theta));
+		}
+	}
+}
+
+// make all the helper geometry and upload it into the helper buffer:
+void
+CreateHelperBuffers()
+{
+	HelperVertices.clear();
+	for (int part = 0; part < NUM_HELPER_PARTS; part++)
+	{
+		HelperParts[part].First.clear();
+		HelperParts[part].Count.clear();
+	}
 
-	// create the axes:
-	AxesList = glGenLists(1);
-	glNewList(AxesList, GL_COMPILE);
-	glLineWidth(AXES_WIDTH);
 	Axes(1.5);
-	glLineWidth(1.);
-	glEndList();
+	CreateLightMarker(LIGHT_RADIUS, LIGHT_SLICES, LIGHT_STACKS);
+
+	if (HelperVao == 0)
+	{
+		glGenVertexArrays(1, &HelperVao);
+		glBindVertexArray(HelperVao);
+		glGenBuffers(1, &HelperVbo);
+		glBindBuffer(GL_ARRAY_BUFFER, HelperVbo);
+		glEnableVertexAttribArray(HELPER_VERTEX_ATTRIB);
+		glVertexAttribPointer(HELPER_VERTEX_ATTRIB, 3, GL_FLOAT, GL_FALSE, sizeof(Vec3), (GLvoid*)0);
+		glBindVertexArray(0);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, HelperVbo);
+	glBufferData(GL_ARRAY_BUFFER, HelperVertices.size() * sizeof(Vec3), &HelperVertices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	CheckGlErrors("CreateHelperBuffers");
+}
+
+// start a new range of one primitive type in a part of the helper buffer, like glBegin( ):
+void
+HelperBegin(int part, GLenum mode)
+{
+	CurrentHelperPart = part;
+	HelperParts[part].Mode = mode;
+	HelperParts[part].First.push_back((GLint)HelperVertices.size());
+	HelperParts[part].Count.push_back(0);
+}
+
+// add a vertex to the current range, like glVertex3f( ):
+void
+HelperVertex(float x, float y, float z)
+{
+	HelperVertices.push_back(Vec3(x, y, z));
+	HelperParts[CurrentHelperPart].Count.back()++;
+}
+
+// the builder for one gear of the configuration:
+// the compiled-in transmission has its tooth angles and the profiles of every LOD worked out at compile time,
+// anything read or changed at run time takes the runtime path, with the tooth share the train fitted
+GearMeshBuilder
+MakeGearBuilder(int gear)
+{
+	const GearParams& params = Train.GetParams(gear);
+	bool defaults = Config.NumTeeth[0] == GEAR_NUMTEETH1 && Config.NumTeeth[1] == GEAR_NUMTEETH2 &&
+		Config.Radius1 == (float)GEAR_RADIUS1 && Config.TeethHeight == (float)GEAR_TEETH_HGT && Config.Backlash == (float)GEAR_BACKLASH;
+	if (defaults && gear == 0)
+		return GearMeshBuilder(Gear1Geometry(), params.Thickness, params.Arms);
+	if (defaults && gear == 1)
+		return GearMeshBuilder(Gear2Geometry(), params.Thickness, params.Arms);
+	GearMeshBuilder builder(params.NumTeeth, params.Radius, params.TeethHeight, params.Thickness, params.Arms, GEAR_POLYGONS);
+	builder.SetInternal(params.Internal, params.ProfileOffset);
+	builder.SetToothShare(params.ToothShare);
+	return builder;
+}
 
-	float gearRadius2 = GEAR_RADIUS1 * GEAR_NUMTEETH2 / GEAR_NUMTEETH1;
-
-	// Calculating contact point 1.
-	// Using "double" here for binary search to converge. Also, GEAR_GLOBAL_TOLERANCE can be increased.
-	double globalTangentAlpha = acos((GEAR_RADIUS1 + gearRadius2) / (GEAR_RADIUS1 + gearRadius2 + GEAR_TEETH_HGT));
-	double pxd1 = GEAR_RADIUS1;
-	double qxd1 = GEAR_RADIUS1 + GEAR_TEETH_HGT;
-	double xd1;
-	double yd1;
-	double radSq;
-	do {
-		xd1 = (pxd1 + qxd1) / 2;
-
-		yd1 = -1 / tan(globalTangentAlpha) * (xd1 - GEAR_RADIUS1 * cos(globalTangentAlpha)) + GEAR_RADIUS1 * sin(globalTangentAlpha);
-		radSq = (xd1 - GEAR_RADIUS1 - gearRadius2 - GEAR_TEETH_HGT) * (xd1 - GEAR_RADIUS1 - gearRadius2 - GEAR_TEETH_HGT) + yd1 * yd1;
-		if (radSq > (gearRadius2 + GEAR_TEETH_HGT) * (gearRadius2 + GEAR_TEETH_HGT)) {
-			pxd1 = xd1;
+// frees the display lists and buffers of every LOD of a gear:
+void
+DeleteGearDrawable(GearDrawable& gear)
+{
+	for (int lod = 0; lod < NUM_GEAR_LODS; lod++)
+	{
+		GearLod& gearLod = gear.Lods[lod];
+		if (gearLod.List != 0)
+			glDeleteLists(gearLod.List, 1);
+		GearBuffers* buffers[3] = { &gearLod.Whole, &gearLod.Tooth, &gearLod.Hub };
+		for (int i = 0; i < 3; i++)
+		{
+			glDeleteVertexArrays(1, &buffers[i]->Vao);
+			glDeleteBuffers(1, &buffers[i]->Vbo);
+			glDeleteBuffers(1, &buffers[i]->Ibo);
 		}
-		else {
-			qxd1 = xd1;
+	}
+}
+
+// Generates the meshes of the gears whose parameters changed since they were last built:
+// every drawable remembers the hash of the parameters its mesh was made from, the gears of the train
+// with the same hash share it, and the drawables no gear uses any more are freed.
+void
+UpdateGears()
+{
+	int numGears = Config.GetNumGears();
+	Train.Build(Config, Vec3(-Config.Radius1, 0.f, 0.f));
+	Contacts.Build(Train);
+
+	std::vector<GearDrawable> drawables;
+	std::vector<bool> kept(Drawables.size(), false);
+	DrawableOf.assign(numGears, -1);
+	for (int gear = 0; gear < numGears; gear++)
+	{
+		// the planets after the first of a set are its instances, a carrier has nothing to draw:
+		if (Train.GetNumInstances(gear) == 0)
+			continue;
+
+		// made for an earlier gear of the train, or before the change:
+		unsigned int hash = Train.GetParams(gear).Hash();
+		for (size_t i = 0; i < drawables.size() && DrawableOf[gear] < 0; i++)
+		{
+			if (drawables[i].ParamHash == hash)
+				DrawableOf[gear] = (int)i;
 		}
-	} while (abs(radSq - (gearRadius2 + GEAR_TEETH_HGT) * (gearRadius2 + GEAR_TEETH_HGT)) > GEAR_GLOBAL_TOLERANCE);
-
-	// Calculating contact point 2
-	double pxd2 = GEAR_RADIUS1;
-	double qxd2 = GEAR_RADIUS1 + GEAR_TEETH_HGT;
-	double xd2;
-	double yd2;
-	do {
-		xd2 = (pxd2 + qxd2) / 2;
-
-		yd2 = 1 / tan(globalTangentAlpha) * (xd2 - (GEAR_RADIUS1 + GEAR_TEETH_HGT + gearRadius2 - gearRadius2 * cos(globalTangentAlpha))) + gearRadius2 * sin(globalTangentAlpha);
-		radSq = xd2 * xd2 + yd2 * yd2;
-		if (radSq > (GEAR_RADIUS1 + GEAR_TEETH_HGT) * (GEAR_RADIUS1 + GEAR_TEETH_HGT)) {
-			qxd2 = xd2;
+		for (size_t i = 0; i < Drawables.size() && DrawableOf[gear] < 0; i++)
+		{
+			if (!kept[i] && Drawables[i].ParamHash == hash)
+			{
+				kept[i] = true;
+				DrawableOf[gear] = (int)drawables.size();
+				drawables.push_back(Drawables[i]);
+			}
 		}
-		else {
-			pxd2 = xd2;
+		if (DrawableOf[gear] >= 0)
+			continue;
+
+		char name[32];
+		sprintf(name, "Gear %d", gear + 1);
+		int startMs = glutGet(GLUT_ELAPSED_TIME);
+		GearDrawable drawable;
+		{
+			ScopedCpuTimer timer(Profile, PROFILE_MESH);
+			drawable = CreateGearDrawable(MakeGearBuilder(gear), name);
 		}
-	} while (abs(radSq - (GEAR_RADIUS1 + GEAR_TEETH_HGT) * (GEAR_RADIUS1 + GEAR_TEETH_HGT)) > GEAR_GLOBAL_TOLERANCE);
-
-	// Debugging lines Display List
-	DebugLinesList = glGenLists(1);
-	glNewList(DebugLinesList, GL_COMPILE);
-		glBegin(GL_POINTS);
-		glPointSize(5.);
-		glColor3f(1., 1., 1.);
-		glVertex3f(xd1, yd1, 0.);
-		glVertex3f(xd2, yd2, 0.);
-		glEnd();
-		glBegin(GL_LINES);
-		glVertex3f(GEAR_RADIUS1 * cos(globalTangentAlpha), GEAR_RADIUS1 * sin(globalTangentAlpha), 0.);
-		glVertex3f((GEAR_RADIUS1 + GEAR_TEETH_HGT + gearRadius2) - gearRadius2 * cos(globalTangentAlpha), -1 / tan(globalTangentAlpha) * ((GEAR_RADIUS1 + GEAR_TEETH_HGT + gearRadius2) - gearRadius2 * cos(globalTangentAlpha) - GEAR_RADIUS1 * cos(globalTangentAlpha)) + GEAR_RADIUS1 * sin(globalTangentAlpha), 0.);
-		glEnd();
-		glBegin(GL_LINES);
-		glVertex3f((GEAR_RADIUS1 + GEAR_TEETH_HGT + gearRadius2) - gearRadius2 * cos(globalTangentAlpha), gearRadius2 * sin(globalTangentAlpha), 0.);
-		glVertex3f(GEAR_RADIUS1 * cos(globalTangentAlpha), 1 / tan(globalTangentAlpha) * (GEAR_RADIUS1 * cos(globalTangentAlpha) - (GEAR_RADIUS1 + GEAR_TEETH_HGT + gearRadius2) + gearRadius2 * cos(globalTangentAlpha)) + gearRadius2 * sin(globalTangentAlpha), 0.);
-		glEnd();
-	glEndList();
+		drawable.ParamHash = hash;
+		drawable.Built = true;
+		DrawableOf[gear] = (int)drawables.size();
+		drawables.push_back(drawable);
+		fprintf(stderr, "%s generated in %d ms on %d threads\n", name, glutGet(GLUT_ELAPSED_TIME) - startMs, MeshWorkers->GetNumThreads());
+	}
+	for (size_t i = 0; i < Drawables.size(); i++)
+	{
+		if (!kept[i])
+			DeleteGearDrawable(Drawables[i]);
+	}
+	Drawables = drawables;
+	UpdateMaterialBuffers(numGears);
+}
 
-	// Gear 1 Display List
-	Gear1List = CreateGearDisplayList(GEAR_NUMTEETH1, GEAR_RADIUS1, GEAR_TEETH_HGT, GEAR_THICKNESS, GEAR_ARMS1, GEAR_POLYGONS, false);
+// one material block per gear of the train, a new one is uploaded by the next frame:
+void
+UpdateMaterialBuffers(int numGears)
+{
+	int numBuffers = (int)MaterialUbos.size();
+	if (numGears < numBuffers)
+		glDeleteBuffers(numBuffers - numGears, &MaterialUbos[numGears]);
+	MaterialUbos.resize(numGears);
+	Materials.resize(numGears);
+	for (int gear = numBuffers; gear < numGears; gear++)
+	{
+		glGenBuffers(1, &MaterialUbos[gear]);
+		glBindBuffer(GL_UNIFORM_BUFFER, MaterialUbos[gear]);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(MaterialBlock), NULL, GL_DYNAMIC_DRAW);
+		memset(&Materials[gear], 0xff, sizeof(MaterialBlock));	// nothing matches it, so the first frame uploads
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
 
-	// Gear 2 Display List
-	Gear2List = CreateGearDisplayList(GEAR_NUMTEETH2, gearRadius2, GEAR_TEETH_HGT, GEAR_THICKNESS, GEAR_ARMS2, GEAR_POLYGONS, true);
+// applies a change to the configuration and rebuilds what it affects,
+// a change that makes an impossible gear is taken back:
+void
+ChangeConfig(const GearTrainConfig& config)
+{
+	if (!config.IsValid())
+	{
+		fprintf(stderr, "Incorrect Gear Parameters! Keeping the previous ones.\n");
+		return;
+	}
+	Config = config;
+	UpdateGears();
 }
 
 // the keyboard callback:
@@ -1487,10 +1932,39 @@ Keyboard(unsigned char c, int x, int y)
 	case 'f':
 	case 'F':
 		Freeze = !Freeze;
-		if (Freeze)
-			glutIdleFunc(NULL);
+		Pacer.SetAnimating(!Freeze);
+		break;
+
+	case 'i':
+	case 'I':
+		PrintFrameStats();
+		break;
+
+	case 'k':
+		HudOn = !HudOn;
+		LastHudPrint = 0.;
+		break;
+
+	case 'K':
+		if (Profile.WriteCsv(ProfileCsvFile != NULL ? ProfileCsvFile : "profile.csv"))
+			fprintf(stderr, "Wrote the timing of the last %d frames to %s\n", PROFILER_SAMPLES, ProfileCsvFile != NULL ? ProfileCsvFile : "profile.csv");
 		else
-			glutIdleFunc(Animate);
+			fprintf(stderr, "Cannot write the timing to %s\n", ProfileCsvFile != NULL ? ProfileCsvFile : "profile.csv");
+		break;
+
+	case 'm':
+	case 'M':
+		glutSetWindow(MainWindow);
+		if (Capture.IsCapturing())
+		{
+			Capture.Stop();
+			Capture.PrintStats(stderr);
+		}
+		else
+		{
+			Capture.Start(CapturePrefix, CaptureFormat);
+			fprintf(stderr, "Capturing the frames to %s*\n", CapturePrefix);
+		}
 		break;
 
 	case 'l':
@@ -1503,15 +1977,97 @@ Keyboard(unsigned char c, int x, int y)
 		IsCorroded = !IsCorroded;
 		break;
 
+	case 'z':
+	case 'Z':
+		WhichCorrosionMode = (WhichCorrosionMode + 1) % (sizeof(CorrosionModeNames) / sizeof(char*));
+		fprintf(stderr, "Corrosion: %s\n", CorrosionModeNames[WhichCorrosionMode]);
+		break;
+
+	case 'b':
+	case 'B':
+		MeasureCorrosionRequested = true;
+		break;
+
+	case '[':
+		CorrosionDensity -= 0.05f;
+		if (CorrosionDensity < 0.f)
+			CorrosionDensity = 0.f;
+		fprintf(stderr, "Corrosion density: %.2f\n", CorrosionDensity);
+		break;
+
+	case ']':
+		CorrosionDensity += 0.05f;
+		if (CorrosionDensity > 1.f)
+			CorrosionDensity = 1.f;
+		fprintf(stderr, "Corrosion density: %.2f\n", CorrosionDensity);
+		break;
+
+	case '{':
+		CorrosionScale /= 1.25f;
+		fprintf(stderr, "Corrosion scale: %.2f\n", CorrosionScale);
+		break;
+
+	case '}':
+		CorrosionScale *= 1.25f;
+		fprintf(stderr, "Corrosion scale: %.2f\n", CorrosionScale);
+		break;
+
 	case 'x':
 	case 'X':
 		AxesOn = !AxesOn;
 		break;
 
+	case 'v':
+	case 'V':
+		WhichRenderMode = (WhichRenderMode + 1) % (sizeof(RenderModeNames) / sizeof(char*));
+		if (CoreProfile && WhichRenderMode == DISPLAY_LISTS)
+			WhichRenderMode = VERTEX_BUFFERS;	// a core profile has no display lists
+		fprintf(stderr, "Render mode: %s\n", RenderModeNames[WhichRenderMode]);
+		break;
+
 	case '0':
 		Light0On = !Light0On;
 		break;
 
+	case 'g':
+	case 'G':
+		DoGearsMenu(SELECT_GEAR);
+		break;
+
+	case 't':
+		DoGearsMenu(FEWER_TEETH);
+		break;
+
+	case 'T':
+		DoGearsMenu(MORE_TEETH);
+		break;
+
+	case 'a':
+		DoGearsMenu(FEWER_ARMS);
+		break;
+
+	case 'A':
+		DoGearsMenu(MORE_ARMS);
+		break;
+
+	case 'h':
+		DoGearsMenu(LOWER_TEETH);
+		break;
+
+	case 'H':
+		DoGearsMenu(HIGHER_TEETH);
+		break;
+
+	case 'r':
+	case 'R':
+		DoGearsMenu(RELOAD_CONFIG);
+		break;
+
+	case 'w':
+	case 'W':
+		DoGearsMenu(SAVE_CONFIG);
+		break;
+
 	default:
 		fprintf(stderr, "Don't know what to do with keyboard hit: '%c' (0x%0x)\n", c, c);
 	}
@@ -1608,8 +2164,319 @@ MouseMotion(int x, int y)
 	Xmouse = x;			// new current position
 	Ymouse = y;
 
-	glutSetWindow(MainWindow);
-	glutPostRedisplay();
+	// the mouse moves much more often than the frames come, and without a button it changes nothing:
+	if (ActiveButton != 0)
+	{
+		PostRedraw();
+	}
+}
+
+// read our own command line options:
+//	--config FILE		read the gear parameters from FILE (default: gears.cfg, if it is there)
+//	--set KEY=VALUE		set one gear parameter, after the config file: teeth1, teeth2, arms1, arms2,
+//						radius1, teeth_height, thickness, backlash, or a gear or planetary line of the config file
+//	--threads N			generate the gear meshes on N threads (default: one per hardware thread)
+//	--bench-mesh [N]	benchmark the mesh generation on 1 .. N threads and quit
+//	--simd PATH			sample the gear profiles with scalar, sse2 or avx2 code (default: the best the CPU has)
+//	--bench-simd		check and benchmark every profile sampling path and quit
+//	--bench-contacts	time the contact tracking of a train of hundreds of meshing pairs and quit
+//	--check-train [N]	turn the train through N steps of a turn of gear 1, measure where the teeth overlap and quit (default: 200)
+//	--seed N			seed of the corrosion pattern (default: 0)
+//	--corrosion-scale S	corrosion noise cells per unit of length (default: 3)
+//	--corrosion-density D	share of the corrosion noise that is eaten away, 0. - 1. (default: 0.45)
+//	--core				draw with an OpenGL 3.3 core profile context
+//	--fps N				draw at most N frames per second while animating, 0 follows the display with vsync (default: 60)
+//	--headless N		draw N frames of the animation without a window, write them to image files and quit
+//	--size WxH			size of the headless frames (default: 1024x1024)
+//	--time-step S		seconds of animation between two headless frames (default: 1/60)
+//	--output PREFIX		captured frames go to PREFIX00000.png, PREFIX00001.png, ...; "none" only times the headless ones (default: frame)
+//	--capture-format F	png or ppm, compressed or raw captured frames (default: png)
+//	--profile-csv FILE	where 'K' writes the timing (default: profile.csv); --headless writes it there at the end only when given
+void
+ParseCommandLine(int argc, char* argv[])
+{
+	// the config file comes first, so --set can override it wherever it is
+	bool configGiven = false;
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "--config") == 0)
+		{
+			ConfigFile = argv[i + 1];
+			configGiven = true;
+		}
+	}
+	if (!Config.Load(ConfigFile) && configGiven)
+		fprintf(stderr, "Cannot read the config file '%s'\n", ConfigFile);
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+		{
+			i++;
+		}
+		else if (strcmp(argv[i], "--set") == 0 && i + 1 < argc)
+		{
+			if (!Config.Set(argv[++i]))
+				fprintf(stderr, "Don't know what to do with gear parameter '%s'\n", argv[i]);
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+		{
+			MeshThreads = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--bench-mesh") == 0)
+		{
+			BenchMeshThreads = 0;
+			if (i + 1 < argc && isdigit(argv[i + 1][0]))
+				BenchMeshThreads = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--simd") == 0 && i + 1 < argc)
+		{
+			i++;
+			int path;
+			for (path = 0; path < NUM_SIMD_PATHS; path++)
+			{
+				if (strcmp(argv[i], GetGearSimdPathName(path)) == 0)
+					break;
+			}
+			if (path == NUM_SIMD_PATHS || !IsGearSimdPathSupported(path))
+				fprintf(stderr, "SIMD path '%s' is not available, using %s\n", argv[i], GetGearSimdPathName(GetGearSimdPath()));
+			else
+				SetGearSimdPath(path);
+		}
+		else if (strcmp(argv[i], "--bench-simd") == 0)
+		{
+			BenchSimd = true;
+		}
+		else if (strcmp(argv[i], "--bench-contacts") == 0)
+		{
+			BenchContacts = true;
+		}
+		else if (strcmp(argv[i], "--check-train") == 0)
+		{
+			CheckTrainFrames = 200;
+			if (i + 1 < argc && isdigit(argv[i + 1][0]))
+				CheckTrainFrames = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+		{
+			CorrosionSeed = (unsigned int)strtoul(argv[++i], NULL, 0);
+		}
+		else if (strcmp(argv[i], "--corrosion-scale") == 0 && i + 1 < argc)
+		{
+			CorrosionScale = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--corrosion-density") == 0 && i + 1 < argc)
+		{
+			CorrosionDensity = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--core") == 0)
+		{
+			CoreProfile = true;
+		}
+		else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc)
+		{
+			HeadlessFrames = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+		{
+			if (sscanf(argv[++i], "%dx%d", &WindowWidth, &WindowHeight) != 2 || WindowWidth <= 0 || WindowHeight <= 0)
+			{
+				fprintf(stderr, "Don't know what to do with frame size '%s'\n", argv[i]);
+				WindowWidth = WindowHeight = INIT_WINDOW_SIZE;
+			}
+		}
+		else if (strcmp(argv[i], "--time-step") == 0 && i + 1 < argc)
+		{
+			HeadlessTimeStep = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+		{
+			CapturePrefix = argv[++i];
+		}
+		else if (strcmp(argv[i], "--profile-csv") == 0 && i + 1 < argc)
+		{
+			ProfileCsvFile = argv[++i];
+		}
+		else if (strcmp(argv[i], "--capture-format") == 0 && i + 1 < argc)
+		{
+			++i;
+			if (strcmp(argv[i], "png") == 0)
+				CaptureFormat = IMAGE_PNG;
+			else if (strcmp(argv[i], "ppm") == 0)
+				CaptureFormat = IMAGE_PPM;
+			else
+				fprintf(stderr, "Don't know what to do with capture format '%s'\n", argv[i]);
+		}
+		else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+		{
+			TargetFps = (float)atof(argv[++i]);
+			if (TargetFps < 0.f)
+				TargetFps = DEFAULT_FPS;
+		}
+		else if (strncmp(argv[i], "--", 2) == 0)
+		{
+			fprintf(stderr, "Don't know what to do with command line option '%s'\n", argv[i]);
+		}
+	}
+}
+
+// Each gear starts at another place in the corrosion noise, picked by a counter based hash
+// of the seed and the gear -- the same integer mixer pattern.frag hashes its lattice with:
+static unsigned int
+MixBits(unsigned int x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+void
+GetCorrosionSeed(int gearId, float offset[4])
+{
+	unsigned int h = MixBits(MixBits(CorrosionSeed) ^ (unsigned int)gearId);
+	for (int i = 0; i < 3; i++)
+	{
+		h = MixBits(h + i);
+		offset[i] = (float)(h & 0xffff) / 256.f;	// anywhere in the first 256 noise cells
+	}
+	offset[3] = 0.f;
+}
+
+// the light moves every frame, so the frame block is simply uploaded every frame:
+void
+UpdateFrameBlock(float xLight, float yLight, float zLight)
+{
+	FrameBlock frame =
+	{
+		{ xLight, yLight, zLight, 1.f },
+		{ 0.f, 0.f, 0.f, 1.f },
+		{ 0.7f, 0.7f, 0.6f, 1.f }
+	};
+	glBindBuffer(GL_UNIFORM_BUFFER, FrameUbo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameBlock), &frame);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// gear 1 is the only one that corrodes:
+bool
+IsGearCorroded(int gear)
+{
+	return gear == 1 && IsCorroded;
+}
+
+// the material of a gear of the train, uploaded only when the keyboard or a rebuild changed it:
+// neighbouring gears mostly get different colors, gears 1 and 2 keep theirs
+void
+UpdateMaterialBlock(int gear)
+{
+	static const float colors[][4] =
+	{
+		{ 0.039f, 0.492f, 0.547f, 1.f },
+		{ 0.715f, 0.254f, 0.055f, 1.f },
+		{ 0.602f, 0.602f, 0.578f, 1.f },
+		{ 0.785f, 0.578f, 0.102f, 1.f },
+		{ 0.227f, 0.320f, 0.602f, 1.f }
+	};
+	int numColors = sizeof(colors) / sizeof(colors[0]);
+	if (DrawableOf[gear] < 0)
+		return;
+
+	MaterialBlock material;
+	memcpy(material.Color, colors[gear % numColors], sizeof(material.Color));
+	material.Ka = 0.33f;
+	material.Kd = 0.33f;
+	material.Ks = 0.33f;
+	material.Shininess = 20.f;
+	GetCorrosionSeed(gear + 1, material.CorrosionSeed);
+	material.CorrosionScale = CorrosionScale;
+	material.CorrosionDensity = CorrosionDensity;
+	material.ToothAngle = Drawables[DrawableOf[gear]].ToothAngle;
+	material.IsCorroded = IsGearCorroded(gear) ? 1 : 0;
+
+	if (memcmp(&material, &Materials[gear], sizeof(MaterialBlock)) == 0)
+		return;
+	Materials[gear] = material;
+	glBindBuffer(GL_UNIFORM_BUFFER, MaterialUbos[gear]);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(MaterialBlock), &material);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// --headless: draw the frames offscreen, write them out and print how long the drawing took:
+// a frame is timed from the start of drawing until glFinish( ) returns; the readback only starts after that,
+// and the files are written by the capture's own threads
+bool
+RenderHeadless()
+{
+	OffscreenRenderer renderer;
+	if (!renderer.Create(WindowWidth, WindowHeight, CoreProfile))
+	{
+		fprintf(stderr, "Cannot render without a window on this machine\n");
+		return false;
+	}
+	fprintf(stderr, "Headless: %s, OpenGL %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+	glClearColor(BACKCOLOR[0], BACKCOLOR[1], BACKCOLOR[2], BACKCOLOR[3]);
+	InitShaders();
+	InitLists();
+	Reset();
+
+	bool writeFiles = strcmp(CapturePrefix, "none") != 0;
+	if (writeFiles)
+	{
+		Capture.Start(CapturePrefix, CaptureFormat);
+	}
+	double firstMs = 0., totalMs = 0., minMs = 0., maxMs = 0.;
+	for (int frame = 0; frame < HeadlessFrames; frame++)
+	{
+		Time = GetAnimationTime((int)(1000.f * HeadlessTimeStep * frame + 0.5f));
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		Profile.BeginFrame();
+		renderer.Bind();
+		DrawScene();
+		glFinish();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		// the first frame also pays for the lazy setup in the driver, so it is kept apart:
+		if (frame == 0)
+		{
+			firstMs = ms;
+		}
+		else
+		{
+			totalMs += ms;
+			minMs = (frame == 1 || ms < minMs) ? ms : minMs;
+			maxMs = (frame == 1 || ms > maxMs) ? ms : maxMs;
+		}
+
+		// the framebuffer object is still bound for reading:
+		Capture.Capture(0, 0, WindowWidth, WindowHeight);
+	}
+	Capture.Stop();
+	CheckGlErrors("RenderHeadless");
+
+	fprintf(stderr, "%d frames of %d x %d, first frame %.2f ms", HeadlessFrames, WindowWidth, WindowHeight, firstMs);
+	if (HeadlessFrames > 1)
+	{
+		double averageMs = totalMs / (HeadlessFrames - 1);
+		fprintf(stderr, ", then %.2f ms per frame (%.2f - %.2f), %.1f fps", averageMs, minMs, maxMs, 1000. / averageMs);
+	}
+	fprintf(stderr, "\n");
+	if (writeFiles)
+	{
+		Capture.PrintStats(stderr);
+	}
+	if (ProfileCsvFile != NULL)
+	{
+		Profile.CollectAll();
+		PrintProfile(stderr);
+		if (!Profile.WriteCsv(ProfileCsvFile))
+			fprintf(stderr, "Cannot write the timing to %s\n", ProfileCsvFile);
+	}
+	return true;
 }
 
 // reset the transformations and the colors:
@@ -1634,8 +2501,10 @@ Reset()
 void
 Resize(int width, int height)
 {
-	// don't really need to do anything since window size is
-	// checked each time in Display( ):
+	// Display( ) and GetGearLod( ) use the size, the offscreen frames set it themselves:
+	WindowWidth = width;
+	WindowHeight = height;
+
 	glutSetWindow(MainWindow);
 	glutPostRedisplay();
 }
@@ -1647,16 +2516,158 @@ Visibility(int state)
 	if (DebugOn != 0)
 		fprintf(stderr, "Visibility: %d\n", state);
 
+	// a hidden window neither animates nor redraws, the frame timer stops by itself:
+	Pacer.SetVisible(state == GLUT_VISIBLE);
 	if (state == GLUT_VISIBLE)
 	{
 		glutSetWindow(MainWindow);
 		glutPostRedisplay();
 	}
-	else
+}
+
+// the number of display refreshes each buffer swap waits for, 0 does not wait:
+// (only wgl is asked, elsewhere the driver settings decide)
+bool
+SetSwapInterval(int interval)
+{
+#ifdef WIN32
+	typedef BOOL (WINAPI *SwapIntervalProc)(int);
+	SwapIntervalProc swapInterval = (SwapIntervalProc)wglGetProcAddress("wglSwapIntervalEXT");
+	return swapInterval != NULL && swapInterval(interval);
+#else
+	(void)interval;
+	return false;
+#endif
+}
+
+// draw the gears CORROSION_MEASURE_FRAMES times with each corrosion mode and print what the GPU did:
+// the time is GPU time from a timer query, the fragment shader invocations need
+// GL_ARB_pipeline_statistics_query and count both passes of the depth prepass
+void
+MeasureCorrosion(const Matrix4& projection, const Matrix4& view)
+{
+	if (!IsCorroded)
+		fprintf(stderr, "The gears are not corroded, 'c' turns the corrosion on\n");
+	bool countInvocations = GearShaders[SHADER_DISCARD].Program->IsExtensionSupported("GL_ARB_pipeline_statistics_query");
+
+	GLuint queries[2];
+	glGenQueries(2, queries);
+	Profile.SetEnabled(false);
+	int numCorrosionModes = sizeof(CorrosionModeNames) / sizeof(char*);
+	for (int mode = 0; mode < numCorrosionModes; mode++)
+	{
+		// one frame first, so neither mode pays for compiling the programs on their first use:
+		DrawGears(projection, view, mode);
+		glFinish();
+
+		glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+		if (countInvocations)
+			glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, queries[1]);
+		for (int i = 0; i < CORROSION_MEASURE_FRAMES; i++)
+		{
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			DrawGears(projection, view, mode);
+		}
+		glEndQuery(GL_TIME_ELAPSED);
+		if (countInvocations)
+			glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+
+		GLuint64 nanoseconds = 0;
+		GLuint64 invocations = 0;
+		glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &nanoseconds);
+		if (countInvocations)
+			glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &invocations);
+		fprintf(stderr, "Corrosion %-13s: %7.3f ms GPU", CorrosionModeNames[mode], 1.e-6 * nanoseconds / CORROSION_MEASURE_FRAMES);
+		if (countInvocations)
+			fprintf(stderr, ", %9llu fragment shader invocations", (unsigned long long)(invocations / CORROSION_MEASURE_FRAMES));
+		fprintf(stderr, " per frame\n");
+	}
+	glDeleteQueries(2, queries);
+	Profile.SetEnabled(true);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	CheckGlErrors("MeasureCorrosion");
+}
+
+// print the timing of the last frames while animating:
+void
+PrintFrameStats()
+{
+	FrameStats stats = Pacer.GetStats();
+	if (stats.NumFrames == 0)
+	{
+		fprintf(stderr, "No animated frames yet\n");
+		return;
+	}
+	fprintf(stderr, "Last %d frames: %.1f fps (target %.0f), frame %.2f ms (%.2f - %.2f), drawing %.2f ms\n",
+		stats.NumFrames, stats.Fps, Pacer.GetTargetFps(), stats.AverageMs, stats.MinMs, stats.MaxMs, stats.AverageWorkMs);
+}
+
+// the teeth touching in this frame, under the timing table while the contact lines are shown:
+void
+FormatContactLine(char* line, size_t size)
+{
+	snprintf(line, size, "%d teeth touching in %d meshing pairs, sliding up to %.2f units/s", Contacts.GetTotalContacts(),
+		Contacts.GetNumPairs(), Contacts.GetMaxSlidingSpeed());
+}
+
+// one line of the timing table, for the HUD and for stderr:
+void
+FormatProfileLine(int section, char* line, size_t size)
+{
+	ProfileStats stats = Profile.GetStats(section);
+	snprintf(line, size, "%-16s %s %7.3f %7.3f %7.3f", Profile.GetSectionName(section),
+		Profile.IsGpuSection(section) ? "GPU" : "CPU", stats.AverageMs, stats.P99Ms, stats.MaxMs);
+}
+
+// the timing of every section that ran in the last PROFILER_SAMPLES frames:
+void
+PrintProfile(FILE* fp)
+{
+	fprintf(fp, "%-16s     %7s %7s %7s\n", "Last frames", "avg ms", "p99 ms", "max ms");
+	for (int section = 0; section < Profile.GetNumSections(); section++)
+	{
+		if (Profile.GetStats(section).NumSamples == 0)
+			continue;
+		char line[128];
+		FormatProfileLine(section, line, sizeof(line));
+		fprintf(fp, "%s\n", line);
+	}
+	if (ControlLinesAreShown)
 	{
-		// could optimize by keeping track of the fact
-		// that the window is not visible and avoid
-		// animating or redrawing it ...
+		char line[128];
+		FormatContactLine(line, sizeof(line));
+		fprintf(fp, "%s\n", line);
+	}
+	if (Profile.GetNumDropped() > 0)
+		fprintf(fp, "%d GPU timings came back too late and were dropped\n", Profile.GetNumDropped());
+}
+
+// the timing table in the top left corner, in the percent units of the overlay:
+void
+DrawHud(float lineHeight)
+{
+	FrameStats frameStats = Pacer.GetStats();
+	char line[128];
+	float y = 100.f - lineHeight;
+	glColor3f(1.f, 1.f, 0.f);
+	snprintf(line, sizeof(line), "%.1f fps, frame %.2f ms, drawing %.2f ms", frameStats.Fps, frameStats.AverageMs, frameStats.AverageWorkMs);
+	DoRasterString(1.f, y, 0.f, line, GLUT_BITMAP_8_BY_13);
+	y -= lineHeight;
+	snprintf(line, sizeof(line), "%-16s     %7s %7s %7s", "", "avg ms", "p99 ms", "max ms");
+	DoRasterString(1.f, y, 0.f, line, GLUT_BITMAP_8_BY_13);
+	for (int section = 0; section < Profile.GetNumSections(); section++)
+	{
+		if (Profile.GetStats(section).NumSamples == 0)
+			continue;
+		y -= lineHeight;
+		FormatProfileLine(section, line, sizeof(line));
+		DoRasterString(1.f, y, 0.f, line, GLUT_BITMAP_8_BY_13);
+	}
+	if (ControlLinesAreShown)
+	{
+		y -= lineHeight;
+		FormatContactLine(line, sizeof(line));
+		DoRasterString(1.f, y, 0.f, line, GLUT_BITMAP_8_BY_13);
 	}
 }
 
@@ -1680,68 +2691,60 @@ const float LENFRAC = 0.10f;
 // fraction of length to use as start location of the characters:
 const float BASEFRAC = 1.10f;
 
-//	Draw a set of 3D axes:
+//	Put a set of 3D axes into the helper buffer:
 //	(length is the axis length in world coordinates)
 void
 Axes(float length)
 {
-	glBegin(GL_LINE_STRIP);
-	glVertex3f(length, 0., 0.);
-	glVertex3f(0., 0., 0.);
-	glVertex3f(0., length, 0.);
-	glEnd();
-	glBegin(GL_LINE_STRIP);
-	glVertex3f(0., 0., 0.);
-	glVertex3f(0., 0., length);
-	glEnd();
+	HelperBegin(HELPER_AXES, GL_LINE_STRIP);
+	HelperVertex(length, 0., 0.);
+	HelperVertex(0., 0., 0.);
+	HelperVertex(0., length, 0.);
+	HelperBegin(HELPER_AXES, GL_LINE_STRIP);
+	HelperVertex(0., 0., 0.);
+	HelperVertex(0., 0., length);
 
 	float fact = LENFRAC * length;
 	float base = BASEFRAC * length;
 
-	glBegin(GL_LINE_STRIP);
+	HelperBegin(HELPER_AXES, GL_LINE_STRIP);
 	for (int i = 0; i < 4; i++)
 	{
 		int j = xorder[i];
 		if (j < 0)
 		{
-			glEnd();
-			glBegin(GL_LINE_STRIP);
+			HelperBegin(HELPER_AXES, GL_LINE_STRIP);
 			j = -j;
 		}
 		j--;
-		glVertex3f(base + fact * xx[j], fact * xy[j], 0.0);
+		HelperVertex(base + fact * xx[j], fact * xy[j], 0.0);
 	}
-	glEnd();
 
-	glBegin(GL_LINE_STRIP);
+	HelperBegin(HELPER_AXES, GL_LINE_STRIP);
 	for (int i = 0; i < 5; i++)
 	{
 		int j = yorder[i];
 		if (j < 0)
 		{
 
-			glEnd();
-			glBegin(GL_LINE_STRIP);
+			HelperBegin(HELPER_AXES, GL_LINE_STRIP);
 			j = -j;
 		}
 		j--;
-		glVertex3f(fact * yx[j], base + fact * yy[j], 0.0);
+		HelperVertex(fact * yx[j], base + fact * yy[j], 0.0);
 	}
-	glEnd();
 
-	glBegin(GL_LINE_STRIP);
+	HelperBegin(HELPER_AXES, GL_LINE_STRIP);
 	for (int i = 0; i < 6; i++)
 	{
 		int j = zorder[i];
 		if (j < 0)
 		{
 
-			glEnd();
-			glBegin(GL_LINE_STRIP);
+			HelperBegin(HELPER_AXES, GL_LINE_STRIP);
 			j = -j;
 		}
 		j--;
-		glVertex3f(0.0, fact * zy[j], base + fact * zx[j]);
+		HelperVertex(0.0, fact * zy[j], base + fact * zx[j]);
 	}
-	glEnd();
 }
@@ -0,0 +1,38 @@
+#ifndef VEC3_H
+#define VEC3_H
+
+// A 3 component float vector for the CPU side matrix stack in matrix4.h.
+// glslprogram.h sees VEC3_H and adds SetUniformVariable( ) and SetAttributeVariable( ) for it.
+
+#ifndef _USE_MATH_DEFINES
+#define _USE_MATH_DEFINES
+#endif
+#include <math.h>
+
+class Vec3
+{
+  public:
+	float	x, y, z;
+
+		Vec3() : x(0.f), y(0.f), z(0.f) { }
+		Vec3(float x0, float y0, float z0) : x(x0), y(y0), z(z0) { }
+
+	Vec3	operator+(const Vec3& v) const	{ return Vec3(x + v.x, y + v.y, z + v.z); }
+	Vec3	operator-(const Vec3& v) const	{ return Vec3(x - v.x, y - v.y, z - v.z); }
+	Vec3	operator*(float s) const		{ return Vec3(s * x, s * y, s * z); }
+
+	Vec3	Cross(const Vec3& v) const		{ return Vec3(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x); }
+	float	Dot(const Vec3& v) const		{ return x * v.x + y * v.y + z * v.z; }
+	float	Length() const					{ return sqrtf(Dot(*this)); }
+	void	GetVec3(float v[3]) const		{ v[0] = x; v[1] = y; v[2] = z; }
+
+	// the unit vector, the zero vector stays zero:
+	Vec3
+	Unit() const
+	{
+		float length = Length();
+		return length > 0.f ? *this * (1.f / length) : *this;
+	}
+};
+
+#endif		// #ifndef VEC3_H
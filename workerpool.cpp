@@ -0,0 +1,101 @@
+#include "workerpool.h"
+
+// numThreads <= 0 means one thread per hardware thread:
+WorkerPool::WorkerPool(int numThreads)
+{
+	if (numThreads <= 0) {
+		numThreads = (int)std::thread::hardware_concurrency();
+	}
+	if (numThreads <= 0) {
+		numThreads = 1;
+	}
+
+	Task = NULL;
+	NumTasks = 0;
+	NextTask = 0;
+	Busy = 0;
+	Generation = 0;
+	Quit = false;
+
+	for (int i = 1; i < numThreads; i++) {
+		Threads.push_back(std::thread(&WorkerPool::WorkerLoop, this));
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		Quit = true;
+	}
+	WakeUp.notify_all();
+	for (size_t i = 0; i < Threads.size(); i++) {
+		Threads[i].join();
+	}
+}
+
+int
+WorkerPool::GetNumThreads() const
+{
+	return (int)Threads.size() + 1;
+}
+
+// calls task(0) ... task(numTasks - 1) across the pool and returns when all of them are done:
+void
+WorkerPool::Run(int numTasks, const std::function<void(int)>& task)
+{
+	if (Threads.empty() || numTasks <= 1) {
+		for (int i = 0; i < numTasks; i++) {
+			task(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		Task = &task;
+		NumTasks = numTasks;
+		NextTask = 0;
+		Busy = (int)Threads.size();
+		Generation++;
+	}
+	WakeUp.notify_all();
+
+	RunTasks();
+
+	std::unique_lock<std::mutex> lock(Mutex);
+	Finished.wait(lock, [this] { return Busy == 0; });
+	Task = NULL;
+}
+
+void
+WorkerPool::RunTasks()
+{
+	for (int i = NextTask++; i < NumTasks; i = NextTask++) {
+		(*Task)(i);
+	}
+}
+
+void
+WorkerPool::WorkerLoop()
+{
+	unsigned int seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(Mutex);
+			WakeUp.wait(lock, [this, seen] { return Quit || Generation != seen; });
+			if (Quit) {
+				return;
+			}
+			seen = Generation;
+		}
+
+		RunTasks();
+
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			Busy--;
+		}
+		Finished.notify_one();
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+// A small persistent pool of worker threads for parallel-for style jobs.
+// The calling thread takes part in every job, so a pool of N threads starts N - 1 workers.
+// Tasks are handed out one index at a time from an atomic counter, so uneven tasks balance themselves.
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool
+{
+  private:
+	std::vector<std::thread>	Threads;
+	std::mutex					Mutex;
+	std::condition_variable		WakeUp;			// signals the workers that a job has started or the pool quits
+	std::condition_variable		Finished;		// signals the caller that all workers are done with the job
+	const std::function<void(int)> *	Task;
+	int							NumTasks;
+	std::atomic<int>			NextTask;
+	int							Busy;			// workers still inside the current job
+	unsigned int				Generation;		// counts the jobs, so workers can tell a new job from a spurious wake up
+	bool						Quit;
+
+	void	RunTasks();
+	void	WorkerLoop();
+
+  public:
+		WorkerPool(int = 0);
+		~WorkerPool();
+
+	int		GetNumThreads() const;
+	void	Run(int, const std::function<void(int)>&);
+};
+
+#endif		// #ifndef WORKERPOOL_H